@@ -0,0 +1,78 @@
+#ifndef _basis_
+#define _basis_
+
+#include <array>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace comb{
+
+/// One tabulated basis function, read once and shared by all users
+struct Table
+{
+	std::vector<double> s;
+	std::vector<double> real;
+	std::vector<double> imag;
+	/// File the table is read from
+	std::string file;
+	/// Range of s the table is read for, see Registry::table. Infinite where the table reaches the end of the file
+	double lower = -std::numeric_limits<double>::infinity();
+	double upper = std::numeric_limits<double>::infinity();
+};
+
+/// Files of the eight basis functions entering comb::Combination
+struct BasisSet
+{
+	/// Order of the files, the indices are used by Combination::tables
+	enum Function {f0_a, f0_b, f0_c, f12_a, f12_b, f12_c, G0, Gp};
+
+	std::string directory = "../../gammaKKpi_amp/basisfunctions/";
+	std::array<std::string,8> files = {"f0_a.txt", "f0_b.txt", "f0_c.txt", "f12_a.txt", "f12_b.txt", "f12_c.txt", "G0.txt", "Gp.txt"};
+
+	/// Returns the path of function k
+	std::string path(std::size_t k) const {return directory + files[k];}
+};
+
+/// Registry of named basis sets and of the tables read for them.
+/// Every file is read once per process on first use, sets using the same file share its table. Thread-safe
+class Registry
+{
+public:
+	/// The registry of this process. Contains the sets "standard" and "f12_c_a2", the latter with the alternative F^(1/2) inhomogeneity f12_c_a2.txt
+	static Registry& instance();
+
+	/// Registers set as name, replaces a set of the same name. No file is read
+	void add(const std::string& name, const BasisSet& set);
+	/// Returns the set registered as name. Throws std::out_of_range if there is none
+	BasisSet set(const std::string& name) const;
+	/// Names of all registered sets
+	std::vector<std::string> names() const;
+
+	/// Returns the table in file, which is read on the first request. The file contains s, modulus and phase
+	std::shared_ptr<const Table> table(const std::string& file);
+	/// Returns the rows of the table in file with s in [lower,upper] and Registry::margin rows beyond on either side, see input::read_table.
+	/// A cached table covering the range is returned as it is, otherwise the file is read again for the union of both ranges. Users of the old table keep it
+	std::shared_ptr<const Table> table(const std::string& file, double lower, double upper);
+	/// Rows read beyond a requested range. The natural boundary condition of the spline at the end of a table changes the spline
+	/// by a factor 2-sqrt(3)=0.27 less per row, i.e. inside the range by a relative 0.27^margin=2e-14 only
+	static constexpr std::size_t margin = 24;
+	/// Returns the tables of all functions of the set registered as name
+	std::array<std::shared_ptr<const Table>,8> tables(const std::string& name);
+	/// Number of files read so far
+	std::size_t size() const;
+
+private:
+	Registry();
+
+	mutable std::mutex mutex;
+	std::map<std::string,BasisSet> sets;
+	std::map<std::string,std::shared_ptr<const Table>> cache;
+};
+
+}
+
+#endif
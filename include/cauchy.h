@@ -7,9 +7,12 @@
 
 #include <algorithm>
 #include <complex>
+#include <exception>
 #include <functional>
 #include <initializer_list>
+#include <thread>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
 /// Facilities for dealing with complex valued functions.
@@ -20,6 +23,15 @@ using Complex_function = std::function<Complex(const Complex&)>;
 using gsl::Interval;
 using namespace std::complex_literals;
 
+/// @brief Restrict templates to callables `C` taking a double and returning a
+/// `Complex`.
+///
+/// Like in `gsl`, every routine taking a `Curve` has an overload for any
+/// such callable, which avoids the type erasure of `std::function`.
+template<class C>
+using Complex_callable = std::enable_if_t<std::is_same<std::decay_t<
+    decltype(std::declval<const C&>()(0.))>,Complex>::value,int>;
+
 // -- Basic facilities --------------------------------------------------------
 
 std::vector<double> real(const std::vector<Complex>& vec);
@@ -32,7 +44,7 @@ std::vector<double> imag(const std::vector<Complex>& vec);
 
 /// Piecewise defined function.
 
-/// @tparam Argument needs to provide `operator<=`.
+/// @tparam Argument needs to provide `operator<`.
 template<class Return, class Argument>
 class PiecewiseFunction {
 public:
@@ -54,6 +66,20 @@ public:
 
     Return operator()(const Argument& x) const;
         ///< Evaluate curve at `x`.
+    void operator()(std::size_t n, const Argument* x, Return* values) const;
+        ///< Write the value at `x[k]` to `values[k]` for k<n. Consecutive
+        ///< points in the same piece, e.g. sorted quadrature nodes, are
+        ///< assigned without a search.
+
+    std::size_t index(const Argument& x) const;
+        ///< Return the index of the piece containing `x` by binary search.
+        ///< Throws std::invalid_argument outside the domain of definition.
+    const Function& piece(std::size_t i) const {return pieces.at(i);}
+    std::size_t size() const noexcept {return pieces.size();}
+    const std::vector<Argument>& boundaries() const noexcept
+    {
+        return boundaries_;
+    }
 
     template<class F>
     F for_each_piece(F f);
@@ -65,8 +91,6 @@ public:
 private:
     std::vector<Function> pieces;
     std::vector<Argument> boundaries_;
-    typename std::vector<Argument>::const_iterator second;
-        // points to the second element of `boundaries_`
 };
 
 using Piecewise_curve = PiecewiseFunction<Complex,double>;
@@ -83,13 +107,14 @@ least one curve"};
     if (boundaries_.size() != pieces.size()+1)
         throw std::invalid_argument{"PiecewiseFunction needs to contain one \
 curve less than boundaries."};
-    const bool sorted{std::is_sorted(boundaries_.begin(),boundaries_.end(),
-            std::less_equal<Argument>{})};
+    const bool sorted{std::adjacent_find(boundaries_.begin(),
+            boundaries_.end(),[](const Argument& a, const Argument& b)
+            {
+                return !(a<b);
+            })==boundaries_.end()};
     if (!sorted)
         throw std::invalid_argument{"PiecewiseFunction's boundaries need to \
 be sorted in strictly ascending order"};
-
-    second = std::next(boundaries_.begin());
 }
 
 template<class Return, class Argument>
@@ -98,26 +123,40 @@ PiecewiseFunction<Return,Argument>::PiecewiseFunction(const Function& f,
         const Argument& right)
     : pieces{f}, boundaries_{left,right}
 {
-    if (left>=right)
+    if (!(left<right))
         throw std::invalid_argument{"PiecewiseFunction's boundaries need to \
 be sorted in strictly ascending order"};
-    second = std::next(boundaries_.begin());
 }
 
 template<class Return, class Argument>
-Return PiecewiseFunction<Return,Argument>::operator()(const Argument& x) const
+std::size_t PiecewiseFunction<Return,Argument>::index(const Argument& x) const
 {
     if (x<boundaries_.front() || boundaries_.back()<x)
         throw std::invalid_argument{"PiecewiseFunction cannot be evaluated \
 outside domain of definition"};
 
-    const auto it{std::find_if(second,boundaries_.end(),
-            [x](const Argument& y)
-            {
-                return x<=y;
-            })};
-    const auto dist{std::distance(second,it)};
-    return pieces[dist](x);
+    // first upper boundary not below x
+    const auto second{std::next(boundaries_.begin())};
+    return static_cast<std::size_t>(std::distance(second,
+                std::lower_bound(second,std::prev(boundaries_.end()),x)));
+}
+
+template<class Return, class Argument>
+Return PiecewiseFunction<Return,Argument>::operator()(const Argument& x) const
+{
+    return pieces[index(x)](x);
+}
+
+template<class Return, class Argument>
+void PiecewiseFunction<Return,Argument>::operator()(std::size_t n,
+        const Argument* x, Return* values) const
+{
+    std::size_t i{0};
+    for (std::size_t k=0; k<n; ++k) {
+        if (!(boundaries_[i]<x[k] && !(boundaries_[i+1]<x[k])))
+            i = index(x[k]);
+        values[k] = pieces[i](x[k]);
+    }
 }
 
 template<class Return, class Argument>
@@ -129,6 +168,37 @@ F PiecewiseFunction<Return,Argument>::for_each_piece(F f)
 
 // -- Integration -------------------------------------------------------------
 
+/// Result of the integration of a complex valued function.
+struct ComplexResult {
+    Complex value;
+    gsl::Result real;
+        ///< integration of the real part
+    gsl::Result imag;
+        ///< integration of the imaginary part
+
+    std::size_t evaluations() const noexcept
+        ///< Return the total number of evaluations of the integrand.
+    {
+        return real.evaluations+imag.evaluations;
+    }
+    bool converged() const noexcept
+    {
+        return real.converged() && imag.converged();
+    }
+};
+
+ComplexResult c_integrate_result(const Curve& c, double lower, double upper,
+        const gsl::Integration& integrate);
+    ///< Integrate `c` in the interval [`lower`,`upper`] using
+    ///< `integrate.integrate`. Return values, error estimates, number of
+    ///< evaluations etc. of both the real and the imaginary part.
+    ///< No exception is thrown if the integration does not converge.
+template<class C, class Integrator, Complex_callable<C> =0>
+ComplexResult c_integrate_result(const C& c, double lower, double upper,
+        const Integrator& integrate);
+    ///< Same as above for any callable `c` and integration routine, e.g.
+    ///< `gsl::Cquad`, whose templated `integrate` is used.
+
 std::tuple<Complex,double,double> c_integrate(const Curve& c,
         double lower, double upper, const gsl::Integration& integrate);
     ///< Integrate `c` in the interval [`lower`,`upper`] using `integrate`.
@@ -139,6 +209,9 @@ std::tuple<Complex,double,double> c_integrate(const Curve& c,
     ///< needs to integrate both real valued and complex valued functions.
     ///< Using `c_integrate`, the same instance of `Integration` can be used for
     ///< both.
+template<class C, class Integrator, Complex_callable<C> =0>
+std::tuple<Complex,double,double> c_integrate(const C& c, double lower,
+        double upper, const Integrator& integrate);
 
 std::tuple<Complex,double,double> c_integrate(const Complex_function& f,
         const Curve& c, const Curve& c_derivative, double lower, double upper,
@@ -146,6 +219,32 @@ std::tuple<Complex,double,double> c_integrate(const Complex_function& f,
     ///< Integrate `f` along c` in the interval [`lower`,`upper`] using
     ///< `integrate`. Return the value of the integral, the error of the real
     ///< part and the error of the imaginary part.
+template<class F, class C, class D, class Integrator, Complex_callable<C> =0,
+    Complex_callable<D> =0>
+std::tuple<Complex,double,double> c_integrate(const F& f, const C& c,
+        const D& c_derivative, double lower, double upper,
+        const Integrator& integrate);
+
+template<class Integrator>
+ComplexResult c_integrate_result(const Piecewise_curve& c, double lower,
+        double upper, const Integrator& integrate, bool concurrent=false);
+    ///< @brief Integrate `c` in [`lower`,`upper`] split at the boundaries of
+    ///< its pieces.
+    ///<
+    ///< Every piece is integrated on its own, such that no subdivisions are
+    ///< spent on locating the kinks where the pieces join. The pieces are
+    ///< integrated one after another unless `concurrent` is set and
+    ///< `Integrator` is copyable, e.g. `gsl::Cquad`, then they are
+    ///< integrated in parallel on copies of `integrate`. The pieces then
+    ///< need to be safe to call concurrently. Values, error estimates and
+    ///< evaluations of the pieces are added up. Throws
+    ///< std::invalid_argument if [`lower`,`upper`] exceeds the domain.
+template<class Integrator>
+std::tuple<Complex,double,double> c_integrate(const Piecewise_curve& c,
+        double lower, double upper, const Integrator& integrate,
+        bool concurrent=false);
+    ///< Same as above, returns like the other overloads of `c_integrate`
+    ///< and throws if the integration of a piece does not converge.
     
     
 Complex complex_integration(const Curve& f, double lower, double upper, 
@@ -156,6 +255,19 @@ Complex complex_integration(const Curve& f, double lower, double upper,
     ///<@param upper upper integration limit
     ///<@param adaptive 'false' to use Gaussian quadrature, 'true' to use adaptive method
     ///<@param integration_nodes number of points used in the quadrature if 'adaptive=false'
+template<class C, Complex_callable<C> =0>
+Complex complex_integration(const C& f, double lower, double upper,
+        bool adaptive=true, std::size_t integration_nodes=300);
+
+ComplexResult complex_integration_result(const Curve& f, double lower,
+        double upper, bool adaptive=true,
+        const std::size_t integration_nodes=300);
+    ///< Same as `complex_integration`, but return the full `ComplexResult`.
+    ///< For Gauss-Legendre quadrature, the error estimates are zero and the
+    ///< number of evaluations of the real part equals `integration_nodes`.
+template<class C, Complex_callable<C> =0>
+ComplexResult complex_integration_result(const C& f, double lower,
+        double upper, bool adaptive=true, std::size_t integration_nodes=300);
 
 // -- Interpolation -----------------------------------------------------------
 
@@ -184,6 +296,9 @@ private:
 Interpolate sample(const Complex_function& f, const Curve& c,
         const Interval& i, gsl::InterpolationMethod m);
     ///< Interpolate `f` along `c`.
+template<class F, class C, Complex_callable<C> =0>
+Interpolate sample(const F& f, const C& c, const Interval& i,
+        gsl::InterpolationMethod m);
 
     ///< Return interpolator for data pairs
     ///< ( i[k], f(c(i[k])) ). It is assumed that `i` is sorted (in ascending
@@ -193,6 +308,8 @@ Interpolate sample(const Complex_function& f, const Curve& c,
 Interpolate sample(const Curve& c, const Interval& i,
         gsl::InterpolationMethod m);
     ///< Interpolate `c` along `i`.
+template<class C, Complex_callable<C> =0>
+Interpolate sample(const C& c, const Interval& i, gsl::InterpolationMethod m);
 
     ///< Return interpolator for data pairs
     ///< ( i[k], c(i[k]) ). It is assumed that `i` is sorted (in ascending
@@ -206,6 +323,208 @@ Complex derivative(const Curve& c, double value, double step_size,
     ///< Compute the derivative of `c` at `value`.
     
     ///< For the other parameters see `gsl::derivative`.
+template<class C, Complex_callable<C> =0>
+Complex derivative(const C& c, double value, double step_size,
+        gsl::DerivativeMethod method=gsl::DerivativeMethod::central);
+
+// -- Implementation of the templates -----------------------------------------
+
+template<class C, class Integrator, Complex_callable<C>>
+ComplexResult c_integrate_result(const C& c, double lower, double upper,
+        const Integrator& integrate)
+{
+    ComplexResult result;
+    result.real = integrate.integrate([&c](double x){return c(x).real();},
+            lower,upper);
+    result.imag = integrate.integrate([&c](double x){return c(x).imag();},
+            lower,upper);
+    result.value = Complex{result.real.value,result.imag.value};
+    return result;
+}
+
+template<class C, class Integrator, Complex_callable<C>>
+std::tuple<Complex,double,double> c_integrate(const C& c, double lower,
+        double upper, const Integrator& integrate)
+{
+    const gsl::Value real_part{
+            integrate([&c](double x){return c(x).real();},lower,upper)};
+    const gsl::Value imaginary_part{
+            integrate([&c](double x){return c(x).imag();},lower,upper)};
+    const Complex result{real_part.first,imaginary_part.first};
+    return std::make_tuple(result,real_part.second,imaginary_part.second);
+}
+
+template<class F, class C, class D, class Integrator, Complex_callable<C>,
+    Complex_callable<D>>
+std::tuple<Complex,double,double> c_integrate(const F& f, const C& c,
+        const D& c_derivative, double lower, double upper,
+        const Integrator& integrate)
+{
+    return c_integrate(
+            [&](double x) -> Complex
+            {
+                return f(c(x))*c_derivative(x);
+            },
+            lower,upper,integrate);
+}
+
+template<class Integrator>
+ComplexResult c_integrate_result(const Piecewise_curve& c, double lower,
+        double upper, const Integrator& integrate, bool concurrent)
+{
+    if (upper<lower) {
+        ComplexResult result{c_integrate_result(c,upper,lower,integrate,
+                concurrent)};
+        result.value = -result.value;
+        result.real.value = -result.real.value;
+        result.imag.value = -result.imag.value;
+        return result;
+    }
+    const auto& b{c.boundaries()};
+    if (lower<b.front() || b.back()<upper)
+        throw std::invalid_argument{"PiecewiseFunction cannot be integrated \
+outside domain of definition"};
+
+    std::vector<std::size_t> pieces;
+    std::vector<std::pair<double,double>> ranges;
+    for (std::size_t i=c.index(lower); i<c.size(); ++i) {
+        const double left{std::max(lower,b[i])};
+        const double right{std::min(upper,b[i+1])};
+        if (left<right) {
+            pieces.push_back(i);
+            ranges.emplace_back(left,right);
+        }
+        if (!(b[i+1]<upper))
+            break;
+    }
+
+    const std::size_t n{pieces.size()};
+    std::vector<ComplexResult> parts(n);
+    std::vector<std::exception_ptr> errors(n);
+    auto work = [&](std::size_t k, const Integrator& in)
+    {
+        try {
+            parts[k] = c_integrate_result(c.piece(pieces[k]),ranges[k].first,
+                    ranges[k].second,in);
+        }
+        catch (...) {
+            errors[k] = std::current_exception();
+        }
+    };
+    bool done{false};
+    if constexpr (std::is_copy_constructible<Integrator>::value) {
+        if (concurrent && n>1) {
+            // the integrators own their workspaces, one copy per thread
+            const std::vector<Integrator> copies(n-1,integrate);
+            std::vector<std::thread> pool;
+            for (std::size_t k=1; k<n; ++k)
+                pool.emplace_back(work,k,std::cref(copies[k-1]));
+            work(0,integrate);
+            for (auto& t: pool)
+                t.join();
+            done = true;
+        }
+    }
+    if (!done)
+        for (std::size_t k=0; k<n; ++k)
+            work(k,integrate);
+    for (const auto& e: errors)
+        if (e)
+            std::rethrow_exception(e);
+
+    ComplexResult result;
+    for (const auto& part: parts) {
+        for (auto p: {std::make_pair(&result.real,&part.real),
+                std::make_pair(&result.imag,&part.imag)}) {
+            p.first->value += p.second->value;
+            p.first->error += p.second->error;
+            p.first->evaluations += p.second->evaluations;
+            p.first->intervals += p.second->intervals;
+            if (!p.first->status)
+                p.first->status = p.second->status;
+        }
+    }
+    result.value = Complex{result.real.value,result.imag.value};
+    return result;
+}
+
+template<class Integrator>
+std::tuple<Complex,double,double> c_integrate(const Piecewise_curve& c,
+        double lower, double upper, const Integrator& integrate,
+        bool concurrent)
+{
+    const ComplexResult result{c_integrate_result(c,lower,upper,integrate,
+            concurrent)};
+    gsl::check(result.real.status);
+    gsl::check(result.imag.status);
+    return std::make_tuple(result.value,result.real.error,result.imag.error);
+}
+
+template<class C, Complex_callable<C>>
+Complex complex_integration(const C& f, double lower, double upper,
+        bool adaptive, std::size_t integration_nodes)
+{
+    const auto result{complex_integration_result(f, lower, upper, adaptive,
+            integration_nodes)};
+    gsl::check(result.real.status);
+    gsl::check(result.imag.status);
+    return result.value;
+}
+
+template<class C, Complex_callable<C>>
+ComplexResult complex_integration_result(const C& f, double lower,
+        double upper, bool adaptive, std::size_t integration_nodes)
+{
+    if (adaptive==false) {
+        const std::size_t size{integration_nodes};
+        gsl::GaussLegendre g{size};
+        Complex value{0.+0.i};
+        for (std::size_t i=0; i<size; ++i) {
+            auto point{g.point(lower,upper,i)};
+            value=value+point.second*f(point.first);
+        }
+        ComplexResult result;
+        result.value = value;
+        result.real.value = value.real();
+        result.imag.value = value.imag();
+        result.real.evaluations = size;
+        return result;
+    }
+    const auto integrate{gsl::Cquad{}};
+    return c_integrate_result(f, lower, upper, integrate);
+}
+
+template<class F, class C, Complex_callable<C>>
+Interpolate sample(const F& f, const C& c, const Interval& i,
+        gsl::InterpolationMethod m)
+{
+    std::vector<Complex> y_values(i.size());
+    std::transform(i.cbegin(),i.cend(),y_values.begin(),
+            [&f,&c](double x) -> Complex {return f(c(x));});
+
+    return Interpolate{i,y_values,m};
+}
+
+template<class C, Complex_callable<C>>
+Interpolate sample(const C& c, const Interval& i, gsl::InterpolationMethod m)
+{
+    std::vector<Complex> y_values(i.size());
+    std::transform(i.cbegin(),i.cend(),y_values.begin(),
+            [&c](double x) -> Complex {return c(x);});
+
+    return Interpolate{i,y_values,m};
+}
+
+template<class C, Complex_callable<C>>
+Complex derivative(const C& c, double value, double step_size,
+        gsl::DerivativeMethod method)
+{
+    const auto real{gsl::derivative([&c](double x){return c(x).real();},
+                                      value, step_size, method)};
+    const auto imag{gsl::derivative([&c](double x){return c(x).imag();},
+                                      value, step_size, method)};
+    return Complex{std::get<0>(real), std::get<0>(imag)};
+}
 
 } // cauchy
 
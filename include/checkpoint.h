@@ -0,0 +1,79 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief Checkpoints of long computations over grids of points and
+/// completion markers of the tables they produce.
+///
+/// A `Progress` collects the results of the points computed so far and
+/// saves them periodically in a binary file, written atomically with
+/// `snapshot::write_file`. A rerun with the same fingerprint restores them
+/// and continues after the last saved point, such that a preempted job
+/// loses at most one interval of work.
+///
+/// Text tables are written with `commit`: to a temporary file, followed by
+/// a marker line with the number of rows and the fingerprint of the job,
+/// then renamed. A table at its final path is therefore complete, and
+/// `completion` tells a complete table apart from one written by other
+/// means, e.g. an older program killed midway.
+namespace checkpoint {
+
+class Progress {
+public:
+    Progress(std::string path, std::uint64_t fingerprint, std::size_t width,
+            double interval=60.);
+        ///< Restore the points saved at `path` if it is a valid checkpoint
+        ///< of the same fingerprint and width, otherwise start with none.
+        ///< @param width number of values per point
+        ///< @param interval seconds between checkpoints
+
+    std::size_t done() const noexcept {return values_.size()/width;}
+        ///< Number of completed points, the next point to compute.
+    std::size_t restored() const noexcept {return restored_;}
+        ///< Number of points taken from the checkpoint.
+    const std::vector<double>& values() const noexcept {return values_;}
+        ///< Values of the completed points, `width` per point.
+
+    void add(const double* point);
+        ///< Append the `width` values of the next point and save if the
+        ///< interval has elapsed since the last checkpoint.
+    void save();
+        ///< Save now.
+    void finish();
+        ///< Remove the checkpoint once the result is stored elsewhere.
+private:
+    std::string path;
+    std::uint64_t fingerprint;
+    std::size_t width;
+    std::chrono::duration<double> interval;
+    std::chrono::steady_clock::time_point last;
+    std::vector<double> values_;
+    std::size_t restored_{0};
+};
+
+/// Marker line of a table written by `commit`.
+struct Completion {
+    bool complete{false};       ///< the marker is present
+    std::size_t rows{0};
+    std::uint64_t fingerprint{0};
+};
+
+void commit(const std::string& path, const std::string& content,
+        std::size_t rows, std::uint64_t fingerprint);
+    ///< Write `content`, which holds `rows` rows ending in newlines, and the
+    ///< marker line `# complete rows=<rows> fingerprint=<hex>` to a
+    ///< temporary file and rename it to `path`. The marker starts with `#`,
+    ///< hence `input::read_table` stops before it. Throws
+    ///< std::runtime_error if the file cannot be written.
+Completion completion(const std::string& path);
+    ///< Read the marker of the table at `path`. Throws std::runtime_error if
+    ///< the file cannot be opened.
+
+} // checkpoint
+
+#endif // CHECKPOINT_H
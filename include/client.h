@@ -0,0 +1,52 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "server_protocol.h"
+#include "type_aliases.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using type_aliases::Complex;
+
+namespace server {
+
+/// @brief Connection to a `server::Server`.
+
+/// Requests are answered in order, one at a time per connection; use one
+/// `Client` per thread for concurrent requests. Failures to connect or send
+/// throw std::system_error, errors reported by the server and broken
+/// responses std::runtime_error.
+class Client {
+public:
+    explicit Client(const std::string& path);
+        ///< Connect to the socket at `path`.
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+    Client(Client&& other) noexcept;
+    Client& operator=(Client&& other) noexcept;
+    ~Client();
+
+    void ping();
+        ///< Round trip without evaluation.
+    void dispersive(int num_sub, int err, const double* s, std::size_t n,
+            double* real, double* imag);
+        ///< DispersiveIntegral(num_sub,err) at the n points `s`.
+    std::vector<Complex> dispersive(int num_sub, int err,
+            const std::vector<double>& s);
+    void discontinuity(bool charged, const double* s, std::size_t n,
+            double* values, double* errors);
+        ///< Discontinuity(charged) and its uncertainty at the n points `s`.
+    std::pair<std::vector<double>,std::vector<double>> discontinuity(
+            bool charged, const std::vector<double>& s);
+private:
+    int fd{-1};
+
+    void request(Request header, const double* s, std::size_t n,
+            double* first, double* second);
+};
+
+} // server
+
+#endif // CLIENT_H
@@ -1,13 +1,20 @@
 #ifndef _combination_
 #define _combination_
 
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <array>
+#include <utility>
+#include "basis.h"
 #include "constants.h"
+#include "dual.h"
+#include "kinematics.h"
 #include "type_aliases.h"
 #include "gsl_interface.h"
 #include "cauchy.h"
+#include "multi_integration.h"
 
 using type_aliases::Complex;
 
@@ -18,17 +25,20 @@ namespace comb{
 class Combination
 {
 public:
-	Combination(double a0, double a12, double b0, double b12, double smax, double step_size);
+	Combination(double a0, double a12, double b0, double b12, double smax, double step_size, bool load_basis=true);
 	///<@param a0 Subtraction constant for F^(0) amplitude
 	///<@param a12 Subtraction constant for F^(1/2) amplitude
 	///<@param b0 Subtraction constant for F^(0) amplitude
 	///<@param b12 Subtraction constant for F^(1/2) amplitude
 	///<@param smax Maximum value of Mandelstam s for the output file
 	///<@param step_size Step size of s for the output file
+	///<@param load_basis if false, the basis functions are not read in until Combination::load is called
 
-	double s0 = 1./3*(2*std::pow(constants::mass_kaon(),2)+std::pow(constants::mass_pi(),2));
+	double s0 = kin::s0;
 	double kaellen(double a, double b, double c);
 	///< Källén function
+	double kaellen_product(double s);
+	///< Product of the square roots of the Källén functions entering Combination::t, independent of z
 	double t(double s,double z);
 	///< Mandelstam t depending on
 	///< @param s Mandelstam s
@@ -44,6 +54,30 @@ public:
 	///<@param s Mandelstam s
 	///<@param i integer that maps to the notation in https://inspirehep.net/literature/1835296 as follows
 	///< i=1: -0; i=2: 0-; i=3: 00; i=4: -+
+	Complex f(int i, double s, cauchy::ComplexResult& report);
+	///< same as Combination::f, additionally the error estimates, number of evaluations and status of the angular integration are written to report.
+	///< Does not throw if the integration does not converge, see report.converged()
+	Complex Fpart(int i, double s);
+	///< part of Combination::f(i,s) without angular projection
+	cauchy::Curve Fhat_integrand(int i, double s);
+	///< integrand of the angular projection in Combination::f(i,s) as function of z in [-1,1]. The returned function refers to this instance
+
+	std::array<Complex,4> f_all(double s);
+	///< all four partial wave amplitudes, element i-1 equals Combination::f(i,s).
+	///< The angular projections of all channels are done in one integration, t, u and the basis functions are evaluated once per node.
+	///<@param s Mandelstam s
+	std::array<Complex,4> f_all(double s, multi::Result& report);
+	///< same as Combination::f_all, additionally the error estimates and number of evaluations of the angular integration are written to report.
+	///< The components of report are ordered as Re f(1,s), Im f(1,s), Re f(2,s), ...
+
+	std::array<ad::Dual<Complex>,4> f_all(const ad::Dual<double>& s);
+	///< all four partial wave amplitudes together with their derivatives with respect to the variable of s, in one angular integration.
+	///< t, u and the basis functions are differentiated with the analytic derivatives of the splines, see ad::Dual. The derivative diverges at the threshold
+	std::array<ad::Dual<Complex>,4> f_all(const ad::Dual<double>& s, multi::Result& report);
+	///< same as Combination::f_all, additionally the error estimates and number of evaluations of the angular integration are written to report.
+	///< The components of report are ordered as Re f(1,s), Im f(1,s), Re f'(1,s), Im f'(1,s), Re f(2,s), ...
+	ad::Dual<Complex> f(int i, const ad::Dual<double>& s);
+	///< partial wave amplitude i together with its derivative, see Combination::f_all
 
 	/// combines the basis functions to F^(0)
 	Complex F0(double s);
@@ -53,18 +87,84 @@ public:
 	Complex Gp(double s);
 	/// combines the basis functions to G^(0)
 	Complex G0(double s);
+	/// Combination::F0 with its derivative
+	ad::Dual<Complex> F0(const ad::Dual<double>& s);
+	/// Combination::F12 with its derivative
+	ad::Dual<Complex> F12(const ad::Dual<double>& s);
+	/// Combination::Gp with its derivative
+	ad::Dual<Complex> Gp(const ad::Dual<double>& s);
+	/// Combination::G0 with its derivative
+	ad::Dual<Complex> G0(const ad::Dual<double>& s);
 
 	double a0, a12, b0, b12;
 	double smax, step_size;
 
-	std::vector<std::vector<double>> array_s, array_real, array_imag;
+	/// Name of the basis set in comb::Registry used by this instance, "standard" by default. Change it via Combination::use_basis
+	std::string basis_set = "standard";
+	/// Tables of the basis functions in the order of comb::BasisSet::Function, shared with all instances using the same files and range.
+	/// Empty until the function is needed
+	std::array<std::shared_ptr<const Table>,8> tables;
+	/// Switches to the basis set registered as name. The tables are taken from comb::Registry, which reads every file once per process,
+	/// and only the functions that differ from the current set are read and interpolated again. Throws std::out_of_range if name is not registered
+	void use_basis(const std::string& name);
+
+	/// Range of Mandelstam s the basis functions are loaded for, [kin::sth,smax] by default. F^(0) and F^(1/2) are read and interpolated for s and the
+	/// reachable u, G^(0) and G^(+) for the reachable t, see kin::reach. Evaluating a function beyond its table extends it, see Combination::require.
+	/// Change it via Combination::set_range
+	double s_lower = kin::sth;
+	double s_upper;
+	/// Sets the range of s, the loaded functions are read and interpolated again. An infinite upper bound loads the whole tables.
+	/// Throws std::domain_error unless kin::sth<=lower<=upper
+	void set_range(double lower, double upper);
+	/// Range of the argument needed of basis function k for Combination::s_lower and Combination::s_upper
+	std::pair<double,double> range(std::size_t k) const;
 
-	/// Called in Contructor. Reads the files for the basis functions; check the directory!
+	/// True if all basis functions are read in and interpolated
+	bool loaded = false;
+	/// Reads in and interpolates all basis functions unless Combination::loaded. Called in Constructor if load_basis is true.
+	/// Otherwise every function is loaded on its first use, e.g. G^(+) only for the partial waves i=1,3
+	void load();
+	/// Called in Combination::load. Gets the tables of Combination::basis_set for their ranges from comb::Registry
 	void readin();
-	/// Called in Contructor. Interpolates the basis functions with gsl 
+	/// Called in Combination::load. Interpolates the basis functions with gsl 
 	void spline();
-	/// Called in Contructor. Outputs the partial wave corresponding to i (see definition of Combination::f ) into file 
-	void output(int i);
+	/// Loads basis function k if needed to evaluate it at x, i.e. reads and interpolates it on its range or extends the range to x,
+	/// at least by half its width such that a slowly moving x does not read the file each time. Called by Combination::F0 etc.
+	void require(std::size_t k, double x)
+	{
+		const Table* table = tables[k].get();
+		if(!table || x < table->lower || x > table->upper){
+			extend(k, x);
+		}
+	}
+	/// Called by Combination::require
+	void extend(std::size_t k, double x);
+	/// Interpolates basis function k, see comb::BasisSet::Function. The interpolators refer to the data of Combination::tables instead of copying it
+	void spline(std::size_t k);
+	/// Storage of the interpolated basis functions, see gsl::Precision. Change it via Combination::use_precision
+	gsl::Precision precision = gsl::Precision::double_precision;
+	/// Switches the storage of the interpolated basis functions, which are interpolated again if they are loaded.
+	/// In single precision an instance keeps about a quarter of the memory of the interpolators, see gsl::Interpolate::error_bound for the error
+	void use_precision(gsl::Precision precision);
+	/// Largest gsl::Interpolate::error_bound of the interpolated basis functions, zero in double precision
+	double error_bound() const;
+	/// Values of s of the files written by Combination::output, from kin::sth below smax in steps of step_size
+	std::vector<double> grid() const;
+	/// Angular projection a file of a partial wave is computed with. The two agree within the integration tolerance only
+	enum class Projection
+	{
+		separate, ///< Combination::f, one Cquad integration per partial wave, used by Combination::output
+		shared ///< Combination::f_all, one integration for all four partial waves, used by Combination::output_all
+	};
+	/// Checksum of the subtraction constants, basis set, grid, precision, projection and i, written into the completion marker of the file of partial wave i.
+	/// i=0 identifies all four partial waves, as computed by Combination::output_all
+	std::uint64_t fingerprint(int i, Projection projection = Projection::separate) const;
+	/// Outputs the partial wave corresponding to i (see definition of Combination::f ) into file. Called in input::gammaKKpi::readin if the file does not exist.
+	/// The completed points are saved every interval seconds in a checkpoint next to the file, a rerun after an interruption continues from there.
+	/// The file is written at the end with a completion marker, see checkpoint::commit. Throws std::runtime_error if it cannot be written
+	void output(int i, double interval=60.);
+	/// Outputs all four partial waves into their files using Combination::f_all, with checkpoints like Combination::output
+	void output_all(double interval=60.);
 
 	gsl::Interpolate F0_a_real;
 	gsl::Interpolate F0_b_real;
@@ -1,8 +1,11 @@
 #ifndef _discontinuity_
 #define _discontinuity_
 
+#include <memory>
 #include "constants.h"
+#include "dual.h"
 #include "input.h"
+#include "memo.h"
 
 /// Namespace to calculate the discontinuity for kaon polarizabilities
 namespace disc{
@@ -14,6 +17,8 @@ public:
 	Discontinuity(bool charged_kaon_int);
 	///<@param charged_kaon_int if true uses gamma K to K pi amplitude with charged kaon in the final state -> charged kaon in intermediate state for gamma K to gamma K
 	///< if fales uses neutral kaon
+	Discontinuity(bool charged_kaon_int, input::gammaKKpi absgammaKKpic, input::gammaKKpi absgammaKKpin);
+	///< Uses already constructed amplitudes, e.g. restored from a snapshot
 
 	bool charged_kaon_int;
 
@@ -32,10 +37,38 @@ public:
 	///<@param m1 input for mass 1, not mass squared!
 	///<@param m2 input for mass 2, not mass squared!
 
-	/// Operator that evaluates the discontinuity
+	/// Evaluates the discontinuity
+	double evaluate(double s);
+	/// Evaluates the uncertainity of the discontinuity
+	double evaluate_err(double s);
+	/// Discontinuity::evaluate with its derivative, bypasses the cache
+	ad::Dual<double> evaluate(const ad::Dual<double>& s) const;
+	/// Discontinuity::evaluate_err with its derivative, bypasses the cache
+	ad::Dual<double> evaluate_err(const ad::Dual<double>& s) const;
+
+	/// Operator that evaluates the discontinuity, uses the cache if enabled
 	double operator()(double s);
-	/// Operator that evaluates the uncertainity of the discontinuity
+	/// Operator that evaluates the uncertainity of the discontinuity, uses the cache if enabled
 	double operator[](double s);
+	/// Writes Discontinuity::operator()(s[k]) to values[k] for k<n, phase_space[k] needs to equal kin::phase_space(s[k]). Uses the cache if enabled
+	void evaluate_batch(std::size_t n, const double* s, const double* phase_space, double* values);
+	/// Writes Discontinuity::operator[](s[k]) to values[k] for k<n like Discontinuity::evaluate_batch
+	void evaluate_err_batch(std::size_t n, const double* s, const double* phase_space, double* values);
+
+	/// Caches for Discontinuity::operator() and Discontinuity::operator[], disabled if empty. Copies share the caches.
+	std::shared_ptr<memo::Cache<double>> value_cache;
+	std::shared_ptr<memo::Cache<double>> error_cache;
+	/// Enables caches storing up to capacity values each. Existing entries are discarded
+	void enable_cache(std::size_t capacity);
+	/// Disables the caches
+	void disable_cache();
+	/// Replaces enabled caches, also those of both amplitudes, by empty ones of the same capacity, see input::gammaKKpi::renew_cache
+	void renew_cache();
+	/// Combined hit-rate statistics of both caches
+	memo::Statistics cache_statistics() const;
+
+	/// Compacts both amplitudes, see input::gammaKKpi::compact. If the precision changes, the caches are renewed
+	void compact(gsl::Precision precision = gsl::Precision::double_precision);
 };
 
 }
@@ -4,9 +4,16 @@
 #include <iostream>
 #include <cmath>
 #include <complex>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+#include "dual.h"
+#include "facilities.h"
 #include "gsl_interface.h"
 #include "cauchy.h"
 #include "discontinuity.h"
+#include "multi_integration.h"
 
 /// Namespace to calculate dispersive integral for gamma K to gamma K 
 namespace disp{
@@ -14,13 +21,85 @@ namespace disp{
 using type_aliases::Complex;
 using namespace std::complex_literals;
 
+/// Number of subtractions and error mode of one dispersion integral, see DispersiveIntegral::evaluate
+struct Variant
+{
+	int num_sub;
+	int err;
+};
+
+/// Error modes of the discontinuity, see DispersiveIntegral::err
+enum class ErrMode
+{
+	central = 0, ///< normal function is evaluated
+	lower = 1, ///< uncertainty below
+	upper = 2 ///< uncertainty above
+};
+
+double analytic_factor(double s, double lower_limit, double subtraction_point, double cutoff, int num_sub);
+///< Principal value of (s-subtraction_point)^num_sub times the integral of 1/((s'-subtraction_point)^num_sub (s'-s)) from lower_limit to cutoff,
+///< i.e. the analytic part of the Cauchy integral divided by the numerator at s. Implemented for any num_sub>=1 and finite or infinite cutoff.
+///<@param s Mandelstam s, needs to lie between lower_limit and cutoff
+ad::Dual<double> analytic_factor(const ad::Dual<double>& s, double lower_limit, double subtraction_point, double cutoff, int num_sub);
+///< disp::analytic_factor with its derivative
+
+template<class F>
+gsl::Result principal_value_integral(const F& f, double s, double lower_limit, double cutoff);
+///< Principal value of the integral of f(s')/(s'-s) from lower_limit to cutoff, used instead of subtracting the numerator at s if DispersiveIntegral::principal_value is set.
+///< On [lower_limit, 2s-lower_limit], which is symmetric about the pole, the weight 1/(s'-s) is treated exactly by gsl::Qawc, the rest is integrated by gsl::Cquad.
+///< Value, error estimate and number of evaluations of both integrations are added up in the returned report.
+///<@param s Mandelstam s, needs to lie strictly between lower_limit and cutoff
+
+/// Dispersion integral with the number of subtractions and the error mode fixed at compile time,
+/// such that the integrands contain no branches. DispersiveIntegral dispatches to this class.
+template<int NumSub, ErrMode Mode>
+class Kernel
+{
+public:
+	Kernel(disc::Discontinuity& charged, disc::Discontinuity& neutral, double subtraction_point, double cutoff, double multiply, bool principal_value=false);
+	///<@param charged discontinuity for charged kaon in intermediate state
+	///<@param neutral discontinuity for neutral kaon in intermediate state
+	///<@param principal_value see DispersiveIntegral::principal_value
+	///< For the other parameters see DispersiveIntegral. The discontinuities are not copied and need to outlive the Kernel.
+
+	static_assert(NumSub >= 1, "number of subtractions must be greater or equal to 1");
+
+	/// Constructs numerator for the disperion integral
+	double numerator(double s) const;
+	/// Integrand for the Cauchy integral, numerator_s needs to equal numerator(s)
+	double integrand_cauchy(double s, double s_prime, double numerator_s) const;
+	/// Integrand for the trivial integral
+	double integrand_trivial(double s, double s_prime) const;
+	/// returns the disperion integral. Uses the right combination of integrals according to where s lies
+	Complex operator()(double s) const;
+	/// same as Kernel::operator(), the result of the numerical integration is written to report. Does not throw if the integration does not converge
+	Complex operator()(double s, gsl::Result& report) const;
+
+private:
+	disc::Discontinuity* charged;
+	disc::Discontinuity* neutral;
+	double sth;
+	double subtraction_point;
+	double cutoff;
+	double multiply;
+	bool principal_value;
+
+	template<class Integrand>
+	gsl::Result integrate(const Integrand& integrand) const;
+};
+
+class Surrogate;
+
 /// Class to calculate dispersive integral for gamma K to gamma K
 class DispersiveIntegral
 {
 public:
 	DispersiveIntegral(int num_sub, int err);
-	///<@param num_sub number of subtractions used for the dispersion integral. Must be greater or equal to 1. Only 1 and 2 are implemented.
+	///<@param num_sub number of subtractions used for the dispersion integral. Must be greater or equal to 1.
 	///<@param err integer that determines which function for the disconinuity are used. 0: normal function is evaluated, 1: uncertainty below, 2: uncertainty above
+	///< Both discontinuities use the same two amplitudes, which are read in once and whose interpolators are shared
+	DispersiveIntegral(int num_sub, int err, disc::Discontinuity gammaKKpicdisc, disc::Discontinuity gammaKKpindisc);
+	///< Uses already constructed discontinuities, e.g. restored from a snapshot, see snapshot::restore
 
 	/// Discontinuity for charged kaon in intermediate state
 	disc::Discontinuity gammaKKpicdisc;
@@ -43,21 +122,198 @@ public:
 
 	/// Constructs numerator for the disperion integral
 	double numerator(double s);
+	/// Constructs numerators for err=0,1,2 from one evaluation of the discontinuities. The uncertainties are only evaluated if with_err is true
+	std::array<double,3> numerators(double s, bool with_err=true);
+	/// Writes numerators(s[k], with_err)[e] to values[3*k+e] for k<n, e.g. for all nodes of a quadrature rule. The phase space is evaluated once for all points
+	void numerators(std::size_t n, const double* s, bool with_err, double* values);
 	/// Integrand for the Cauchy integral
 	double integrand_cauchy(double s, double s_prime);
 	/// Calculates integral for the Cauchy integral
 	double numeric_integral_cauchy(double s, double lower_limit);
+	/// Calculates integral for the Cauchy integral, the full result of the integration is written to report. Does not throw if the integration does not converge
+	double numeric_integral_cauchy(double s, double lower_limit, gsl::Result& report);
+	/// Calculates integral for the Cauchy integral using integration instead of the default Cquad, the full result of the integration is written to report
+	double numeric_integral_cauchy(double s, double lower_limit, const gsl::Integration& integration, gsl::Result& report);
+	/// If true, the Cauchy integral for sth<s<cutoff is computed as a principal value, see disp::principal_value_integral, instead of subtracting numerator(s). At s=cutoff the numerator is subtracted
+	/// The weight 1/(s'-s) is then integrated exactly, which needs fewer evaluations of the discontinuities. Copies keep the setting
+	bool principal_value = false;
+	/// Principal value of the integral of numerator(s')/((s'-subtraction_point)^num_sub (s'-s)) from lower_limit to cutoff, the full result of the integration is written to report.
+	/// Equals numeric_integral_cauchy plus integral_analytic/(s-subtraction_point)^num_sub. Does not throw if the integration does not converge
+	double numeric_integral_principal_value(double s, double lower_limit, gsl::Result& report);
 	/// Integrand for the trivial integral
 	double integrand_trivial(double s, double s_prime);
 	/// Integrates trivially (only valid for s<sth)
 	double numeric_integral_trivial(double s, double lower_limit);
-	/// Analytic part of the integral when s>sth and using the Cauchy integration. Only implemented for num_sub={1,2}
+	/// Integrates trivially (only valid for s<sth), the full result of the integration is written to report. Does not throw if the integration does not converge
+	double numeric_integral_trivial(double s, double lower_limit, gsl::Result& report);
+	/// Integrates trivially (only valid for s<sth) using integration instead of the default Cquad, the full result of the integration is written to report
+	double numeric_integral_trivial(double s, double lower_limit, const gsl::Integration& integration, gsl::Result& report);
+	/// Analytic part of the integral when s>sth and using the Cauchy integration.
 	double integral_analytic(double s, double lower_limit);
-	/// returns the disperion integral. Uses the right combination of integrals according to where s lies
+	/// Analytic part of the integral divided by numerator(s) for given num_sub, see disp::analytic_factor
+	double analytic_factor(double s, double lower_limit, int num_sub);
+	/// returns the disperion integral. Uses DispersiveIntegral::surrogate if enabled and applicable, otherwise dispatches to Kernel for num_sub<=4 or DispersiveIntegral::evaluate_runtime
 	Complex operator()(double s);
+	/// same as DispersiveIntegral::operator(), the result of the numerical integration (value, error estimate, number of evaluations, status) is written to report.
+	/// Does not throw if the integration does not converge, see gsl::Result::converged
+	Complex operator()(double s, gsl::Result& report);
+	/// returns the disperion integral with num_sub and err evaluated at runtime. Uses the right combination of integrals according to where s lies
+	Complex evaluate_runtime(double s);
+	/// same as DispersiveIntegral::evaluate_runtime, the result of the numerical integration is written to report
+	Complex evaluate_runtime(double s, gsl::Result& report);
+	/// Kernel sharing the discontinuities of this instance, num_sub and err are replaced by the template parameters
+	template<int NumSub, ErrMode Mode>
+	Kernel<NumSub,Mode> kernel();
+	/// Constructs numerator for the disperion integral together with its derivative, bypasses the caches
+	ad::Dual<double> numerator(const ad::Dual<double>& s);
+	/// returns the disperion integral and its derivative with respect to the variable of s, from one integration with two components.
+	/// The derivative of the Cauchy integrand is subtracted once more with the derivative of the numerator at s, such that it stays integrable.
+	/// Does not use the surrogate and subtracts also if DispersiveIntegral::principal_value is set. The derivative diverges at the threshold
+	ad::Dual<Complex> operator()(const ad::Dual<double>& s);
+	/// same as DispersiveIntegral::operator()(const ad::Dual<double>&), the error estimates and number of evaluations of the integration are written to report
+	ad::Dual<Complex> operator()(const ad::Dual<double>& s, multi::Result& report);
+	/// returns the disperion integrals for all variants at once. The numerical integrals of all variants are evaluated on shared nodes,
+	/// such that the discontinuities are evaluated only once per node. The members num_sub and err are not used.
+	/// If DispersiveIntegral::principal_value is set and sth<s<cutoff, every variant is integrated separately as a principal value instead
+	std::vector<Complex> evaluate(double s, const std::vector<Variant>& variants);
+	/// same as DispersiveIntegral::evaluate, the error estimates and number of evaluations of the numerical integrals are written to report
+	std::vector<Complex> evaluate(double s, const std::vector<Variant>& variants, multi::Result& report);
+
+	/// Enables the caches of both discontinuities, see disc::Discontinuity::enable_cache
+	void enable_cache(std::size_t capacity);
+	/// Disables the caches of both discontinuities
+	void disable_cache();
+	/// Combined hit-rate statistics of the caches of both discontinuities
+	memo::Statistics cache_statistics() const;
+
+	/// Releases the lists of the amplitudes of both discontinuities and optionally stores their interpolators in single precision,
+	/// see input::gammaKKpi::compact. Amplitudes shared by the discontinuities stay shared, the caches are renewed if the precision changes
+	void compact(gsl::Precision precision = gsl::Precision::double_precision);
+
+	/// Surrogate answering DispersiveIntegral::operator()(s) for s in its range if its num_sub and err match, disabled if empty. Copies share it.
+	std::shared_ptr<const Surrogate> surrogate;
+	/// Builds a surrogate on [lower,upper] with the default options and enables it, see disp::Surrogate::build
+	void enable_surrogate(double lower, double upper);
+	/// Disables the surrogate
+	void disable_surrogate();
 
 };
 
+template<class F>
+gsl::Result principal_value_integral(const F& f, double s, double lower_limit, double cutoff)
+{
+	if (!(lower_limit < s && s < cutoff))
+	{
+		throw std::domain_error("principal value needs lower_limit < s < cutoff.");
+	}
+	gsl::Settings settings;
+	settings.space = 10000;
+	const double upper = std::min(2*s - lower_limit, cutoff);
+
+	gsl::Result report = gsl::Qawc(settings).integrate(f, lower_limit, upper, s);
+	if (upper < cutoff){
+		const gsl::Result tail = gsl::Cquad(settings).integrate([&f, s](double s_prime){
+			return f(s_prime)/(s_prime-s); }, upper, cutoff);
+		report.value += tail.value;
+		report.error += tail.error;
+		report.evaluations += tail.evaluations;
+		report.intervals += tail.intervals;
+		if (report.status == 0){
+			report.status = tail.status;
+		}
+	}
+	return report;
+}
+
+template<int NumSub, ErrMode Mode>
+Kernel<NumSub,Mode>::Kernel(disc::Discontinuity& charged, disc::Discontinuity& neutral, double subtraction_point, double cutoff, double multiply, bool principal_value)
+:
+charged{&charged},
+neutral{&neutral},
+sth{charged.sth},
+subtraction_point{subtraction_point},
+cutoff{cutoff},
+multiply{multiply},
+principal_value{principal_value}
+{}
+
+template<int NumSub, ErrMode Mode>
+double Kernel<NumSub,Mode>::numerator(double s) const
+{
+	const double value = (*charged)(s) + (*neutral)(s);
+	if (Mode == ErrMode::central){
+		return value*multiply;
+	}
+	const double error = (*charged)[s] + (*neutral)[s];
+	if (Mode == ErrMode::lower){
+		return (value - error)*multiply;
+	}
+	return (value + error)*multiply;
+}
+
+template<int NumSub, ErrMode Mode>
+double Kernel<NumSub,Mode>::integrand_cauchy(double s, double s_prime, double numerator_s) const
+{
+	return (numerator(s_prime)-numerator_s)/(facilities::power<NumSub>(s_prime-subtraction_point)*(s_prime-s));
+}
+
+template<int NumSub, ErrMode Mode>
+double Kernel<NumSub,Mode>::integrand_trivial(double s, double s_prime) const
+{
+	return numerator(s_prime)/(facilities::power<NumSub>(s_prime-subtraction_point)*(s_prime-s));
+}
+
+template<int NumSub, ErrMode Mode>
+template<class Integrand>
+gsl::Result Kernel<NumSub,Mode>::integrate(const Integrand& integrand) const
+{
+	auto integration = gsl::Cquad();
+	integration.reserve(10000);
+	integration.set_absolute(0.0);
+	integration.set_relative(1e-7);
+
+	return integration.integrate(integrand, sth, cutoff);
+}
+
+template<int NumSub, ErrMode Mode>
+Complex Kernel<NumSub,Mode>::operator()(double s) const
+{
+	gsl::Result report;
+	const Complex result = (*this)(s, report);
+	gsl::check(report.status);
+	return result;
+}
+
+template<int NumSub, ErrMode Mode>
+Complex Kernel<NumSub,Mode>::operator()(double s, gsl::Result& report) const
+{
+	if (s > cutoff)
+	{
+		throw std::domain_error("s larger than cutoff of integral.");
+	}
+	const double prefactor = facilities::power<NumSub>(s-subtraction_point)/(2*constants::pi());
+	if (s < sth){
+		report = integrate([this, s](double s_prime){
+			return integrand_trivial(s, s_prime); });
+		return 1./multiply*(prefactor*report.value);
+	}
+	const double numerator_s = numerator(s);
+	if (principal_value && s > sth && s < cutoff){
+		report = principal_value_integral([this](double s_prime){
+			return numerator(s_prime)/facilities::power<NumSub>(s_prime-subtraction_point); }, s, sth, cutoff);
+		return 1./multiply*(prefactor*report.value + 1.i/2. * numerator_s);
+	}
+	report = integrate([this, s, numerator_s](double s_prime){
+		return integrand_cauchy(s, s_prime, numerator_s); });
+	return 1./multiply*(prefactor*report.value + 1./(2*constants::pi()) * numerator_s * analytic_factor(s, sth, subtraction_point, cutoff, NumSub) + 1.i/2. * numerator_s);
+}
+
+template<int NumSub, ErrMode Mode>
+Kernel<NumSub,Mode> DispersiveIntegral::kernel()
+{
+	return Kernel<NumSub,Mode>(gammaKKpicdisc, gammaKKpindisc, subtraction_point, cutoff, multiply, principal_value);
+}
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,161 @@
+#ifndef DUAL_H
+#define DUAL_H
+
+#include <cmath>
+#include <complex>
+#include <type_traits>
+
+/// @brief Forward-mode automatic differentiation with dual numbers.
+///
+/// A `Dual<T>` carries a value and its derivative with respect to one
+/// variable, usually Mandelstam s. The arithmetic propagates both by the
+/// chain rule, such that value and derivative of an expression come out of
+/// one evaluation and without the step size of a finite difference.
+/// `Dual<std::complex<double>>` is used for amplitudes, their derivative
+/// is the derivative of real and imaginary part.
+namespace ad {
+
+template<class T>
+struct Dual {
+    T value{};
+    T derivative{};
+
+    constexpr Dual() = default;
+    constexpr Dual(const T& value, const T& derivative=T{})
+        : value{value}, derivative{derivative} {}
+        ///< Implicit, a plain number is a constant.
+    template<class U, std::enable_if_t<!std::is_same<U,T>::value
+        && std::is_convertible<U,T>::value,int> =0>
+    constexpr Dual(const Dual<U>& other)
+        : value(other.value), derivative(other.derivative) {}
+        ///< E.g. real to complex.
+
+    Dual& operator+=(const Dual& o) {return *this = *this+o;}
+    Dual& operator-=(const Dual& o) {return *this = *this-o;}
+    Dual& operator*=(const Dual& o) {return *this = *this*o;}
+    Dual& operator/=(const Dual& o) {return *this = *this/o;}
+
+    friend constexpr Dual operator-(const Dual& a)
+    {
+        return {-a.value,-a.derivative};
+    }
+    friend constexpr Dual operator+(const Dual& a, const Dual& b)
+    {
+        return {a.value+b.value,a.derivative+b.derivative};
+    }
+    friend constexpr Dual operator-(const Dual& a, const Dual& b)
+    {
+        return {a.value-b.value,a.derivative-b.derivative};
+    }
+    friend constexpr Dual operator*(const Dual& a, const Dual& b)
+    {
+        return {a.value*b.value,a.derivative*b.value+a.value*b.derivative};
+    }
+    friend constexpr Dual operator/(const Dual& a, const Dual& b)
+    {
+        return {a.value/b.value,
+            (a.derivative*b.value-a.value*b.derivative)/(b.value*b.value)};
+    }
+
+    // constants, preferred over the conversion to Dual
+    friend constexpr Dual operator+(const Dual& a, const T& b)
+    {
+        return {a.value+b,a.derivative};
+    }
+    friend constexpr Dual operator+(const T& a, const Dual& b)
+    {
+        return {a+b.value,b.derivative};
+    }
+    friend constexpr Dual operator-(const Dual& a, const T& b)
+    {
+        return {a.value-b,a.derivative};
+    }
+    friend constexpr Dual operator-(const T& a, const Dual& b)
+    {
+        return {a-b.value,-b.derivative};
+    }
+    friend constexpr Dual operator*(const Dual& a, const T& b)
+    {
+        return {a.value*b,a.derivative*b};
+    }
+    friend constexpr Dual operator*(const T& a, const Dual& b)
+    {
+        return {a*b.value,a*b.derivative};
+    }
+    friend constexpr Dual operator/(const Dual& a, const T& b)
+    {
+        return {a.value/b,a.derivative/b};
+    }
+    friend constexpr Dual operator/(const T& a, const Dual& b)
+    {
+        return {a/b.value,-a*b.derivative/(b.value*b.value)};
+    }
+};
+
+template<class T>
+constexpr Dual<T> variable(const T& x)
+    ///< The independent variable x, i.e. derivative 1.
+{
+    return {x,T{1}};
+}
+
+inline Dual<std::complex<double>> complex(const Dual<double>& re,
+        const Dual<double>& im)
+    ///< re+i*im
+{
+    return {{re.value,im.value},{re.derivative,im.derivative}};
+}
+
+inline Dual<double> real(const Dual<std::complex<double>>& z)
+{
+    return {z.value.real(),z.derivative.real()};
+}
+
+inline Dual<double> imag(const Dual<std::complex<double>>& z)
+{
+    return {z.value.imag(),z.derivative.imag()};
+}
+
+inline Dual<double> abs(const Dual<double>& x)
+    ///< The derivative at 0 is taken to be 0.
+{
+    return x.value<0 ? -x : x.value>0 ? x : Dual<double>{0.};
+}
+
+template<class T>
+Dual<T> sqrt(const Dual<T>& x)
+{
+    using std::sqrt;
+    const T root{sqrt(x.value)};
+    return {root,x.derivative/(T{2}*root)};
+}
+
+template<class T>
+Dual<T> log(const Dual<T>& x)
+{
+    using std::log;
+    return {log(x.value),x.derivative/x.value};
+}
+
+template<class T>
+Dual<T> exp(const Dual<T>& x)
+{
+    using std::exp;
+    const T e{exp(x.value)};
+    return {e,e*x.derivative};
+}
+
+template<class T>
+Dual<T> pow(const Dual<T>& x, int n)
+    ///< x^n for integer n.
+{
+    using std::pow;
+    if (n==0)
+        return Dual<T>{T{1}};
+    const T p{pow(x.value,n-1)};
+    return {p*x.value,T(n)*p*x.derivative};
+}
+
+} // ad
+
+#endif // DUAL_H
@@ -45,6 +45,17 @@ constexpr T square(const T& x)
     return x*x;
 }
 
+template<int N, class T>
+constexpr T power(const T& x)
+    /// Return `x` to the power of `N>=0` by repeated multiplication.
+{
+    static_assert(N>=0, "power is implemented for non-negative exponents");
+    T result{1};
+    for (int i=0; i<N; ++i)
+        result *= x;
+    return result;
+}
+
 template<class T>
 constexpr T identity(const T& x)
 {
@@ -75,7 +86,10 @@ constexpr auto compose(F&& f, G&& g)
     /// The return type of `G` needs to be implicitly convertible to the
     /// argument type of `F`.
 {
-    return std::bind(f,std::bind(g,std::placeholders::_1));
+    return [f=std::forward<F>(f),g=std::forward<G>(g)](auto&& x)
+    {
+        return f(g(std::forward<decltype(x)>(x)));
+    };
 }
 
 template<class Number>
@@ -0,0 +1,124 @@
+#ifndef FIT_H
+#define FIT_H
+
+#include "pipeline.h"
+#include "type_aliases.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief Least-squares fit of the subtraction constants a0, a12, b0, b12 of
+/// `comb::Combination` to partial-wave data.
+///
+/// The partial waves are affine in the constants, f(p) = f(0)+sum_k p_k d_k
+/// with d_k the response to a unit change of constant k. The responses at
+/// the data points are evaluated once, concurrently on copies of one
+/// `comb::Combination` sharing the tables of `comb::Registry`. Every
+/// iteration of the trust-region solver of gsl_multifit_nlinear then only
+/// combines them, also for the modulus, which is not linear in the
+/// constants. Thus residuals and Jacobian are exact up to the accuracy of
+/// the angular integration and cost no further integrations.
+namespace fit {
+
+using type_aliases::Complex;
+
+/// Observable of a data point.
+enum class Part {real, imag, modulus};
+
+/// Measurement of Part of f(i,s), see `comb::Combination::f`.
+struct Point {
+    int i;
+    double s;
+    Part part;
+    double value;
+    double error;           ///< Standard deviation, needs to be positive.
+};
+
+struct Options {
+    std::string basis{"standard"};
+        ///< Basis set in `comb::Registry`.
+    std::size_t max_iterations{100};
+        ///< Including the iterations of a resumed fit.
+    double xtol{1e-8};
+    double gtol{1e-8};
+    double ftol{0.};
+        ///< Convergence criteria of gsl_multifit_nlinear_test.
+    std::size_t threads{0};
+        ///< Threads evaluating the responses, 0 for one per core.
+    std::string checkpoint;
+        ///< @brief File written after every iteration, empty for none.
+        ///<
+        ///< It holds the responses and the current constants. If it exists
+        ///< and was written for the same data and basis set, the
+        ///< constructor takes the responses from it and `Fit::run` continues
+        ///< from its constants and iteration count.
+};
+
+struct Result {
+    pipeline::Constants constants;
+    std::array<double,4> errors{};
+        ///< Standard deviations of a0, a12, b0, b12.
+    std::array<std::array<double,4>,4> covariance{};
+    double chi2{0.};
+    std::size_t dof{0};
+    std::size_t iterations{0};
+        ///< Including those of a resumed fit.
+    int status{0};
+        ///< GSL status of the last iteration or convergence test.
+    bool resumed{false};
+
+    bool converged() const noexcept {return status==0;}
+};
+
+/// Fit of Options::basis to a fixed set of data. Not thread-safe.
+class Fit {
+public:
+    explicit Fit(std::vector<Point> data, const Options& options=Options{});
+        ///< Evaluate the responses at the data points, or read them from
+        ///< Options::checkpoint. Throws std::invalid_argument for fewer
+        ///< than four points, a non-positive error or i not in 1..4.
+
+    Result run(const pipeline::Constants& start=pipeline::Constants{});
+        ///< @brief Fit starting from `start`, or on the first call from the
+        ///< checkpoint if one was read.
+        ///<
+        ///< For a warm start pass the constants of a previous result, e.g.
+        ///< of a fit to a subset of the data.
+
+    Complex model(std::size_t k, const pipeline::Constants& c) const;
+        ///< f(i,s) at data point k for constants c.
+    std::vector<double> residuals(const pipeline::Constants& c) const;
+        ///< (model-value)/error for all data points.
+
+    const std::vector<Point>& data() const noexcept {return data_;}
+    bool resumed() const noexcept {return checkpoint_loaded;}
+        ///< True if the responses were read from the checkpoint.
+private:
+    std::vector<Point> data_;
+    Options options;
+    std::vector<std::array<Complex,5>> response;
+        ///< f(0) and the responses to a0, a12, b0, b12 per data point.
+    std::uint64_t key{0};
+        ///< Checksum of data and basis set identifying the checkpoint.
+    bool checkpoint_loaded{false};
+    bool resume{false};
+    std::size_t checkpoint_iterations{0};
+    pipeline::Constants checkpoint_constants;
+
+    void evaluate_responses();
+    bool read_checkpoint();
+    void write_checkpoint(const pipeline::Constants& c,
+            std::size_t iterations) const;
+    void evaluate(const double* p, double* r, double* jacobian) const;
+        ///< Residuals and, if `jacobian` is not null, the Jacobian in row
+        ///< major order at parameters p.
+
+    friend struct Callbacks;
+};
+
+} // fit
+
+#endif // FIT_H
@@ -8,6 +8,8 @@
 #include "gsl/gsl_interp2d.h"
 #include "gsl/gsl_spline2d.h"
 
+#include "dual.h"
+#include "instrumentation.h"
 
 #include <algorithm>
 #include <cmath>
@@ -32,6 +34,17 @@ using Function = std::function<double(double)>;
 /// An `Interval` needs to be sorted in ascending order.
 using Interval = std::vector<double>;
 
+/// @brief Restrict templates to callables `F` taking a double and returning a
+/// real number.
+///
+/// Every routine taking a `Function` has an overload for any such callable,
+/// which is passed to the gsl routine directly instead of via a
+/// `std::function`. This allows the compiler to inline the integrand, which
+/// matters for cheap integrands evaluated many times.
+template<class F>
+using Real_callable = std::enable_if_t<std::is_convertible<
+    decltype(std::declval<const F&>()(0.)),double>::value,int>;
+
 // -- Error handling ----------------------------------------------------------
 
 /// Turn off default GSL error handling, sucht that error handling with exceptions can be invoked.
@@ -120,6 +133,8 @@ public:
         ///< the interval [`lower`,`upper`].
     double operator()(const Function& f, double lower, double upper) const;
         ///< Integrate `f` from `lower` to `upper`.
+    template<class F, Real_callable<F> =0>
+    double operator()(const F& f, double lower, double upper) const;
     void resize(std::size_t s);
         ///< Adjust the number of points of the integration scheme.
     std::size_t size() const noexcept;
@@ -133,6 +148,21 @@ private:
 
 // -- Integration: adaptive routines ------------------------------------------
 
+/// Result of an integration together with information on its computation.
+struct Result {
+    double value{0.0};
+    double error{0.0};
+        ///< error estimate of `value`
+    std::size_t evaluations{0};
+        ///< number of evaluations of the integrand
+    std::size_t intervals{0};
+        ///< number of subintervals used, zero if not provided by the routine
+    int status{0};
+        ///< status returned by the gsl routine, see `check`
+
+    bool converged() const noexcept {return status==0;}
+};
+
 struct Integration {
     virtual Value operator()(const Function& f, double lower, double upper) const=0;
         ///<@brief Integrate the function `f` in the interval [`lower`,`upper`].
@@ -140,6 +170,19 @@ struct Integration {
         ///< Both `lower` and `upper` are allowed to be infinity
         ///< (use e.g. `std::numeric_limits<double>::infinity()`).
 
+    virtual Result integrate(const Function& f, double lower, double upper) const
+        ///<@brief Integrate `f` like `operator()`, but return the full `Result`.
+
+        ///< If the requested precision is not reached, no exception is
+        ///< thrown, instead `status` indicates the failure.
+    {
+        const Value v{(*this)(f,lower,upper)};
+        Result r;
+        r.value = v.first;
+        r.error = v.second;
+        return r;
+    }
+
     virtual ~Integration() {}
 };
 
@@ -298,6 +341,12 @@ public:
     ~Cquad() noexcept {}
 
     Value operator()(const Function& f, double lower, double upper) const override;
+    Result integrate(const Function& f, double lower, double upper) const override;
+        ///< `intervals` is not provided by the gsl routine and set to zero.
+    template<class F, Real_callable<F> =0>
+    Value operator()(const F& f, double lower, double upper) const;
+    template<class F, Real_callable<F> =0>
+    Result integrate(const F& f, double lower, double upper) const;
 
     void reserve(std::size_t space);
         ///< Change the size of the workspace used by the gsl integration
@@ -312,6 +361,10 @@ private:
     double absolute_precision;
     double relative_precision;
     Cquad_workspace workspace;
+
+    template<class F>
+    Result integrate_finite(const F& f, double lower, double upper, int sign)
+        const;
 };
 
 /// @brief Integration of one function or multiple functions using GSL QAG
@@ -329,6 +382,56 @@ public:
     ~Qag() noexcept {}
 
     Value operator()(const Function& f, double lower, double upper) const override;
+    Result integrate(const Function& f, double lower, double upper) const override;
+    template<class F, Real_callable<F> =0>
+    Value operator()(const F& f, double lower, double upper) const;
+    template<class F, Real_callable<F> =0>
+    Result integrate(const F& f, double lower, double upper) const;
+
+    void reserve(std::size_t space);
+        // Change the size of the workspace used by the gsl integration
+        // routine.
+    void set_absolute(double abs) noexcept {absolute_precision = abs;}
+    void set_relative(double rel) noexcept {relative_precision = rel;}
+
+    double absolute() const noexcept {return absolute_precision;}
+    double relative() const noexcept {return relative_precision;}
+    std::size_t size() const noexcept {return workspace.size();}
+private:
+    double absolute_precision;
+    double relative_precision;
+    std::size_t limit;
+    Qag_workspace workspace;
+};
+
+/// @brief Cauchy principal value of the integral of f(x)/(x-c) using the GSL
+/// QAWC routine.
+///
+/// The weight 1/(x-c) is treated exactly by modified Clenshaw-Curtis rules
+/// on the subintervals containing `c`, such that `f` needs to be smooth only.
+/// Not derived from `Integration`, since the integrand depends on `c`.
+class Qawc {
+public:
+    Qawc(const Settings& set=Settings{});
+        ///< If `absolute_precision` is set to zero, `relative_precision` is
+        ///< used and vice versa. `space` denotes the size of the workspace
+        ///< used by the gsl integration routine.
+
+    Value operator()(const Function& f, double lower, double upper, double c)
+        const;
+        ///<@brief Principal value of the integral of f(x)/(x-c) in the
+        ///< interval [`lower`,`upper`].
+
+        ///< Both `lower` and `upper` need to be finite and `c` needs to lie
+        ///< strictly in between.
+    Result integrate(const Function& f, double lower, double upper, double c)
+        const;
+        ///< Same as `operator()`, but return the full `Result`. If the
+        ///< requested precision is not reached, no exception is thrown.
+    template<class F, Real_callable<F> =0>
+    Value operator()(const F& f, double lower, double upper, double c) const;
+    template<class F, Real_callable<F> =0>
+    Result integrate(const F& f, double lower, double upper, double c) const;
 
     void reserve(std::size_t space);
         // Change the size of the workspace used by the gsl integration
@@ -388,7 +491,19 @@ public:
         : MethodTemplate(p, gsl_interp_type_min_size) {}
 };
 
+/// Storage of the data of an `Interpolate`.
+enum class Precision {
+    double_precision,
+    single_precision
+        ///< Values and second derivatives of a cubic spline as float, see
+        ///< `Interpolate::error_bound`.
+};
+
 /// Interpolation of 1 dimensional data provided as pairs (x_i,y_i).
+///
+/// The data and the initialized GSL object are immutable and shared by
+/// copies, every copy only owns its accelerator. Several interpolators on
+/// the same grid can share it, see the constructor taking pointers.
 class Interpolate {
 public:
     Interpolate(const Interval& x, const std::vector<double>& y,
@@ -396,6 +511,16 @@ public:
         ///< The sizes of `x` and `y` need to be the same. `tolerant` influences
         ///< the behavour of `operator()` at the boundaries and beyond, see
         ///< below.
+    Interpolate(std::shared_ptr<const Interval> x,
+            std::shared_ptr<const std::vector<double>> y, InterpolationMethod m,
+            bool tolerant=true, Precision precision=Precision::double_precision);
+        ///< @brief Interpolate without copying `x` and `y`, which must not be
+        ///< modified afterwards.
+        ///<
+        ///< With `Precision::single_precision` only `x` is kept, the values
+        ///< and second derivatives of the natural cubic spline are stored as
+        ///< float and evaluated without GSL. Throws std::invalid_argument
+        ///< unless `m` is `InterpolationMethod::cubic`.
     Interpolate(const Interpolate& other);
     Interpolate(Interpolate&& other);
     Interpolate();
@@ -420,32 +545,75 @@ public:
     double derivative2(double x) const;
         ///< Return the value of the second derivative at point `x`.
         ///< Note: for e.g. linear interpolation this will always be zero.
+    ad::Dual<double> operator()(const ad::Dual<double>& x) const;
+        ///< Return value and derivative at point `x`, using the analytic
+        ///< derivative of the interpolant. Beyond the interval a tolerant
+        ///< interpolator is constant, its derivative is zero there.
+
+    double front() const noexcept {return x_data->front();}
+    double back() const noexcept {return x_data->back();}
+    const Interval& grid() const noexcept {return *x_data;}
+        ///< The points x_i.
+    std::shared_ptr<const Interval> share_grid() const noexcept
+    {
+        return x_data;
+    }
+        ///< The points x_i, for further interpolators on the same grid.
+    std::vector<double> values() const;
+        ///< The values y_i, rounded to float in single precision.
 
-    double front() const noexcept {return x_data.front();}
-    double back() const noexcept {return x_data.back();}
+    Precision precision() const noexcept
+    {
+        return single ? Precision::single_precision
+            : Precision::double_precision;
+    }
+    double error_bound() const noexcept {return single ? single->bound : 0.;}
+        ///< @brief Bound on the deviation of the values from the spline in
+        ///< double precision, zero in double precision.
+        ///<
+        ///< Rounding y_i and the second derivatives c_i to float changes
+        ///< them by at most eps=2^-24 relative, hence the value on
+        ///< [x_i,x_i+1] by at most eps*(max(|y_i|,|y_i+1|)
+        ///< +h_i^2/(9*sqrt(3))*(|c_i|+|c_i+1|)). The bound is the largest of
+        ///< these, i.e. about 6e-8 times the largest value for smooth data.
 
     bool is_tolerant() const noexcept {return tolerant;}
     void be_tolerant() noexcept {tolerant = true;}
     void be_strict() noexcept {tolerant = false;}
 private:
-    // The GSL routine needs a copy of the data. This copy is stored
-    // explicitly (instead of implicitly by the GSL 1d higher-level interface)
-    // to allow for copy and move constructors.
-    std::vector<double> x_data;
-    std::vector<double> y_data;
+    /// Natural cubic spline with data stored as float.
+    struct Single {
+        std::vector<float> y;
+        std::vector<float> second;   ///< second derivatives
+        double bound;                ///< see `error_bound`
+    };
+    struct Interp_deleter {
+        void operator()(const gsl_interp* p) const
+        {
+            gsl_interp_free(const_cast<gsl_interp*>(p));
+        }
+    };
+
+    std::shared_ptr<const Interval> x_data;
+    std::shared_ptr<const std::vector<double>> y_data;
 
     InterpolationMethod method;
     bool tolerant;
     gsl_interp_accel* acc{gsl_interp_accel_alloc()};
-    gsl_interp* spline;
+    std::shared_ptr<const gsl_interp> spline;
+        ///< read-only after initialization, hence shared by copies
+    std::shared_ptr<const Single> single;
 private:
+    void initialize(Precision precision);
+    double evaluate_single(int order, double x) const;
     template<class Function>
-    double evaluate(Function f, double x) const;
+    double evaluate(Function f, int order, double x) const;
 };
 
 template<class Function>
-double Interpolate::evaluate(Function f, double x) const
+double Interpolate::evaluate(Function f, int order, double x) const
 {
+    INSTR_COUNT("gsl::Interpolate::evaluate");
     double result{};
     if(tolerant) {
         if (x<front())
@@ -453,13 +621,18 @@ double Interpolate::evaluate(Function f, double x) const
         else if (x>back())
             x = back();
     }
-    call(f,spline,x_data.data(),y_data.data(),x,acc,&result);
+    if (single)
+        return evaluate_single(order,x);
+    call(f,spline.get(),x_data->data(),y_data->data(),x,acc,&result);
     return result;
 }
 
 Interpolate sample(const Function& f, const Interval& i,
         InterpolationMethod m, bool tolerant=true);
     ///< Interpolate `f` along `i`.
+template<class F, Real_callable<F> =0>
+Interpolate sample(const F& f, const Interval& i, InterpolationMethod m,
+        bool tolerant=true);
 
 template<class InIterA, class InIterB>
 Interpolate make_interpolate(InIterA first1, InIterA last1, InIterB first2,
@@ -587,6 +760,9 @@ Value derivative(const Function& f, double value, double step_size,
     ///< @param value the value at which derivative is computed
     ///< @param step_size used to estimate the optimal step size
     ///< @param method the method that is used to compute the derivative
+template<class F, Real_callable<F> =0>
+Value derivative(const F& f, double value, double step_size,
+        DerivativeMethod method=DerivativeMethod::central);
 
 // -- Helper-functions --------------------------------------------------------
 
@@ -603,6 +779,199 @@ bool signed_interval(Number& a, Number& b)
     }
     return true;
 }
+
+// -- Callables ---------------------------------------------------------------
+
+template<class F>
+double trampoline(double x, void* p)
+    /// Call the `F` pointed to by `p` with `x`, `trampoline` provides the
+    /// signature needed by the gsl routines.
+{
+    return (*static_cast<const F*>(p))(x);
+}
+
+template<class F>
+gsl_function make_function(const F& f)
+    /// @brief Wrap `f` such that it can be used by the gsl routines.
+    ///
+    /// ATTENTION: the result refers to `f`, which hence needs to exist for
+    /// the entire run time of the gsl routine.
+{
+    gsl_function function;
+    function.function = trampoline<F>;
+    function.params = const_cast<F*>(std::addressof(f));
+    return function;
+}
+
+template<class F, Real_callable<F>>
+double GaussLegendre::operator()(const F& f, double lower, double upper) const
+{
+    gsl_function function{make_function(f)};
+    return gsl_integration_glfixed(&function,lower,upper,table.get());
+}
+
+template<class F, Real_callable<F>>
+Value Qag::operator()(const F& f, double lower, double upper) const
+{
+    const Result result{integrate(f,lower,upper)};
+    check(result.status);
+    return Value{result.value,result.error};
+}
+
+template<class F, Real_callable<F>>
+Result Qag::integrate(const F& f, double lower, double upper) const
+{
+    const int sign{signed_interval(lower,upper) ? 1 : -1};
+
+    Result r;
+    const auto counted = [&f,&r](double x) -> double
+    {
+        ++r.evaluations;
+        return f(x);
+    };
+    gsl_function function{make_function(counted)};
+
+    double result{0.0};
+    double error{0.0};
+
+    const bool lower_inf{std::isinf(lower)};
+    const bool upper_inf{std::isinf(upper)};
+
+    if (lower_inf && upper_inf)
+        r.status = gsl_integration_qagi(&function,absolute_precision,
+                relative_precision,limit,workspace.data(),&result,&error);
+    else if (lower_inf)
+        r.status = gsl_integration_qagil(&function,upper,absolute_precision,
+                relative_precision,limit,workspace.data(),&result,&error);
+    else if (upper_inf)
+        r.status = gsl_integration_qagiu(&function,lower,absolute_precision,
+                relative_precision,limit,workspace.data(),&result,&error);
+    else
+        r.status = gsl_integration_qags(&function,lower,upper,
+                absolute_precision,relative_precision,limit,workspace.data(),
+                &result,&error);
+
+    r.value = sign*result;
+    r.error = error;
+    r.intervals = workspace.data()->size;
+    return r;
+}
+
+template<class F, Real_callable<F>>
+Value Qawc::operator()(const F& f, double lower, double upper, double c) const
+{
+    const Result result{integrate(f,lower,upper,c)};
+    check(result.status);
+    return Value{result.value,result.error};
+}
+
+template<class F, Real_callable<F>>
+Result Qawc::integrate(const F& f, double lower, double upper, double c) const
+{
+    if (std::isinf(lower) || std::isinf(upper))
+        throw std::invalid_argument{"Qawc needs a finite interval"};
+
+    Result r;
+    const auto counted = [&f,&r](double x) -> double
+    {
+        ++r.evaluations;
+        return f(x);
+    };
+    gsl_function function{make_function(counted)};
+
+    // the sign for upper<lower is taken care of by the gsl routine
+    r.status = gsl_integration_qawc(&function,lower,upper,c,
+            absolute_precision,relative_precision,limit,workspace.data(),
+            &r.value,&r.error);
+    r.intervals = workspace.data()->size;
+    return r;
+}
+
+template<class F, Real_callable<F>>
+Value Cquad::operator()(const F& f, double lower, double upper) const
+{
+    const Result result{integrate(f,lower,upper)};
+    check(result.status);
+    return Value{result.value,result.error};
+}
+
+template<class F, Real_callable<F>>
+Result Cquad::integrate(const F& f, double lower, double upper) const
+{
+    // operator() and the Function overload forward here
+    INSTR_COUNT("gsl::Cquad::integrate");
+    const int sign{signed_interval(lower,upper) ? 1 : -1};
+
+    const bool lower_inf{std::isinf(lower)};
+    const bool upper_inf{std::isinf(upper)};
+
+    // `gsl_integration_cquad` does not provide functions for the integration
+    // of infinite intervals. Hence, the required change of variables is
+    // performed explicitly.
+    if (lower_inf && upper_inf)
+        return integrate_finite([&f](double x) -> double
+                {return (f((1-x)/x) + f((x-1)/x)) / (x*x);},0.0,1.0,sign);
+    if (lower_inf)
+        return integrate_finite([&f,upper](double x) -> double
+                {return f(upper+(x-1)/x) / (x*x);},0.0,1.0,sign);
+    if (upper_inf)
+        return integrate_finite([&f,lower](double x) -> double
+                {return f(lower+(1-x)/x) / (x*x);},0.0,1.0,sign);
+    return integrate_finite(f,lower,upper,sign);
+}
+
+template<class F>
+Result Cquad::integrate_finite(const F& f, double lower, double upper,
+        int sign) const
+{
+    gsl_function function{make_function(f)};
+    double result{0.0};
+    double error{0.0};
+
+    std::size_t evaluations{0};
+    Result r;
+    r.status = gsl_integration_cquad(&function,lower,upper,absolute_precision,
+            relative_precision,workspace.data(),&result,&error,&evaluations);
+    INSTR_ADD("gsl::Cquad integrand evaluations",evaluations);
+    r.value = sign*result;
+    r.error = error;
+    r.evaluations = evaluations;
+    return r;
+}
+
+template<class F, Real_callable<F>>
+Interpolate sample(const F& f, const Interval& i, InterpolationMethod m,
+        bool tolerant)
+{
+    std::vector<double> y_values(i.size());
+    std::transform(i.cbegin(),i.cend(),y_values.begin(),
+            [&f](double x) -> double {return f(x);});
+
+    return Interpolate{i,y_values,m,tolerant};
+}
+
+template<class F, Real_callable<F>>
+Value derivative(const F& f, double value, double step_size,
+        DerivativeMethod method)
+{
+    gsl_function function{make_function(f)};
+    double result{0.0};
+    double abs_error{0.0};
+    switch (method) {
+        case DerivativeMethod::central:
+            gsl_deriv_central(&function, value, step_size, &result, &abs_error);
+            break;
+        case DerivativeMethod::forward:
+            gsl_deriv_forward(&function, value, step_size, &result, &abs_error);
+            break;
+        case DerivativeMethod::backward:
+            gsl_deriv_backward(&function, value, step_size, &result, &abs_error);
+            break;
+        default:
+            throw std::runtime_error{"switch does not cover all cases"};
+    }
+    return Value{result, abs_error};
+}
 } // gsl
 
 #endif // GSL_INTERFACE_H
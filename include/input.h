@@ -4,12 +4,27 @@
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <string>
 #include "gsl_interface.h"
 #include "combination.h"
+#include "memo.h"
 
 /// Namespace to readin, spline and match the gamma K to K pi function from https://inspirehep.net/literature/1835296
 namespace input{
 
+std::vector<std::vector<double>> read_table(const std::string& file, std::size_t columns);
+///< Reads whitespace separated numbers from file, which is read at once, and returns them column-wise.
+///< Like a loop over operator>>, reading stops at the first row that is incomplete or not numeric. Throws std::runtime_error if file cannot be opened
+///<@param columns number of columns per row
+std::vector<std::vector<double>> read_table(const std::string& file, std::size_t columns, double lower, double upper, std::size_t margin);
+///< Like read_table, but returns only the rows whose first column lies in [lower,upper] and up to margin rows before and after, for files sorted by the first column.
+///< The rows before are skipped by converting their first number only, which assumes one row per line, reading stops after the rows beyond upper
+std::vector<std::vector<double>> read_amplitude(int i, const comb::Combination& combination);
+///< Reads the file gammaKKpi::file(i,false) written by combination.output(i) or combination.output_all() via read_table. Throws std::runtime_error if the file is incomplete,
+///< i.e. if its completion marker (see checkpoint::commit) does not match the number of rows or combination.fingerprint(i) for either comb::Combination::Projection
+///< or, for files written without marker, if the rows do not cover combination.grid()
+
 /// Class to readin, spline and match the gamma K to K pi function from https://inspirehep.net/literature/1835296
 class gammaKKpi
 {
@@ -20,6 +35,27 @@ public:
 	///<@param use_err if true readin_old is used and files with uncertainties generated in https://inspirehep.net/literature/1835296 are used
 	///< if true readin is used and new files using basis functions from https://inspirehep.net/literature/1835296 but adaptive subtraction constants are used, no uncertainties are calculated
 
+	/// Complete constructed state, see gammaKKpi::state
+	struct State
+	{
+		std::vector<double> s_list, real_list, imag_list, real_err_list, imag_err_list, abs_list, abs_err_list;
+		double a, b, a_err, b_err, matchpoint;
+		/// Precision of the interpolators and gammaKKpi::compacted
+		gsl::Precision precision = gsl::Precision::double_precision;
+		bool compacted = false;
+	};
+	explicit gammaKKpi(State state);
+	///< Restores a constructed state, e.g. from a snapshot, without reading files, gammaKKpi::spline, gammaKKpi::spline_err and gammaKKpi::match.
+	///< The interpolators are built in the precision of the state
+	/// Returns the state needed by gammaKKpi(State). After gammaKKpi::compact, s_list, abs_list and abs_err_list are taken from the interpolators
+	/// and the other lists are empty
+	State state() const;
+	gammaKKpi(std::vector<double> s_list, std::vector<double> real_list, std::vector<double> imag_list, double matchpoint);
+	///< Uses data computed elsewhere, e.g. by pipeline::Pipeline, instead of reading a file. Runs gammaKKpi::spline, gammaKKpi::spline_err and gammaKKpi::match, no uncertainties are included
+
+	/// Returns the file read in by gammaKKpi::which_readin for i and use_err
+	static std::string file(int i, bool use_err);
+
 	std::vector<double> s_list;
 	std::vector<double> real_list;
 	std::vector<double> imag_list;
@@ -34,7 +70,7 @@ public:
 	/// Matchpoint set in Constructor
 	double matchpoint;
 
-	/// Called in gammaKKpi::readin if file does not exist with the subtraction constants calculated in https://inspirehep.net/literature/1835296
+	/// Called in gammaKKpi::readin if file does not exist with the subtraction constants calculated in https://inspirehep.net/literature/1835296. The basis functions are only read in in this case
 	comb::Combination combination;
 
 	gsl::Interpolate spline_abs;
@@ -42,19 +78,32 @@ public:
 
 	/// Called in Constructor. Depending on use_err decides which readin function is used
 	void which_readin(int i, bool use_err);
-	/// Reads in file. If the file does not exist creates new one according to gammaKKpi::combination
+	/// Reads in file via input::read_amplitude. If the file does not exist creates new one according to gammaKKpi::combination,
+	/// continuing from the checkpoint of an interrupted run. Throws std::runtime_error if the file is incomplete, remove it to create it again
 	void readin(int i);
 	/// Reads in file from https://inspirehep.net/literature/1835296 including uncertainties
 	void readin_old(int i);
 	/// Splines functions
 	void spline();
-	/// Splines uncertainies
+	/// Splines uncertainies. Without uncertainties, i.e. empty real_err_list and imag_err_list, the values are taken as uncertainties
 	void spline_err();
 
-	/// Calculates the derivative. Needed for matching.
-	double deriv(double x, double step);
+	/// Releases the lists, only spline_abs and spline_abs_err are kept, on one shared grid and optionally in single precision, see gsl::Precision.
+	/// Evaluation and the match parameters are not affected, apart from the error of single precision bounded by gsl::Interpolate::error_bound.
+	/// If the precision changes, the caches are renewed, see gammaKKpi::renew_cache
+	void compact(gsl::Precision precision = gsl::Precision::double_precision);
+	/// True after gammaKKpi::compact
+	bool compacted = false;
+
 	/// Matches the interpolated function to analytic function at gammaKKpi::matchpoint
 	void match();
+	/// Parameters of the analytic continuation, see gammaKKpi::cont and gammaKKpi::cont_err
+	struct Match
+	{
+		double a, b, a_err, b_err;
+	};
+	/// Computes the parameters set by gammaKKpi::match for the given matchpoint without modifying this instance. Uses the analytic derivative of the splines
+	Match match_at(double matchpoint) const;
 
 	/// Analytic function for continuation. Uses parameters from gammaKKpi::match
 	double cont(double s);
@@ -62,9 +111,66 @@ public:
 	double cont_err(double s);
 
 	/// Evalutes the function. Below the matchpoint uses interpolated splines, above the function gammaKKpi::cont
-	double operator()(double s);
+	double evaluate(double s);
 	/// Evalutes the uncertanty of the function. Below the matchpoint uses interpolated splines, above the function gammaKKpi::cont_err
+	double evaluate_err(double s);
+	/// gammaKKpi::evaluate with its derivative, from the analytic derivatives of the spline and of gammaKKpi::cont
+	ad::Dual<double> evaluate(const ad::Dual<double>& s) const;
+	/// gammaKKpi::evaluate_err with its derivative
+	ad::Dual<double> evaluate_err(const ad::Dual<double>& s) const;
+
+	/// Evalutes the function via gammaKKpi::evaluate, uses the cache if enabled
+	double operator()(double s);
+	/// Evalutes the uncertanty of the function via gammaKKpi::evaluate_err, uses the cache if enabled
 	double operator[](double s);
+
+	/// Caches for gammaKKpi::operator() and gammaKKpi::operator[], disabled if empty. Copies share the caches.
+	std::shared_ptr<memo::Cache<double>> value_cache;
+	std::shared_ptr<memo::Cache<double>> error_cache;
+	/// Enables caches storing up to capacity values each. Existing entries are discarded
+	void enable_cache(std::size_t capacity);
+	/// Disables the caches
+	void disable_cache();
+	/// Replaces enabled caches by empty ones of the same capacity, which are no longer shared with copies. Called when the interpolators change
+	void renew_cache();
+	/// Combined hit-rate statistics of both caches
+	memo::Statistics cache_statistics() const;
+};
+
+/// t-channel amplitude tabulated in dispersive_t_channel/k0pp.dat, interpolated by a natural cubic spline on its uniform grid.
+/// The spline is evaluated by computing the interval from t directly, without gsl accelerators, such that all evaluations are const and thread-safe
+class TChannel
+{
+public:
+	explicit TChannel(const std::string& file = TChannel::file());
+	///< Reads file via input::read_table. Throws std::invalid_argument if the points are not on a uniform grid in ascending order
+
+	/// Returns the default file
+	static std::string file();
+	/// Instance for the default file, read once per process. Thread-safe
+	static std::shared_ptr<const TChannel> shared();
+
+	/// Evaluates the amplitude at t. Throws std::domain_error if t is outside of [front(), back()]
+	double operator()(double t) const;
+	/// Evaluates the amplitude at the n points t and writes the results to values
+	void operator()(std::size_t n, const double* t, double* values) const;
+	/// Evaluates the amplitude at all points of t
+	std::vector<double> operator()(const std::vector<double>& t) const;
+
+	double front() const noexcept {return t_list.front();}
+	double back() const noexcept {return t_list.back();}
+	std::size_t size() const noexcept {return t_list.size();}
+
+	std::vector<double> t_list;
+	std::vector<double> value_list;
+
+private:
+	/// grid spacing
+	double step;
+	/// second derivatives of the spline at the grid points
+	std::vector<double> second;
+
+	double evaluate(double t) const;
 };
 
 }
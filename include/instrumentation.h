@@ -0,0 +1,125 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/// @brief Opt-in counters and timers for the hot paths.
+///
+/// Instrumentation is compiled in only if `KAON_INSTRUMENTATION` is defined
+/// (e.g. `-DKAON_INSTRUMENTATION`). Otherwise the macros `INSTR_COUNT`,
+/// `INSTR_ADD` and `INSTR_SCOPE` expand to nothing and cost nothing.
+///
+/// If the environment variable `KAON_INSTRUMENTATION_REPORT` is set to a path
+/// `p`, a report is written to `p.txt` and `p.json` when the program exits.
+namespace instr {
+
+/// Entry of a report.
+struct Record {
+    std::string name;
+    std::uint64_t count;
+    double seconds; ///< total time spent in scopes, zero for plain counters
+};
+
+/// @brief Thread-safe counter of calls and time.
+
+/// The counts are spread over several cache lines indexed by thread, such
+/// that concurrent increments do not contend. They are summed up in
+/// `count()` and `seconds()`.
+class Counter {
+public:
+    explicit Counter(std::string name) : name_{std::move(name)} {}
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    void add(std::uint64_t n=1) noexcept
+    {
+        slot().count.fetch_add(n,std::memory_order_relaxed);
+    }
+    void add_time(std::chrono::nanoseconds t) noexcept
+    {
+        Slot& s{slot()};
+        s.count.fetch_add(1,std::memory_order_relaxed);
+        s.nanoseconds.fetch_add(static_cast<std::uint64_t>(t.count()),
+                std::memory_order_relaxed);
+    }
+
+    const std::string& name() const noexcept {return name_;}
+    std::uint64_t count() const noexcept;
+    double seconds() const noexcept;
+    void reset() noexcept;
+private:
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> count{0};
+        std::atomic<std::uint64_t> nanoseconds{0};
+    };
+    static constexpr std::size_t slots{16};
+
+    Slot& slot() noexcept;
+
+    std::string name_;
+    std::array<Slot,slots> data;
+};
+
+Counter& counter(const std::string& name);
+    ///< Return the counter called `name`, create it if it does not exist yet.
+    ///< References stay valid for the run time of the program.
+
+/// Add the time between construction and destruction to a `Counter`.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Counter& c)
+        : c{c}, start{std::chrono::steady_clock::now()} {}
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    ~ScopedTimer()
+    {
+        c.add_time(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now()-start));
+    }
+private:
+    Counter& c;
+    std::chrono::steady_clock::time_point start;
+};
+
+std::vector<Record> report();
+    ///< Return the state of all counters, sorted by name.
+void write_text(std::ostream& out);
+    ///< Write `report()` as a table.
+void write_json(std::ostream& out);
+    ///< Write `report()` as JSON.
+void reset();
+    ///< Set all counters to zero.
+
+} // instr
+
+#define INSTR_CONCAT_IMPL(a,b) a##b
+#define INSTR_CONCAT(a,b) INSTR_CONCAT_IMPL(a,b)
+
+#ifdef KAON_INSTRUMENTATION
+/// Count one call of the enclosing code.
+#define INSTR_COUNT(name) INSTR_ADD(name,1)
+/// Add `n` to the counter `name`.
+#define INSTR_ADD(name,n) \
+    do { \
+        static instr::Counter& instr_counter_{instr::counter(name)}; \
+        instr_counter_.add(n); \
+    } while (false)
+/// Count and time the enclosing scope.
+#define INSTR_SCOPE(name) \
+    static instr::Counter& INSTR_CONCAT(instr_scope_counter_,__LINE__){ \
+        instr::counter(name)}; \
+    const instr::ScopedTimer INSTR_CONCAT(instr_scope_timer_,__LINE__){ \
+        INSTR_CONCAT(instr_scope_counter_,__LINE__)}
+#else
+#define INSTR_COUNT(name) do {} while (false)
+#define INSTR_ADD(name,n) do {} while (false)
+#define INSTR_SCOPE(name) do {} while (false)
+#endif
+
+#endif // INSTRUMENTATION_H
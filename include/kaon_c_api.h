@@ -0,0 +1,85 @@
+#ifndef _kaon_c_api_
+#define _kaon_c_api_
+
+/* C interface to the library, meant to be built as a shared library.
+ *
+ * Handles are opaque. All evaluation functions take an array of n values of
+ * Mandelstam s and write into buffers provided by the caller; nothing is
+ * allocated or copied on the caller's side. The points are distributed over
+ * `threads` threads (0: number of hardware threads). A handle must not be
+ * used by several caller threads at the same time, the threading is done
+ * internally on private copies of the handle.
+ *
+ * All functions except the destructors return a kaon_status. If it is not
+ * KAON_OK, kaon_last_error() describes the error of the calling thread. */
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#define KAON_API __declspec(dllexport)
+#else
+#define KAON_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Version of the interface, incremented on incompatible changes */
+#define KAON_C_API_VERSION 1
+
+typedef enum kaon_status {
+    KAON_OK = 0,
+    KAON_INVALID_ARGUMENT = 1, /* null pointer, channel or num_sub out of range */
+    KAON_DOMAIN_ERROR = 2,
+    KAON_INTEGRATION_ERROR = 3, /* an integration did not converge */
+    KAON_RUNTIME_ERROR = 4, /* e.g. missing input files */
+    KAON_UNKNOWN_ERROR = 5
+} kaon_status;
+
+/* DispersiveIntegral together with its two discontinuities */
+typedef struct kaon_dispersive kaon_dispersive;
+/* Combination of the basis functions, i.e. the amplitudes f(i,s) */
+typedef struct kaon_combination kaon_combination;
+
+KAON_API int kaon_c_api_version(void);
+    /* Return KAON_C_API_VERSION of the library. */
+KAON_API const char* kaon_last_error(void);
+    /* Message of the last error in the calling thread, empty if none. */
+
+KAON_API kaon_status kaon_dispersive_create(kaon_dispersive** handle);
+    /* Read in the input of DispersiveIntegral, cf. DispersiveIntegral(1,0). */
+KAON_API void kaon_dispersive_destroy(kaon_dispersive* handle);
+
+KAON_API kaon_status kaon_dispersive_evaluate(kaon_dispersive* handle,
+        int num_sub, int err, const double* s, size_t n, double* real,
+        double* imag, int threads);
+    /* Dispersive integral for num_sub subtractions and the discontinuity
+     * selected by err (0: central, 1: lower, 2: upper uncertainty). */
+KAON_API kaon_status kaon_discontinuity_evaluate(kaon_dispersive* handle,
+        int charged, const double* s, size_t n, double* values,
+        double* errors, int threads);
+    /* Discontinuity with charged (charged!=0) or neutral kaon in the
+     * intermediate state. errors may be NULL, otherwise the uncertainty
+     * is written to it. */
+
+KAON_API kaon_status kaon_combination_create(double a0, double a12,
+        double b0, double b12, kaon_combination** handle);
+    /* Read in and spline the basis functions with the given subtraction
+     * constants, cf. comb::Combination. */
+KAON_API void kaon_combination_destroy(kaon_combination* handle);
+
+KAON_API kaon_status kaon_combination_evaluate(kaon_combination* handle,
+        int i, const double* s, size_t n, double* real, double* imag,
+        int threads);
+    /* Partial wave f(i,s), i=1: -0, i=2: 0-, i=3: 00, i=4: -+. */
+KAON_API kaon_status kaon_combination_evaluate_all(kaon_combination* handle,
+        const double* s, size_t n, double* real, double* imag, int threads);
+    /* All four partial waves, real and imag hold 4*n values, f(i,s[k]) is
+     * stored at index 4*k+i-1. */
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
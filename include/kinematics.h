@@ -0,0 +1,179 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include "constants.h"
+#include "dual.h"
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+/// @brief Kinematics of gamma K -> K pi: Källén function, Mandelstam t and u
+/// and the phase-space factor of the discontinuity.
+///
+/// All mass-dependent quantities are compile-time constants. Besides the
+/// scalar functions there are batched versions evaluating whole arrays, e.g.
+/// all nodes of a quadrature rule at once. Their loops are free of branches
+/// and calls other than `std::sqrt`, such that the compiler can vectorize
+/// them. Overloads for `ad::Dual` propagate derivatives with respect to s.
+namespace kin {
+
+/// squared mass of the charged pion
+constexpr double mass_pi2{constants::mass_pi()*constants::mass_pi()};
+/// squared mass of the kaon
+constexpr double mass_kaon2{constants::mass_kaon()*constants::mass_kaon()};
+/// threshold of gamma K -> K pi
+constexpr double sth{(constants::mass_pi()+constants::mass_kaon())
+    *(constants::mass_pi()+constants::mass_kaon())};
+/// s+t+u = 3*s0
+constexpr double s0{1./3*(2*mass_kaon2+mass_pi2)};
+/// constant part of t, see kin::t
+constexpr double delta{mass_kaon2*(mass_kaon2-mass_pi2)};
+/// 1/(4 pi e^2) with e^2 = 4 pi alpha
+constexpr double inverse_charge2{1./(16*constants::pi()*constants::pi()
+        *constants::fine_structure_constant())};
+
+constexpr double kaellen(double a, double b, double c)
+    ///< Källén function
+{
+    return a*a+b*b+c*c-2.*(a*b+b*c+a*c);
+}
+
+inline double kaellen_product(double s)
+    ///< @brief Product of the square roots of the Källén functions entering
+    ///< kin::t, independent of z.
+    ///<
+    ///< The first factor is sqrt(kaellen(s,0,mass_kaon2)) = |s-mass_kaon2|.
+{
+    return std::abs(s-mass_kaon2)*std::sqrt(kaellen(s,mass_pi2,mass_kaon2));
+}
+
+constexpr double t(double s, double z, double product)
+    ///< Mandelstam t, `product` needs to equal kaellen_product(s)
+{
+    return 0.5*(3*s0-s+(product*z-delta)/s);
+}
+
+inline double t(double s, double z)
+    ///< Mandelstam t depending on s and the cosine z of the s-channel
+    ///< scattering angle
+{
+    return t(s,z,kaellen_product(s));
+}
+
+constexpr double u(double s, double t)
+    ///< Mandelstam u for given s and t
+{
+    return 3*s0-s-t;
+}
+
+inline double phase_space(double s)
+    ///< @brief Factor of the discontinuity multiplying the squared modulus of
+    ///< the amplitude, i.e. kaellen(s,mass_pi2,mass_kaon2)^(3/2)/(72 s^2)
+    ///< /(4 pi e^2). Only meaningful for s>=sth.
+{
+    const double lambda{kaellen(s,mass_pi2,mass_kaon2)};
+    return inverse_charge2*lambda*std::sqrt(lambda)/(72*s*s);
+}
+
+/// Ranges of t and u, see kin::reach.
+struct Reach {
+    double t_lower;
+    double t_upper;
+    double u_lower;
+    double u_upper;
+};
+
+inline Reach reach(double lower, double upper, std::size_t samples=1000)
+    ///< @brief Ranges of t(s,z) and u for s in [`lower`,`upper`] and z in
+    ///< [-1,1], where sth <= `lower`.
+    ///<
+    ///< t is linear in z, hence extremal at z=+-1. In s the extremes are
+    ///< taken from `samples` equidistant points including the end points,
+    ///< i.e. an extremum inside the range may be underestimated slightly.
+{
+    constexpr double infinity{std::numeric_limits<double>::infinity()};
+    Reach r{infinity,-infinity,infinity,-infinity};
+    for (std::size_t k=0; k<=samples; ++k) {
+        const double s{k<samples ? lower+(upper-lower)*k/samples : upper};
+        const double product{kaellen_product(s)};
+        for (double z: {-1.,1.}) {
+            const double t_z{t(s,z,product)};
+            const double u_z{u(s,t_z)};
+            r.t_lower = std::fmin(r.t_lower,t_z);
+            r.t_upper = std::fmax(r.t_upper,t_z);
+            r.u_lower = std::fmin(r.u_lower,u_z);
+            r.u_upper = std::fmax(r.u_upper,u_z);
+        }
+    }
+    return r;
+}
+
+// -- Batched versions --------------------------------------------------------
+
+inline void t_u(double s, std::size_t n, const double* z, double* t,
+        double* u)
+    ///< Write t(s,z[k]) and u to `t[k]` and `u[k]` for k<n.
+{
+    const double product{kaellen_product(s)};
+    const double constant{0.5*(3*s0-s-delta/s)};
+    const double slope{0.5*product/s};
+    for (std::size_t k=0; k<n; ++k) {
+        t[k] = constant+slope*z[k];
+        u[k] = 3*s0-s-t[k];
+    }
+}
+
+inline void phase_space(std::size_t n, const double* s, double* values)
+    ///< Write phase_space(s[k]) to `values[k]` for k<n.
+{
+    for (std::size_t k=0; k<n; ++k) {
+        const double lambda{kaellen(s[k],mass_pi2,mass_kaon2)};
+        values[k] = inverse_charge2*lambda*std::sqrt(lambda)/(72*s[k]*s[k]);
+    }
+}
+
+// -- Dual numbers ------------------------------------------------------------
+
+inline ad::Dual<double> kaellen(const ad::Dual<double>& a, double b,
+        double c)
+    ///< Källén function depending on a dual a
+{
+    return a*a+(b*b+c*c-2.*b*c)-2.*(b+c)*a;
+}
+
+inline ad::Dual<double> kaellen_product(const ad::Dual<double>& s)
+    ///< kin::kaellen_product with its derivative, which diverges at the
+    ///< threshold
+{
+    return ad::abs(s-mass_kaon2)*ad::sqrt(kaellen(s,mass_pi2,mass_kaon2));
+}
+
+inline ad::Dual<double> t(const ad::Dual<double>& s, double z,
+        const ad::Dual<double>& product)
+    ///< Mandelstam t, `product` needs to equal kaellen_product(s)
+{
+    return 0.5*(3*s0-s+(product*z-delta)/s);
+}
+
+inline ad::Dual<double> t(const ad::Dual<double>& s, double z)
+{
+    return t(s,z,kaellen_product(s));
+}
+
+inline ad::Dual<double> u(const ad::Dual<double>& s,
+        const ad::Dual<double>& t)
+{
+    return 3*s0-s-t;
+}
+
+inline ad::Dual<double> phase_space(const ad::Dual<double>& s)
+    ///< kin::phase_space with its derivative, only meaningful for s>=sth
+{
+    const ad::Dual<double> lambda{kaellen(s,mass_pi2,mass_kaon2)};
+    return inverse_charge2*lambda*ad::sqrt(lambda)/(72*s*s);
+}
+
+} // kin
+
+#endif // KINEMATICS_H
@@ -0,0 +1,203 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+/// Memoization of expensive functions of one real argument.
+namespace memo {
+
+/// Usage statistics of a `Cache`.
+struct Statistics {
+    std::size_t hits{0};
+    std::size_t misses{0};
+    std::size_t entries{0};
+    std::size_t capacity{0};
+
+    double hit_rate() const noexcept
+    {
+        const std::size_t lookups{hits+misses};
+        return lookups ? static_cast<double>(hits)/lookups : 0.0;
+    }
+};
+
+/// @brief Bounded, thread-safe cache for values of a function of one `double`.
+
+/// Arguments are compared bitwise, i.e. only exactly identical arguments
+/// are considered to be the same. The cache is split into shards, each
+/// guarded by its own mutex, such that concurrent lookups rarely contend.
+/// If a shard is full, its oldest entry is replaced (first in, first out).
+///
+/// The cache does not know the function it memoizes. If the state of the
+/// function changes, `clear()` needs to be called.
+template<class Value>
+class Cache {
+public:
+    explicit Cache(std::size_t capacity, std::size_t shards=16);
+        ///< `capacity` is the maximal number of stored values (rounded up to
+        ///< a multiple of `shards`).
+    Cache(const Cache&) = delete;
+    Cache& operator=(const Cache&) = delete;
+
+    template<class Function>
+    Value operator()(double x, Function f);
+        ///< Return the stored value for `x` or evaluate `f(x)` and store it.
+
+        ///< `f` is evaluated without holding a lock, hence concurrent misses
+        ///< for the same `x` may evaluate `f` more than once.
+
+    bool find(double x, Value& value);
+        ///< If a value for `x` is stored, write it to `value` and return true.
+    void insert(double x, const Value& value);
+        ///< Store `value` for `x`.
+
+    void clear();
+        ///< Remove all entries and reset the statistics.
+    std::size_t capacity() const noexcept
+        {return shard_capacity*shards.size();}
+        ///< Maximal number of stored values.
+    Statistics statistics() const;
+private:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::uint64_t,Value> values;
+        std::vector<std::uint64_t> order; // ring buffer of keys, oldest first
+        std::size_t next{0};
+    };
+
+    static std::uint64_t key(double x) noexcept;
+    Shard& shard(std::uint64_t k) noexcept;
+
+    std::size_t shard_capacity;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<std::size_t> hits{0};
+    std::atomic<std::size_t> misses{0};
+};
+
+template<class Value>
+Cache<Value>::Cache(std::size_t capacity, std::size_t number_of_shards)
+{
+    if (!capacity || !number_of_shards)
+        throw std::invalid_argument{"Cache needs a positive capacity and at \
+least one shard"};
+    shard_capacity = (capacity+number_of_shards-1)/number_of_shards;
+    shards.reserve(number_of_shards);
+    for (std::size_t i=0; i<number_of_shards; ++i) {
+        shards.emplace_back(new Shard);
+        shards.back()->values.reserve(shard_capacity);
+    }
+}
+
+template<class Value>
+std::uint64_t Cache<Value>::key(double x) noexcept
+{
+    std::uint64_t k;
+    std::memcpy(&k,&x,sizeof(k));
+    return k;
+}
+
+template<class Value>
+typename Cache<Value>::Shard& Cache<Value>::shard(std::uint64_t k) noexcept
+{
+    // mix the bits, neighbouring arguments differ mostly in the mantissa
+    k ^= k>>33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k>>33;
+    return *shards[k%shards.size()];
+}
+
+template<class Value>
+template<class Function>
+Value Cache<Value>::operator()(double x, Function f)
+{
+    Value value;
+    if (find(x,value))
+        return value;
+    value = f(x);
+    insert(x,value);
+    return value;
+}
+
+template<class Value>
+bool Cache<Value>::find(double x, Value& value)
+{
+    const std::uint64_t k{key(x)};
+    Shard& s{shard(k)};
+    {
+        std::lock_guard<std::mutex> lock{s.mutex};
+        const auto it{s.values.find(k)};
+        if (it!=s.values.end()) {
+            value = it->second;
+            hits.fetch_add(1,std::memory_order_relaxed);
+            return true;
+        }
+    }
+    misses.fetch_add(1,std::memory_order_relaxed);
+    return false;
+}
+
+template<class Value>
+void Cache<Value>::insert(double x, const Value& value)
+{
+    const std::uint64_t k{key(x)};
+    Shard& s{shard(k)};
+    std::lock_guard<std::mutex> lock{s.mutex};
+    if (s.values.count(k))
+        return;
+    if (s.order.size()<shard_capacity) {
+        s.order.push_back(k);
+    }
+    else {
+        s.values.erase(s.order[s.next]);
+        s.order[s.next] = k;
+        s.next = (s.next+1)%shard_capacity;
+    }
+    s.values.emplace(k,value);
+}
+
+template<class Value>
+void Cache<Value>::clear()
+{
+    for (auto& s: shards) {
+        std::lock_guard<std::mutex> lock{s->mutex};
+        s->values.clear();
+        s->order.clear();
+        s->next = 0;
+    }
+    hits = 0;
+    misses = 0;
+}
+
+template<class Value>
+Statistics Cache<Value>::statistics() const
+{
+    Statistics stat;
+    stat.hits = hits.load(std::memory_order_relaxed);
+    stat.misses = misses.load(std::memory_order_relaxed);
+    stat.capacity = shard_capacity*shards.size();
+    for (const auto& s: shards) {
+        std::lock_guard<std::mutex> lock{s->mutex};
+        stat.entries += s->values.size();
+    }
+    return stat;
+}
+
+/// Combine the statistics of several caches.
+inline Statistics operator+(Statistics a, const Statistics& b)
+{
+    a.hits += b.hits;
+    a.misses += b.misses;
+    a.entries += b.entries;
+    a.capacity += b.capacity;
+    return a;
+}
+
+} // memo
+
+#endif // MEMO_H
@@ -0,0 +1,73 @@
+#ifndef MULTI_INTEGRATION_H
+#define MULTI_INTEGRATION_H
+
+#include "gsl_interface.h"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/// @brief Adaptive integration of several real valued integrands that share
+/// their integration nodes.
+///
+/// Integrands that differ only by cheap factors (e.g. the number of
+/// subtractions or the error band of a dispersion integral) can be evaluated
+/// together: the expensive part is computed once per node and all components
+/// are refined on the same subdivision of the integration interval.
+namespace multi {
+
+/// @brief Evaluate all components of an integrand at `n` points `x` at once.
+
+/// The values are written row-major to `values`, i.e. component `k` at point
+/// `x[i]` is stored in `values[i*dimension+k]`.
+using Function = std::function<void(std::size_t n, const double* x,
+        double* values)>;
+
+/// Values and error estimates of all components of an integral.
+struct Result {
+    std::vector<double> values;
+    std::vector<double> errors;
+    std::size_t evaluations{0};
+        ///< number of points at which the integrand has been evaluated
+    std::size_t intervals{0};
+        ///< number of subintervals of the final subdivision
+};
+
+/// @brief Adaptive 7-15 point Gauss-Kronrod integration of a vector valued
+/// function.
+///
+/// The interval with the largest error (relative to the requested accuracy of
+/// the respective component) is bisected until every component meets
+/// `absolute_precision` or `relative_precision`.
+class Integration {
+public:
+    explicit Integration(std::size_t dimension,
+            const gsl::Settings& set=gsl::Settings{});
+        ///< `dimension` is the number of components of the integrand.
+        ///< `space` limits the number of subintervals.
+
+    Result operator()(const Function& f, double lower, double upper) const;
+        ///< Integrate `f` in the interval [`lower`,`upper`].
+
+        ///< Both `lower` and `upper` are allowed to be infinity. Throws
+        ///< `gsl::Subdivision_error` if the requested accuracy cannot be
+        ///< reached within `space` subintervals.
+
+    void set_absolute(double abs) noexcept {absolute_precision = abs;}
+    void set_relative(double rel) noexcept {relative_precision = rel;}
+    void reserve(std::size_t space) noexcept {limit = space;}
+
+    double absolute() const noexcept {return absolute_precision;}
+    double relative() const noexcept {return relative_precision;}
+    std::size_t size() const noexcept {return limit;}
+    std::size_t dimension() const noexcept {return dim;}
+private:
+    std::size_t dim;
+    double absolute_precision;
+    double relative_precision;
+    std::size_t limit;
+};
+
+} // multi
+
+#endif // MULTI_INTEGRATION_H
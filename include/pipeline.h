@@ -0,0 +1,195 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "combination.h"
+#include "dispersiveintegral.h"
+#include "input.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @brief The chain basis functions -> amplitudes -> splines -> matching ->
+/// `disp::DispersiveIntegral` as a graph of lazily evaluated stages.
+///
+/// Every stage caches its product together with the versions of its inputs
+/// it was computed from. Changing a parameter only bumps the version of that
+/// parameter, the stages depending on it are recomputed when their product
+/// is requested next. E.g. a new matchpoint re-runs the matching only, the
+/// splines of the amplitudes are reused.
+namespace pipeline {
+
+/// Anything a stage can depend on.
+class Node {
+public:
+    virtual std::uint64_t version()=0;
+        ///< Bring the node up to date and return its version, which changes
+        ///< whenever its value may have changed.
+    virtual ~Node() {}
+};
+
+/// Input of the graph set from outside.
+template<class T>
+class Parameter : public Node {
+public:
+    explicit Parameter(T value) : value{std::move(value)} {}
+
+    const T& get() const noexcept {return value;}
+    void set(const T& v)
+        ///< The version changes only if `v` differs from the current value.
+    {
+        if (!(v==value)) {
+            value = v;
+            ++current;
+        }
+    }
+    std::uint64_t version() override {return current;}
+private:
+    T value;
+    std::uint64_t current{1};
+};
+
+/// Cached product of `compute`, recomputed if the version of an input changed.
+template<class T>
+class Stage : public Node {
+public:
+    Stage(std::string name, std::vector<Node*> inputs,
+            std::function<T()> compute)
+        : name_{std::move(name)}, inputs{std::move(inputs)},
+        compute{std::move(compute)} {}
+
+    T& get();
+        ///< Return the product, computing it if necessary.
+    std::uint64_t version() override
+    {
+        get();
+        return current;
+    }
+    void invalidate() noexcept {product.reset();}
+        ///< Force recomputation on the next request.
+
+    const std::string& name() const noexcept {return name_;}
+    std::size_t computations() const noexcept {return count;}
+        ///< Number of times the product has been computed.
+private:
+    std::string name_;
+    std::vector<Node*> inputs;
+    std::function<T()> compute;
+    std::vector<std::uint64_t> seen;
+    std::optional<T> product;
+    std::uint64_t current{0};
+    std::size_t count{0};
+};
+
+template<class T>
+T& Stage<T>::get()
+{
+    std::vector<std::uint64_t> now;
+    now.reserve(inputs.size());
+    for (Node* input: inputs)
+        now.push_back(input->version());
+    if (!product || now!=seen) {
+        product.reset();
+        product.emplace(compute());
+        seen = std::move(now);
+        ++current;
+        ++count;
+    }
+    return *product;
+}
+
+/// Subtraction constants of the amplitudes, the defaults are those used by
+/// `input::gammaKKpi`.
+struct Constants {
+    double a0{0.9};
+    double a12{1.0};
+    double b0{-0.4};
+    double b12{2.7};
+
+    bool operator==(const Constants& o) const noexcept
+    {
+        return a0==o.a0 && a12==o.a12 && b0==o.b0 && b12==o.b12;
+    }
+};
+
+/// Tabulated amplitude on the grid of `comb::Combination::output`.
+struct Amplitude {
+    std::vector<double> s;
+    std::vector<double> real;
+    std::vector<double> imag;
+};
+
+/// @brief The chain leading to `disp::DispersiveIntegral` for the amplitudes
+/// i=1,2 of `disc::Discontinuity`.
+///
+/// Stages and their inputs:
+/// - "basis": basis set (`comb::Combination` with the tables and splines)
+/// - "data": constants, basis set (amplitudes i=1,2 on the grid)
+/// - "spline 1", "spline 2": data (`input::gammaKKpi` continued at a fixed
+///   point)
+/// - "match 1", "match 2": spline, matchpoint (the spline continued at the
+///   matchpoint)
+/// - "integral": matches
+///
+/// For the default constants and basis set the data is read from the files
+/// F1.dat and F2.dat like in `input::gammaKKpi`, otherwise it is computed in
+/// memory with `comb::Combination::f` on `comb::Combination::grid`, like
+/// `comb::Combination::output` does for the files, and no file is written.
+///
+/// Not thread-safe. Copy the returned integral for use in other threads.
+class Pipeline {
+public:
+    Pipeline();
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    void set_constants(const Constants& c) {constants_.set(c);}
+    void set_basis(const std::string& name);
+        ///< Throws std::out_of_range if `name` is not in comb::Registry.
+    void set_matchpoint(double s) {matchpoint_.set(s);}
+
+    const Constants& constants() const noexcept {return constants_.get();}
+    const std::string& basis() const noexcept {return basis_.get();}
+    double matchpoint() const noexcept {return matchpoint_.get();}
+
+    comb::Combination& combination();
+        ///< Product of "basis", its subtraction constants are those of the
+        ///< last computation of "data".
+    const std::array<Amplitude,2>& data();
+    const input::gammaKKpi& amplitude(int i);
+        ///< Product of "match i", i=1,2, i.e. the amplitude continued at the
+        ///< current matchpoint.
+    input::gammaKKpi::Match match(int i);
+        ///< Parameters of the continuation of `amplitude(i)`.
+    disp::DispersiveIntegral& integral(int num_sub, int err);
+        ///< Product of "integral" with num_sub and err set.
+
+    std::map<std::string,std::size_t> computations() const;
+        ///< Number of computations per stage.
+private:
+    Parameter<Constants> constants_{Constants{}};
+    Parameter<std::string> basis_{"standard"};
+    Parameter<double> matchpoint_{1.};
+
+    Stage<std::shared_ptr<comb::Combination>> basis_stage;
+    Stage<std::array<Amplitude,2>> data_stage;
+    std::array<std::unique_ptr<Stage<input::gammaKKpi>>,2> spline_stage;
+    std::array<std::unique_ptr<Stage<input::gammaKKpi>>,2> match_stage;
+    std::unique_ptr<Stage<disp::DispersiveIntegral>> integral_stage;
+
+    std::array<Amplitude,2> compute_data();
+    input::gammaKKpi compute_match(std::size_t k);
+    disp::DispersiveIntegral compute_integral();
+    static std::size_t index(int i);
+};
+
+} // pipeline
+
+#endif // PIPELINE_H
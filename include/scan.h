@@ -0,0 +1,145 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "dispersiveintegral.h"
+#include "pipeline.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief Scans of `disp::DispersiveIntegral` over s-grids, variants
+/// (num_sub, err) and parameter sets, split into shards that run in
+/// separate processes.
+///
+/// The points of a job are ordered by parameter set, then by s. A shard is
+/// a contiguous range of points, such that it prepares few parameter sets.
+/// The partition depends only on the job and the number of shards, hence
+/// every process computes the same shards without coordination. Each shard
+/// writes a binary partial result of its own, `merge` checks that the
+/// partials of a job cover every point exactly once and assembles the
+/// table. Processes on several nodes only need to share the directory of
+/// the partials.
+namespace scan {
+
+using type_aliases::Complex;
+
+/// Subtraction constants and basis set of the amplitudes, see
+/// `pipeline::Pipeline`.
+struct Parameters {
+    pipeline::Constants constants;
+    std::string basis{"standard"};
+};
+
+struct Job {
+    std::vector<double> s;
+    std::vector<disp::Variant> variants;
+    std::vector<Parameters> parameters;
+    double setup_cost{500.};
+        ///< Cost of preparing the integral of a parameter set relative to
+        ///< one point below threshold, used by `partition` only.
+
+    std::size_t size() const noexcept {return s.size()*parameters.size();}
+        ///< Number of points, point k is s[k%s.size()] of
+        ///< parameters[k/s.size()].
+    std::uint64_t fingerprint() const;
+        ///< Checksum of s, variants and parameters, i.e. of everything
+        ///< determining the results.
+
+    static Job read(const std::string& path);
+        ///< @brief Read a job description, one entry per line:
+        ///<
+        ///<     grid <lower> <upper> <step>     s = lower+k*step <= upper
+        ///<     points <s> <s> ...
+        ///<     variant <num_sub> <err>
+        ///<     parameters <a0> <a12> <b0> <b12> [basis]
+        ///<     setup_cost <cost>
+        ///<
+        ///< `#` starts a comment. Without variant or parameters lines the
+        ///< variant (1,0) and the default parameters are used. Throws
+        ///< std::runtime_error for unknown or malformed lines and for a basis
+        ///< set not in comb::Registry.
+};
+
+/// Points [begin,end) of a job, shard `index` of `count`.
+struct Shard {
+    std::size_t index;
+    std::size_t count;
+    std::size_t begin;
+    std::size_t end;
+};
+
+double cost(const Job& job, std::size_t begin, std::size_t end);
+    ///< Estimated cost of points [begin,end): one per point below threshold,
+    ///< two above, where the Cauchy integrand is subtracted, and
+    ///< Job::setup_cost per parameter set touched.
+std::vector<Shard> partition(const Job& job, std::size_t count);
+    ///< Split the job into `count` contiguous shards of about equal cost.
+    ///< Every shard contains at least one point, throws
+    ///< std::invalid_argument if there are fewer points than shards.
+
+/// Values of the points of one shard, Job::variants.size() per point.
+struct Partial {
+    std::uint64_t fingerprint;
+    Shard shard;
+    std::vector<Complex> values;
+};
+
+std::string partial_path(const std::string& directory, const Shard& shard);
+    ///< File of the partial result of `shard` in `directory`.
+Partial run_shard(const Job& job, const Shard& shard,
+        const std::string& checkpoint={});
+    ///< Compute the points of `shard` using `DispersiveIntegral::evaluate`,
+    ///< i.e. all variants on shared nodes. If `checkpoint` is given, the
+    ///< completed points are saved there periodically, see
+    ///< `checkpoint::Progress`, and a rerun continues after them.
+void complete_shard(const Job& job, const std::string& directory,
+        const Shard& shard);
+    ///< `run_shard` with a checkpoint next to the partial, `write_partial`,
+    ///< then remove the checkpoint.
+void write_partial(const std::string& path, const Partial& partial);
+    ///< Written atomically, see `snapshot::write_file`.
+Partial read_partial(const std::string& path);
+    ///< Throws snapshot::Error if the file is missing or corrupt.
+bool has_partial(const Job& job, const std::string& directory,
+        const Shard& shard);
+    ///< True if a valid partial of `shard` of this job exists.
+
+/// Merged result of a job, Job::variants.size() values per point.
+struct Table {
+    Job job;
+    std::vector<Complex> values;
+
+    void write(const std::string& path) const;
+        ///< @brief Write one line per point: index of the parameter set, s
+        ///< and real and imaginary part of every variant.
+        ///<
+        ///< Written with `checkpoint::commit`, i.e. the file only exists if
+        ///< it is complete and ends in a marker with the job fingerprint.
+};
+
+Table merge(const Job& job, const std::string& directory, std::size_t count);
+    ///< Read the partials of the `count` shards of `job`. Throws
+    ///< std::runtime_error if a partial is missing, belongs to another job
+    ///< or does not match the partition, such that points would be missing
+    ///< or duplicated.
+
+struct Options {
+    std::size_t shards{1};
+    std::size_t workers{1};     ///< Concurrent worker processes.
+    std::string directory{"."}; ///< Directory of the partials.
+};
+
+std::vector<std::size_t> run_local(const Job& job, const Options& options);
+    ///< @brief Compute all shards without a valid partial, every shard in a
+    ///< worker process of its own, at most Options::workers at a time.
+    ///< Shards interrupted before continue from their checkpoints, see
+    ///< `complete_shard`.
+    ///<
+    ///< A failing shard does not affect the others. Returns the indices of
+    ///< the shards that failed, they can be rerun alone.
+
+} // scan
+
+#endif // SCAN_H
@@ -0,0 +1,118 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "dispersiveintegral.h"
+#include "server_protocol.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// @brief Evaluation daemon: keeps `DispersiveIntegral` instances warm and
+/// answers batched requests over a Unix domain socket.
+namespace server {
+
+/// @brief Pool of warm `DispersiveIntegral` instances per (num_sub, err).
+
+/// The first instance of a key is constructed from the input files, further
+/// instances (one per concurrent request) are copies of it. Instances are
+/// not thread-safe, hence every request leases one exclusively.
+class Instances {
+public:
+    using Key = std::pair<int,int>; ///< (num_sub, err)
+
+    class Lease {
+    public:
+        Lease(Instances& pool, Key key,
+                std::unique_ptr<disp::DispersiveIntegral> instance)
+            : pool{&pool}, key{key}, instance{std::move(instance)} {}
+        Lease(Lease&&) = default;
+        Lease& operator=(Lease&&) = delete;
+            ///< Deleted, the default would destroy the held instance instead
+            ///< of returning it to the pool.
+        ~Lease();
+
+        disp::DispersiveIntegral& operator*() const {return *instance;}
+        disp::DispersiveIntegral* operator->() const {return instance.get();}
+    private:
+        Instances* pool;
+        Key key;
+        std::unique_ptr<disp::DispersiveIntegral> instance;
+    };
+
+    Lease acquire(int num_sub, int err);
+        ///< Lease an instance, construct it if none is free.
+        ///< Throws std::invalid_argument for unsupported num_sub or err.
+    void preload(int num_sub, int err);
+        ///< Construct the first instance of (num_sub, err) now.
+    std::size_t size() const;
+        ///< Number of instances constructed so far.
+private:
+    struct Entry {
+        std::unique_ptr<disp::DispersiveIntegral> prototype;
+        std::vector<std::unique_ptr<disp::DispersiveIntegral>> idle;
+        std::once_flag loaded;
+    };
+
+    Entry& entry(const Key& key);
+
+    mutable std::mutex mutex;
+    std::map<Key,Entry> entries;
+    std::size_t constructed{0};
+};
+
+struct Options {
+    std::string path;        ///< path of the socket
+    std::size_t workers{0};  ///< number of worker threads, 0: hardware threads
+    std::vector<Instances::Key> preload; ///< instances loaded at start
+};
+
+/// @brief Listen on a Unix domain socket and answer requests, see
+/// server_protocol.h.
+
+/// One thread waits for new connections and for requests on idle
+/// connections and hands connections with a pending request to a pool of
+/// workers. A worker answers one request and returns the connection to the
+/// idle set, such that many clients can share few workers.
+class Server {
+public:
+    explicit Server(Options options);
+        ///< Bind the socket, replacing a stale one, and preload instances.
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+    ~Server();
+
+    void run();
+        ///< Serve requests until stop() is called.
+    void stop() noexcept;
+        ///< Make run() return. Async-signal-safe.
+
+    Instances& instances() noexcept {return pool;}
+private:
+    Options options;
+    Instances pool;
+    int listener{-1};
+    int wake[2]{-1,-1}; // self-pipe to interrupt poll()
+    std::atomic<bool> stop_requested{false};
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<int> pending;  // connections with a pending request
+    std::vector<int> idle;    // connections returned by the workers
+    bool stopping{false};
+
+    void work();
+    bool answer(int fd);
+    void release(int fd);
+};
+
+} // server
+
+#endif // SERVER_H
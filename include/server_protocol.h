@@ -0,0 +1,92 @@
+#ifndef SERVER_PROTOCOL_H
+#define SERVER_PROTOCOL_H
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+/// @brief Binary protocol between `server::Server` and `server::Client`.
+///
+/// Both sides run on the same machine, therefore all numbers are sent in
+/// native byte order. A connection carries any number of request/response
+/// pairs. A request is a `Request` header followed by `n` doubles (the
+/// values of s). A response is a `Response` header, followed by
+/// `message_length` bytes of an error message if `status!=Status::ok`, or
+/// by 2n doubles otherwise: first n real parts, then n imaginary parts for
+/// `Kind::dispersive`, first n values, then n uncertainties for
+/// `Kind::discontinuity`.
+namespace server {
+
+constexpr std::uint32_t magic{0x4e4f414b}; // "KAON"
+constexpr std::uint16_t version{2};
+constexpr std::uint64_t max_points{1u<<24}; ///< maximal n of one request
+
+enum class Kind : std::uint16_t {
+    ping = 0,          ///< no payload, answered with n=0
+    dispersive = 1,    ///< DispersiveIntegral(num_sub,err)(s)
+    discontinuity = 2, ///< Discontinuity(charged)(s) and [s]
+};
+
+enum class Status : std::uint16_t {
+    ok = 0,
+    bad_request = 1,
+    evaluation_error = 2,
+};
+
+struct Request {
+    std::uint32_t magic{server::magic};
+    std::uint16_t version{server::version};
+    Kind kind{Kind::ping};
+    std::int32_t num_sub{1};
+    std::int32_t err{0};
+    std::int32_t charged{0}; ///< Kind::discontinuity only, 0 or 1
+    std::int32_t reserved{0}; ///< keeps n aligned without padding
+    std::uint64_t n{0};
+};
+
+struct Response {
+    std::uint32_t magic{server::magic};
+    std::uint16_t version{server::version};
+    Status status{Status::ok};
+    std::uint64_t n{0};
+    std::uint64_t message_length{0};
+};
+
+inline bool read_all(int fd, void* data, std::size_t size)
+    /// Read exactly `size` bytes, return false on end of file or error.
+{
+    char* p{static_cast<char*>(data)};
+    while (size) {
+        const ssize_t r{::read(fd,p,size)};
+        if (r<0 && errno==EINTR)
+            continue;
+        if (r<=0)
+            return false;
+        p += r;
+        size -= r;
+    }
+    return true;
+}
+
+inline bool write_all(int fd, const void* data, std::size_t size)
+    /// Write exactly `size` bytes, return false on error.
+{
+    const char* p{static_cast<const char*>(data)};
+    while (size) {
+        const ssize_t r{::send(fd,p,size,MSG_NOSIGNAL)};
+        if (r<0 && errno==EINTR)
+            continue;
+        if (r<=0)
+            return false;
+        p += r;
+        size -= r;
+    }
+    return true;
+}
+
+} // server
+
+#endif // SERVER_PROTOCOL_H
@@ -0,0 +1,159 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "dispersiveintegral.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// @brief Binary snapshots of a constructed `disp::DispersiveIntegral`.
+///
+/// A snapshot holds the complete state of both discontinuities (the data of
+/// the amplitudes, the match parameters and thresholds) together with the
+/// size and checksum of every input file it was derived from. Restoring
+/// maps the file into memory and rebuilds the interpolators from the stored
+/// data, without parsing text, `gammaKKpi::spline`, `spline_err` and
+/// `match`, or reading the basis functions.
+///
+/// The format is versioned, native endian and not meant to be exchanged
+/// between machines. Its building blocks (`Writer`, `Reader`, `write_file`,
+/// `open_file`) are shared with other persistent objects, e.g.
+/// `disp::Surrogate`.
+namespace snapshot {
+
+constexpr std::uint32_t version{2};
+
+/// Snapshot missing, corrupt or written by another version.
+struct Error : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+/// An input file changed since the snapshot was written.
+struct Stale_error : Error {
+    using Error::Error;
+};
+
+/// Input file the state was derived from.
+struct Source {
+    std::string path;
+    std::uint64_t size;
+    std::uint64_t checksum;
+};
+
+std::uint64_t checksum(const void* data, std::size_t size,
+        std::uint64_t seed=0xcbf29ce484222325);
+    ///< 64 bit FNV-1a hash of `size` bytes at `data`.
+Source source(const std::string& path);
+    ///< Size and checksum of the file at `path`.
+std::vector<Source> sources();
+    ///< Input files of `disp::DispersiveIntegral`.
+
+void save(const disp::DispersiveIntegral& integral, const std::string& path);
+    ///< Write a snapshot of `integral` to `path`.
+disp::DispersiveIntegral restore(const std::string& path,
+        bool verify_sources=true);
+    ///< Restore the state written by `save`. Throws `Error` if the
+    ///< snapshot is not valid and, if `verify_sources`, `Stale_error` if
+    ///< one of the input files changed.
+disp::DispersiveIntegral load_or_build(const std::string& path, int num_sub,
+        int err);
+    ///< Restore from `path` if possible, otherwise construct
+    ///< `DispersiveIntegral(num_sub,err)` and save a snapshot to `path`.
+
+// -- Building blocks of the format -------------------------------------------
+
+/// Serialize into a buffer, strings are padded such that arrays stay
+/// aligned to 8 bytes.
+class Writer {
+public:
+    void u64(std::uint64_t x) {raw(&x,sizeof(x));}
+    void f64(double x) {raw(&x,sizeof(x));}
+    void string(const std::string& s)
+    {
+        u64(s.size());
+        raw(s.data(),s.size());
+        data.append((8-data.size()%8)%8,'\0');
+    }
+    void array(const std::vector<double>& v)
+    {
+        u64(v.size());
+        raw(v.data(),v.size()*sizeof(double));
+    }
+    void sources(const std::vector<Source>& inputs);
+        ///< Write `inputs`, to be checked by `Reader::sources`.
+    const std::string& buffer() const noexcept {return data;}
+private:
+    std::string data;
+
+    void raw(const void* p, std::size_t n)
+    {
+        data.append(static_cast<const char*>(p),n);
+    }
+};
+
+/// Deserialize data written by `Writer`, throws `Error` if it is truncated.
+class Reader {
+public:
+    Reader(const char* begin, std::size_t size)
+        : begin{begin}, pos{begin}, end{begin+size} {}
+
+    std::uint64_t u64() {return scalar<std::uint64_t>();}
+    double f64() {return scalar<double>();}
+    std::string string();
+    std::vector<double> array();
+    void sources(const std::string& path, bool verify);
+        ///< Read the sources and, if `verify`, throw `Stale_error` if one of
+        ///< the files changed. `path` is used in the message.
+    bool done() const noexcept {return pos==end;}
+private:
+    const char* begin;
+    const char* pos;
+    const char* end;
+
+    void need(std::uint64_t n) const
+    {
+        if (n>static_cast<std::uint64_t>(end-pos))
+            throw Error{"snapshot truncated"};
+    }
+    template<class T>
+    T scalar()
+    {
+        need(sizeof(T));
+        T x;
+        std::memcpy(&x,pos,sizeof(T));
+        pos += sizeof(T);
+        return x;
+    }
+};
+
+/// Read-only memory map of a file.
+class Mapping {
+public:
+    explicit Mapping(const std::string& path);
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+    ~Mapping();
+
+    const char* data() const noexcept {return static_cast<char*>(address);}
+    std::size_t size() const noexcept {return length;}
+private:
+    void* address{nullptr};
+    std::size_t length{0};
+};
+
+void write_file(const std::string& path, const char (&magic)[8],
+        std::uint32_t version, const Writer& payload);
+    ///< Write header and `payload` to `path`, via a temporary file such
+    ///< that readers never see a partially written file.
+Reader open_file(const Mapping& file, const char (&magic)[8],
+        std::uint32_t version, const std::string& path);
+    ///< Check header and checksum of a file written by `write_file` and
+    ///< return a `Reader` of its payload.
+
+} // snapshot
+
+#endif // SNAPSHOT_H
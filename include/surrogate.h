@@ -0,0 +1,94 @@
+#ifndef SURROGATE_H
+#define SURROGATE_H
+
+#include "dispersiveintegral.h"
+#include "type_aliases.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace disp {
+
+/// Options of `Surrogate::build`.
+struct SurrogateOptions {
+    double relative{1e-8};        ///< relative tolerance
+    double absolute{1e-10};       ///< absolute tolerance
+    std::size_t degree{16};       ///< polynomial degree per panel
+    double min_width{1e-7};       ///< panels are not bisected further
+    std::size_t max_panels{4000};
+    std::size_t validation_points{200};
+    std::size_t refinements{3};   ///< rounds of validation and refinement
+    std::size_t threads{0};       ///< 0: number of hardware threads
+};
+
+/// @brief Error-controlled piecewise Chebyshev interpolant of
+/// `DispersiveIntegral::operator()` over a range of s.
+///
+/// The range is split at the threshold sth and the panels are bisected
+/// until the last Chebyshev coefficients of real and imaginary part fall
+/// below the tolerance. The integral is evaluated at the nodes of all open
+/// panels in parallel, on private copies of the `DispersiveIntegral`. The
+/// result is checked against direct evaluations at random held-out points,
+/// and panels failing the check are refined further.
+///
+/// Enable it via `DispersiveIntegral::surrogate` or
+/// `DispersiveIntegral::enable_surrogate`.
+class Surrogate {
+public:
+    using Options = SurrogateOptions;
+
+    /// Result of the comparison with direct evaluations.
+    struct Validation {
+        std::size_t points{0};
+        double max_ratio{0};  ///< max. deviation relative to the tolerance
+        double worst_s{0};    ///< s at which max_ratio occurs
+        bool passed() const noexcept {return max_ratio<=1;}
+    };
+
+    static Surrogate build(const DispersiveIntegral& integral, double lower,
+            double upper, const Options& options=Options{});
+        ///< Build for `integral.num_sub` and `integral.err` on
+        ///< [`lower`,`upper`]. `integral` itself is not modified.
+
+    Complex operator()(double s) const;
+        ///< Throws std::domain_error if s is outside of the range.
+    bool covers(double s) const noexcept
+    {
+        return s>=edges.front() && s<=edges.back();
+    }
+    bool covers(double s, int num_sub, int err) const noexcept
+    {
+        return num_sub==num_sub_ && err==err_ && covers(s);
+    }
+
+    double lower() const noexcept {return edges.front();}
+    double upper() const noexcept {return edges.back();}
+    int num_sub() const noexcept {return num_sub_;}
+    int err() const noexcept {return err_;}
+    std::size_t panels() const noexcept {return edges.size()-1;}
+    bool converged() const noexcept {return converged_;}
+        ///< False if a panel reached min_width or max_panels was hit.
+    const Validation& validation() const noexcept {return validation_;}
+
+    void save(const std::string& path) const;
+        ///< Persist, together with the checksums of the input files, see
+        ///< snapshot::sources.
+    static Surrogate load(const std::string& path, bool verify_sources=true);
+        ///< Throws snapshot::Error if the file is not valid and, if
+        ///< `verify_sources`, snapshot::Stale_error if an input changed.
+private:
+    Surrogate() = default;
+
+    int num_sub_{1};
+    int err_{0};
+    std::size_t degree{0};
+    std::vector<double> edges;         // panel i is [edges[i],edges[i+1]]
+    std::vector<Complex> coefficients; // degree+1 per panel
+    bool converged_{true};
+    Validation validation_;
+};
+
+} // disp
+
+#endif // SURROGATE_H
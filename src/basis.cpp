@@ -0,0 +1,106 @@
+#include "basis.h"
+#include "input.h"
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <complex>
+#include <limits>
+#include <stdexcept>
+
+using namespace comb;
+
+Registry::Registry()
+{
+	sets["standard"] = BasisSet{};
+	BasisSet a2;
+	a2.files[BasisSet::f12_c] = "f12_c_a2.txt";
+	sets["f12_c_a2"] = a2;
+}
+
+Registry& Registry::instance()
+{
+	static Registry registry;
+	return registry;
+}
+
+void Registry::add(const std::string& name, const BasisSet& set)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	sets[name] = set;
+}
+
+BasisSet Registry::set(const std::string& name) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	const auto it = sets.find(name);
+	if(it == sets.end()){
+		throw std::out_of_range("no basis set " + name);
+	}
+	return it->second;
+}
+
+std::vector<std::string> Registry::names() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<std::string> result;
+	for(const auto& entry: sets){
+		result.push_back(entry.first);
+	}
+	return result;
+}
+
+std::shared_ptr<const Table> Registry::table(const std::string& file)
+{
+	return table(file, -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity());
+}
+
+std::shared_ptr<const Table> Registry::table(const std::string& file, double lower, double upper)
+{
+	// reading under the lock is fine, each range is read once per process
+	std::lock_guard<std::mutex> lock(mutex);
+	auto& entry = cache[file];
+	if(entry && entry->lower <= lower && entry->upper >= upper){
+		return entry;
+	}
+	if(entry){
+		lower = std::min(lower, entry->lower);
+		upper = std::max(upper, entry->upper);
+	}
+
+	INSTR_SCOPE("comb::Registry::table");
+	const auto columns = input::read_table(file, 3, lower, upper, margin);
+	auto table = std::make_shared<Table>();
+	table->s = columns[0];
+	table->real.resize(table->s.size());
+	table->imag.resize(table->s.size());
+	std::size_t before = 0, after = 0;
+	for(std::size_t k=0; k<table->s.size(); k++){
+		const std::complex<double> value = columns[1][k]*std::exp(std::complex<double>(0, columns[2][k]));
+		table->real[k] = value.real();
+		table->imag[k] = value.imag();
+		before += table->s[k] < lower;
+		after += table->s[k] > upper;
+	}
+	// fewer rows than the margin beyond the range: the file ends there
+	table->file = file;
+	table->lower = before < margin ? -std::numeric_limits<double>::infinity() : lower;
+	table->upper = after < margin ? std::numeric_limits<double>::infinity() : upper;
+	entry = std::move(table);
+	return entry;
+}
+
+std::array<std::shared_ptr<const Table>,8> Registry::tables(const std::string& name)
+{
+	const BasisSet basis = set(name);
+	std::array<std::shared_ptr<const Table>,8> result;
+	for(std::size_t k=0; k<result.size(); k++){
+		result[k] = table(basis.path(k));
+	}
+	return result;
+}
+
+std::size_t Registry::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return cache.size();
+}
@@ -35,47 +35,41 @@ std::vector<double> imag(const std::vector<Complex>& vec)
 
 // -- Integration -------------------------------------------------------------
 
+ComplexResult c_integrate_result(const Curve& c, double lower, double upper,
+        const gsl::Integration& integrate)
+{
+    return c_integrate_result<Curve,gsl::Integration>(c,lower,upper,
+            integrate);
+}
+
 std::tuple<Complex,double,double> c_integrate(const Curve& c,
         double lower, double upper, const gsl::Integration& integrate)
 {
-    gsl::Value real_part{
-            integrate(facilities::compose(real_specified,c),lower,upper)};
-    gsl::Value imaginary_part{
-            integrate(facilities::compose(imag_specified,c),lower,upper)};
-    Complex result{real_part.first,imaginary_part.first};
-    return std::make_tuple(result,real_part.second,imaginary_part.second);
+    return c_integrate<Curve,gsl::Integration>(c,lower,upper,integrate);
 }
 
 std::tuple<Complex,double,double> c_integrate(const Complex_function& f,
         const Curve& c, const Curve& c_derivative, double lower, double upper,
         const gsl::Integration& integrate)
 {
-    return c_integrate(
-            [&](double x)
-            {
-                return f(c(x))*c_derivative(x);
-            },
-            lower,upper,integrate);
+    return c_integrate<Complex_function,Curve,Curve,gsl::Integration>(f,c,
+            c_derivative,lower,upper,integrate);
+}
+
+Complex complex_integration(const Curve& f, double lower, double upper,
+        bool adaptive, const std::size_t integration_nodes)
+{
+    return complex_integration<Curve>(f,lower,upper,adaptive,
+            integration_nodes);
 }
 
-    
-Complex complex_integration(const Curve& f, double lower, double upper, bool adaptive, const std::size_t integration_nodes){
-    if (adaptive==false) {
-        const std::size_t size{integration_nodes};
-        gsl::GaussLegendre g{size};
-        Complex value{0.+0.i};
-        for (std::size_t i=0; i<size; ++i) {
-            auto point{g.point(lower,upper,i)};
-            value=value+point.second*f(point.first);
-        }
-        return value;
-    }
-    const auto integrate{gsl::Cquad{}};
-    const auto result{c_integrate(f, lower, upper, integrate)};
-    const auto value{std::get<0>(result)};
-    return value;
+ComplexResult complex_integration_result(const Curve& f, double lower,
+        double upper, bool adaptive, const std::size_t integration_nodes)
+{
+    return complex_integration_result<Curve>(f,lower,upper,adaptive,
+            integration_nodes);
 }
-    
+
 // -- Interpolation -----------------------------------------------------------
 
 Interpolate::Interpolate(const Interval& x,
@@ -92,17 +86,13 @@ Complex Interpolate::operator()(double x) const
 Interpolate sample(const Complex_function& f, const Curve& c,
         const Interval& i, gsl::InterpolationMethod m)
 {
-    std::vector<Complex> y_values(i.size());
-    std::transform(i.cbegin(),i.cend(),y_values.begin(),
-            facilities::compose(f,c));
-
-    return Interpolate{i,y_values,m};
+    return sample<Complex_function,Curve>(f,c,i,m);
 }
 
 Interpolate sample(const Curve& c, const Interval& i,
         gsl::InterpolationMethod m)
 {
-    return sample(facilities::identity<Complex>,c,i,m);
+    return sample<Curve>(c,i,m);
 }
 
 // -- Differentiation  --------------------------------------------------------
@@ -110,11 +100,7 @@ Interpolate sample(const Curve& c, const Interval& i,
 Complex derivative(const Curve& c, double value, double step_size,
         gsl::DerivativeMethod method)
 {
-    const auto real{gsl::derivative([&c](double x){return c(x).real();},
-                                      value, step_size, method)};
-    const auto imag{gsl::derivative([&c](double x){return c(x).imag();},
-                                      value, step_size, method)};
-    return Complex{std::get<0>(real), std::get<0>(imag)};
+    return derivative<Curve>(c,value,step_size,method);
 }
 
 } // cauchy
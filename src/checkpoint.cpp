@@ -0,0 +1,111 @@
+#include "checkpoint.h"
+#include "snapshot.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace checkpoint {
+
+namespace {
+constexpr char magic[8]{'K','A','O','N','P','R','O','G'};
+constexpr std::uint32_t version{1};
+constexpr char marker[]{"# complete rows="};
+} // anonymous namespace
+
+Progress::Progress(std::string path, std::uint64_t fingerprint,
+        std::size_t width, double interval)
+    : path{std::move(path)}, fingerprint{fingerprint}, width{width},
+    interval{interval}, last{std::chrono::steady_clock::now()}
+{
+    if (!width)
+        throw std::invalid_argument{"checkpoint needs at least one value \
+per point"};
+    try {
+        const snapshot::Mapping file{this->path};
+        snapshot::Reader in{snapshot::open_file(file,magic,version,
+                this->path)};
+        if (in.u64()!=fingerprint || in.u64()!=width)
+            return;
+        auto values{in.array()};
+        if (!in.done() || values.size()%width)
+            return;
+        values_ = std::move(values);
+        restored_ = done();
+    }
+    catch (const snapshot::Error&) {
+        // missing or corrupt, start from the beginning
+    }
+}
+
+void Progress::add(const double* point)
+{
+    values_.insert(values_.end(),point,point+width);
+    const auto now{std::chrono::steady_clock::now()};
+    if (now-last>=interval)
+        save();
+}
+
+void Progress::save()
+{
+    snapshot::Writer out;
+    out.u64(fingerprint);
+    out.u64(width);
+    out.array(values_);
+    snapshot::write_file(path,magic,version,out);
+    last = std::chrono::steady_clock::now();
+}
+
+void Progress::finish()
+{
+    std::remove(path.c_str());
+}
+
+void commit(const std::string& path, const std::string& content,
+        std::size_t rows, std::uint64_t fingerprint)
+{
+    const std::string temporary{path+".tmp"};
+    {
+        std::ofstream out{temporary,std::ios::binary|std::ios::trunc};
+        if (!out)
+            throw std::runtime_error{"could not open "+temporary};
+        out<<content<<marker<<rows<<" fingerprint="<<std::hex<<fingerprint
+            <<'\n';
+        if (!out.flush())
+            throw std::runtime_error{"could not write "+temporary};
+    }
+    if (std::rename(temporary.c_str(),path.c_str()))
+        throw std::runtime_error{"could not rename "+temporary+" to "+path};
+}
+
+Completion completion(const std::string& path)
+{
+    std::ifstream in{path,std::ios::binary|std::ios::ate};
+    if (!in)
+        throw std::runtime_error{"could not open "+path};
+    // the marker is the last line, much shorter than this
+    const std::streamoff size{in.tellg()};
+    const std::streamoff tail{size<256 ? size : 256};
+    std::string end(static_cast<std::size_t>(tail),'\0');
+    in.seekg(size-tail);
+    in.read(&end[0],tail);
+
+    Completion result;
+    if (end.empty() || end.back()!='\n')
+        return result;
+    end.pop_back();
+    const std::size_t begin{end.rfind('\n')};
+    std::istringstream line{end.substr(begin==std::string::npos ? 0
+            : begin+1)};
+    std::string prefix(sizeof(marker)-1,'\0');
+    std::string key;
+    line.read(&prefix[0],prefix.size());
+    if (prefix!=marker || !(line>>result.rows) || !std::getline(line,key,'=')
+            || key!=" fingerprint" || !(line>>std::hex>>result.fingerprint))
+        return Completion{};
+    result.complete = true;
+    return result;
+}
+
+} // checkpoint
@@ -0,0 +1,134 @@
+#include "client.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace server {
+
+Client::Client(const std::string& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size()>=sizeof(address.sun_path))
+        throw std::invalid_argument{"invalid socket path "+path};
+    std::strcpy(address.sun_path,path.c_str());
+
+    fd = ::socket(AF_UNIX,SOCK_STREAM|SOCK_CLOEXEC,0);
+    if (fd<0)
+        throw std::system_error{errno,std::generic_category(),"socket"};
+    if (::connect(fd,reinterpret_cast<sockaddr*>(&address),
+                sizeof(address))<0) {
+        const int error{errno};
+        ::close(fd);
+        throw std::system_error{error,std::generic_category(),
+            "connect "+path};
+    }
+}
+
+Client::Client(Client&& other) noexcept
+    : fd{other.fd}
+{
+    other.fd = -1;
+}
+
+Client& Client::operator=(Client&& other) noexcept
+{
+    if (this!=&other) {
+        if (fd>=0)
+            ::close(fd);
+        fd = other.fd;
+        other.fd = -1;
+    }
+    return *this;
+}
+
+Client::~Client()
+{
+    if (fd>=0)
+        ::close(fd);
+}
+
+void Client::request(Request header, const double* s, std::size_t n,
+        double* first, double* second)
+{
+    if (fd<0)
+        throw std::logic_error{"server::Client is not connected"};
+    if (n>max_points)
+        throw std::invalid_argument{"too many points for one request"};
+
+    header.n = n;
+    if (!write_all(fd,&header,sizeof(header))
+            || !write_all(fd,s,n*sizeof(double)))
+        throw std::system_error{errno,std::generic_category(),
+            "sending request"};
+
+    Response response;
+    if (!read_all(fd,&response,sizeof(response))
+            || response.magic!=magic || response.version!=version)
+        throw std::runtime_error{"server::Client: no valid response"};
+    if (response.status!=Status::ok) {
+        std::string message(response.message_length,'\0');
+        read_all(fd,&message[0],message.size());
+        throw std::runtime_error{"server: "+message};
+    }
+    if (response.n!=(header.kind==Kind::ping ? 0 : n))
+        throw std::runtime_error{"server: unexpected size of response"};
+    if (!read_all(fd,first,n*sizeof(double))
+            || !read_all(fd,second,n*sizeof(double)))
+        throw std::runtime_error{"server::Client: incomplete response"};
+}
+
+void Client::ping()
+{
+    request(Request{},nullptr,0,nullptr,nullptr);
+}
+
+void Client::dispersive(int num_sub, int err, const double* s,
+        std::size_t n, double* real, double* imag)
+{
+    Request header;
+    header.kind = Kind::dispersive;
+    header.num_sub = num_sub;
+    header.err = err;
+    request(header,s,n,real,imag);
+}
+
+std::vector<Complex> Client::dispersive(int num_sub, int err,
+        const std::vector<double>& s)
+{
+    std::vector<double> real(s.size());
+    std::vector<double> imag(s.size());
+    dispersive(num_sub,err,s.data(),s.size(),real.data(),imag.data());
+    std::vector<Complex> result(s.size());
+    for (std::size_t k=0; k<s.size(); ++k)
+        result[k] = Complex{real[k],imag[k]};
+    return result;
+}
+
+void Client::discontinuity(bool charged, const double* s, std::size_t n,
+        double* values, double* errors)
+{
+    Request header;
+    header.kind = Kind::discontinuity;
+    header.charged = charged;
+    request(header,s,n,values,errors);
+}
+
+std::pair<std::vector<double>,std::vector<double>> Client::discontinuity(
+        bool charged, const std::vector<double>& s)
+{
+    std::pair<std::vector<double>,std::vector<double>> result;
+    result.first.resize(s.size());
+    result.second.resize(s.size());
+    discontinuity(charged,s.data(),s.size(),result.first.data(),
+            result.second.data());
+    return result;
+}
+
+} // server
@@ -1,143 +1,464 @@
 #include "combination.h"
+#include "checkpoint.h"
+#include "instrumentation.h"
+#include "kinematics.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
 
 using namespace comb;
 
-Combination::Combination(double a0, double a12, double b0, double b12, double smax, double step_size)
+Combination::Combination(double a0, double a12, double b0, double b12, double smax, double step_size, bool load_basis)
 :
 a0{a0},
 a12{a12},
 b0{b0},
 b12{b12},
 smax{smax},
-step_size{step_size}
-{readin(); spline();}
+step_size{step_size},
+s_upper{smax}
+{if(load_basis){load();}}
+
+void Combination::load()
+{
+	if(loaded)
+	{
+		return;
+	}
+	readin();
+	spline();
+	loaded = true;
+}
 
 double Combination::kaellen(double a, double b, double c)
 {
-	return std::pow(a,2)+std::pow(b,2)+std::pow(c,2)-2.*(a*b+b*c+a*c);
+	return kin::kaellen(a,b,c);
+}
+
+double Combination::kaellen_product(double s)
+{
+	return kin::kaellen_product(s);
 }
 
 double Combination::t(double s, double z)
-{ 
-	double delta = std::pow(constants::mass_kaon(),2)*(std::pow(constants::mass_kaon(),2)-std::pow(constants::mass_pi(),2));
-	double lambda = std::sqrt(kaellen(s,0,std::pow(constants::mass_kaon(),2)))*std::sqrt(kaellen(s,std::pow(constants::mass_pi(),2),std::pow(constants::mass_kaon(),2)));
-	return 1./2*(3*s0-s+(lambda*z-delta)/s);
+{
+	return kin::t(s,z);
 }
 
 double Combination::u(double s, double z)
 {
-	return 3*s0 - s - t(s,z);
+	return kin::u(s,t(s,z));
 }
 
 void Combination::readin()
 {
-	std::string directory = "../../gammaKKpi_amp/basisfunctions/";
-	std::vector<std::string> v = {"f0_a.txt", "f0_b.txt", "f0_c.txt", "f12_a.txt", "f12_b.txt", "f12_c.txt", "G0.txt", "Gp.txt"};
+	INSTR_SCOPE("comb::Combination::readin");
+	const BasisSet set = Registry::instance().set(basis_set);
+	for(std::size_t k=0; k<tables.size(); k++){
+		const std::pair<double,double> needed = range(k);
+		tables[k] = Registry::instance().table(set.path(k), needed.first, needed.second);
+	}
+}
 
-	array_s.resize(8);
-	array_real.resize(8);
-	array_imag.resize(8);
+void Combination::spline()
+{
+	INSTR_SCOPE("comb::Combination::spline");
+	for(std::size_t k=0; k<tables.size(); k++){
+		if(tables[k]){
+			spline(k);
+		}
+	}
+}
 
-    int i = 0;
-    for(auto &file: v){
-    	std::ifstream myfile(directory + file);
-    	double s, abs, arg;
-	    while (myfile >> s >> abs >> arg) {
-	    	Complex comp = abs*std::exp(I*arg);
-	        array_s[i].push_back(s);
-		    array_real[i].push_back(std::real(comp));
-		    array_imag[i].push_back(std::imag(comp));
-	    }
-	    i+=1;
-    }
-    return;
+std::pair<double,double> Combination::range(std::size_t k) const
+{
+	if(!(s_lower > -std::numeric_limits<double>::infinity() && s_upper < std::numeric_limits<double>::infinity())){
+		return {-std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+	}
+	const kin::Reach reach = kin::reach(s_lower, s_upper);
+	if(k == BasisSet::G0 || k == BasisSet::Gp){
+		return {reach.t_lower, reach.t_upper};
+	}
+	// F^(0) and F^(1/2) at s and u
+	return {std::min(s_lower, reach.u_lower), std::max(s_upper, reach.u_upper)};
 }
 
-void Combination::spline()
+void Combination::set_range(double lower, double upper)
+{
+	if(!(kin::sth <= lower && lower <= upper)){
+		throw std::domain_error("range of s needs sth <= lower <= upper.");
+	}
+	s_lower = lower;
+	s_upper = upper;
+	// the tables cover the range of s they are read for, hence reread the loaded ones
+	for(std::size_t k=0; k<tables.size(); k++){
+		if(tables[k]){
+			tables[k].reset();
+			require(k, range(k).first);
+		}
+	}
+}
+
+void Combination::extend(std::size_t k, double x)
+{
+	INSTR_SCOPE("comb::Combination::extend");
+	std::pair<double,double> needed = range(k);
+	if(tables[k]){
+		needed.first = std::min(needed.first, tables[k]->lower);
+		needed.second = std::max(needed.second, tables[k]->upper);
+	}
+	const double width = needed.second - needed.first;
+	if(x < needed.first){
+		needed.first = x - 0.5*width;
+	}
+	else if(x > needed.second){
+		needed.second = x + 0.5*width;
+	}
+	tables[k] = Registry::instance().table(Registry::instance().set(basis_set).path(k), needed.first, needed.second);
+	spline(k);
+}
+
+void Combination::spline(std::size_t k)
+{
+	const std::array<gsl::Interpolate*,8> real{&F0_a_real, &F0_b_real, &F0_c_real, &F12_a_real, &F12_b_real, &F12_c_real, &G0_real, &Gp_real};
+	const std::array<gsl::Interpolate*,8> imag{&F0_a_imag, &F0_b_imag, &F0_c_imag, &F12_a_imag, &F12_b_imag, &F12_c_imag, &G0_imag, &Gp_imag};
+	// the tables are immutable and shared, the interpolators keep them alive
+	const std::shared_ptr<const Table>& table = tables[k];
+	const std::shared_ptr<const gsl::Interval> s(table, &table->s);
+	*real.at(k) = gsl::Interpolate(s, std::shared_ptr<const std::vector<double>>(table, &table->real), gsl::InterpolationMethod::cubic, true, precision);
+	*imag.at(k) = gsl::Interpolate(s, std::shared_ptr<const std::vector<double>>(table, &table->imag), gsl::InterpolationMethod::cubic, true, precision);
+}
+
+void Combination::use_precision(gsl::Precision precision)
+{
+	if(precision == this->precision){
+		return;
+	}
+	this->precision = precision;
+	if(loaded){
+		spline();
+	}
+}
+
+double Combination::error_bound() const
+{
+	double bound = 0;
+	for(const gsl::Interpolate* f: {&F0_a_real, &F0_b_real, &F0_c_real, &F12_a_real, &F12_b_real, &F12_c_real, &Gp_real, &G0_real,
+			&F0_a_imag, &F0_b_imag, &F0_c_imag, &F12_a_imag, &F12_b_imag, &F12_c_imag, &Gp_imag, &G0_imag}){
+		bound = std::max(bound, f->error_bound());
+	}
+	return bound;
+}
+
+void Combination::use_basis(const std::string& name)
 {
-	F0_a_real = gsl::Interpolate(array_s[0],array_real[0],gsl::InterpolationMethod::cubic);
-	F0_b_real = gsl::Interpolate(array_s[1],array_real[1],gsl::InterpolationMethod::cubic);
-	F0_c_real = gsl::Interpolate(array_s[2],array_real[2],gsl::InterpolationMethod::cubic);
-	F12_a_real = gsl::Interpolate(array_s[3],array_real[3],gsl::InterpolationMethod::cubic);
-	F12_b_real = gsl::Interpolate(array_s[4],array_real[4],gsl::InterpolationMethod::cubic);
-	F12_c_real = gsl::Interpolate(array_s[5],array_real[5],gsl::InterpolationMethod::cubic);
-	G0_real = gsl::Interpolate(array_s[6],array_real[6],gsl::InterpolationMethod::cubic);
-	Gp_real = gsl::Interpolate(array_s[7],array_real[7],gsl::InterpolationMethod::cubic);
-	F0_a_imag = gsl::Interpolate(array_s[0],array_imag[0],gsl::InterpolationMethod::cubic);
-	F0_b_imag = gsl::Interpolate(array_s[1],array_imag[1],gsl::InterpolationMethod::cubic);
-	F0_c_imag = gsl::Interpolate(array_s[2],array_imag[2],gsl::InterpolationMethod::cubic);
-	F12_a_imag = gsl::Interpolate(array_s[3],array_imag[3],gsl::InterpolationMethod::cubic);
-	F12_b_imag = gsl::Interpolate(array_s[4],array_imag[4],gsl::InterpolationMethod::cubic);
-	F12_c_imag = gsl::Interpolate(array_s[5],array_imag[5],gsl::InterpolationMethod::cubic);
-	G0_imag = gsl::Interpolate(array_s[6],array_imag[6],gsl::InterpolationMethod::cubic);
-	Gp_imag = gsl::Interpolate(array_s[7],array_imag[7],gsl::InterpolationMethod::cubic);
-	return;
+	INSTR_SCOPE("comb::Combination::use_basis");
+	const BasisSet next = Registry::instance().set(name);
+	basis_set = name;
+	for(std::size_t k=0; k<tables.size(); k++){
+		if(tables[k] && tables[k]->file != next.path(k)){
+			tables[k].reset();
+			if(loaded){
+				require(k, range(k).first);
+			}
+		}
+	}
 }
 
 Complex Combination::F0(double s)
 {
+	require(BasisSet::f0_a, s); require(BasisSet::f0_b, s); require(BasisSet::f0_c, s);
 	return a0*(F0_a_real(s)+I*F0_a_imag(s))+b0*(F0_b_real(s)+I*F0_b_imag(s))+F0_c_real(s)+I*F0_c_imag(s);
 }
 
 Complex Combination::F12(double s)
 {
+	require(BasisSet::f12_a, s); require(BasisSet::f12_b, s); require(BasisSet::f12_c, s);
 	return a12*(F12_a_real(s)+I*F12_a_imag(s))+b12*(F12_b_real(s)+I*F12_b_imag(s))+F12_c_real(s)+I*F12_c_imag(s);
 }
 
 Complex Combination::Gp(double s)
 {
+	require(BasisSet::Gp, s);
 	return Gp_real(s) + I*Gp_imag(s);
 }
 
 Complex Combination::G0(double s)
 {
+	require(BasisSet::G0, s);
 	return G0_real(s) + I*G0_imag(s);
 }
 
+ad::Dual<Complex> Combination::F0(const ad::Dual<double>& s)
+{
+	require(BasisSet::f0_a, s.value); require(BasisSet::f0_b, s.value); require(BasisSet::f0_c, s.value);
+	return a0*ad::complex(F0_a_real(s), F0_a_imag(s))+b0*ad::complex(F0_b_real(s), F0_b_imag(s))+ad::complex(F0_c_real(s), F0_c_imag(s));
+}
+
+ad::Dual<Complex> Combination::F12(const ad::Dual<double>& s)
+{
+	require(BasisSet::f12_a, s.value); require(BasisSet::f12_b, s.value); require(BasisSet::f12_c, s.value);
+	return a12*ad::complex(F12_a_real(s), F12_a_imag(s))+b12*ad::complex(F12_b_real(s), F12_b_imag(s))+ad::complex(F12_c_real(s), F12_c_imag(s));
+}
+
+ad::Dual<Complex> Combination::Gp(const ad::Dual<double>& s)
+{
+	require(BasisSet::Gp, s.value);
+	return ad::complex(Gp_real(s), Gp_imag(s));
+}
+
+ad::Dual<Complex> Combination::G0(const ad::Dual<double>& s)
+{
+	require(BasisSet::G0, s.value);
+	return ad::complex(G0_real(s), G0_imag(s));
+}
+
 Complex Combination::f(int i, double s)
 {
-	Complex F, Fhat;
+	cauchy::ComplexResult report;
+	const Complex value = f(i, s, report);
+	gsl::check(report.real.status);
+	gsl::check(report.imag.status);
+	return value;
+}
+
+Complex Combination::f(int i, double s, cauchy::ComplexResult& report)
+{
+	INSTR_COUNT("comb::Combination::f");
+	const Complex F = Fpart(i, s);
+	report = cauchy::complex_integration_result(Fhat_integrand(i, s), -1, 1);
+	return F + report.value;
+}
+
+Complex Combination::Fpart(int i, double s)
+{
+	if (i == 1){
+		return F12(s) - F0(s);
+	}
+	else if (i == 2){
+		return -std::sqrt(2)*(F12(s) - F0(s));
+	}
+	else if (i == 3){
+		return F12(s) + F0(s);
+	}
+	else if (i == 4){
+		return std::sqrt(2)*(F12(s) + F0(s));
+	}
+	else{
+		throw std::domain_error("Function not defined for i!={1,2,3,4}.");
+	}
+}
+
+cauchy::Curve Combination::Fhat_integrand(int i, double s)
+{
+	const double product = kin::kaellen_product(s);
 	if (i == 1){
-		F = F12(s) - F0(s);
-		auto integrand = [this, s](double z){return 3./4*(1-std::pow(z,2))*(Gp(t(s,z)) - G0(t(s,z)) + F12(u(s,z)) - F0(u(s,z)));};
-		Fhat = cauchy::complex_integration(integrand, -1, 1);
+		return [this, s, product](double z){const double t_z = kin::t(s,z,product); const double u_z = kin::u(s,t_z); return 3./4*(1-std::pow(z,2))*(Gp(t_z) - G0(t_z) + F12(u_z) - F0(u_z));};
 	}
 	else if (i == 2){
-		F = -std::sqrt(2)*(F12(s) - F0(s));
-		auto integrand = [this, s](double z){return 3./4*(1-std::pow(z,2))*std::sqrt(2)*(G0(t(s,z)) + F12(u(s,z)) + F0(u(s,z)));};
-		Fhat = cauchy::complex_integration(integrand, -1, 1);
+		return [this, s, product](double z){const double t_z = kin::t(s,z,product); const double u_z = kin::u(s,t_z); return 3./4*(1-std::pow(z,2))*std::sqrt(2)*(G0(t_z) + F12(u_z) + F0(u_z));};
 	}
 	else if (i == 3){
-		F = F12(s) + F0(s);
-		auto integrand = [this, s](double z){return 3./4*(1-std::pow(z,2))*(Gp(t(s,z)) + G0(t(s,z)) + F12(u(s,z)) + F0(u(s,z)));};
-		Fhat = cauchy::complex_integration(integrand, -1, 1);
+		return [this, s, product](double z){const double t_z = kin::t(s,z,product); const double u_z = kin::u(s,t_z); return 3./4*(1-std::pow(z,2))*(Gp(t_z) + G0(t_z) + F12(u_z) + F0(u_z));};
 	}
 	else if (i == 4){
-		F = std::sqrt(2)*(F12(s) + F0(s));
-		auto integrand = [this, s](double z){return 3./4*(1-std::pow(z,2))*std::sqrt(2)*(G0(t(s,z)) - F12(u(s,z)) + F0(u(s,z)));};
-		Fhat = cauchy::complex_integration(integrand, -1, 1);
+		return [this, s, product](double z){const double t_z = kin::t(s,z,product); const double u_z = kin::u(s,t_z); return 3./4*(1-std::pow(z,2))*std::sqrt(2)*(G0(t_z) - F12(u_z) + F0(u_z));};
 	}
 	else{
 		throw std::domain_error("Function not defined for i!={1,2,3,4}.");
 	}
-	
-	return F + Fhat;
 }
 
-void Combination::output(int i)
+std::array<Complex,4> Combination::f_all(double s)
+{
+	multi::Result report;
+	return f_all(s, report);
+}
+
+std::array<Complex,4> Combination::f_all(double s, multi::Result& report)
+{
+	INSTR_COUNT("comb::Combination::f_all");
+	// t and u of all nodes of a rule are computed at once
+	std::vector<double> t_z, u_z;
+
+	// components: real and imaginary parts of the angular projections for i=1,...,4
+	const multi::Function integrand{[&](std::size_t n, const double* z, double* values){
+		t_z.resize(n);
+		u_z.resize(n);
+		kin::t_u(s, n, z, t_z.data(), u_z.data());
+		for (std::size_t k=0; k<n; k++){
+			const Complex gp = Gp(t_z[k]);
+			const Complex g0 = G0(t_z[k]);
+			const Complex f12 = F12(u_z[k]);
+			const Complex f0 = F0(u_z[k]);
+			const double weight = 3./4*(1-std::pow(z[k],2));
+			const std::array<Complex,4> projection{
+				weight*(gp - g0 + f12 - f0),
+				weight*std::sqrt(2)*(g0 + f12 + f0),
+				weight*(gp + g0 + f12 + f0),
+				weight*std::sqrt(2)*(g0 - f12 + f0)};
+			for (std::size_t i=0; i<4; i++){
+				values[8*k+2*i] = std::real(projection[i]);
+				values[8*k+2*i+1] = std::imag(projection[i]);
+			}
+		}
+	}};
+	report = multi::Integration(8)(integrand, -1, 1);
+
+	const Complex f12 = F12(s);
+	const Complex f0 = F0(s);
+	const std::array<Complex,4> F{
+		f12 - f0,
+		-std::sqrt(2)*(f12 - f0),
+		f12 + f0,
+		std::sqrt(2)*(f12 + f0)};
+
+	std::array<Complex,4> result;
+	for (std::size_t i=0; i<4; i++){
+		result[i] = F[i] + Complex{report.values[2*i], report.values[2*i+1]};
+	}
+	return result;
+}
+
+ad::Dual<Complex> Combination::f(int i, const ad::Dual<double>& s)
+{
+	if (i < 1 || i > 4){
+		throw std::domain_error("Function not defined for i!={1,2,3,4}.");
+	}
+	return f_all(s)[i-1];
+}
+
+std::array<ad::Dual<Complex>,4> Combination::f_all(const ad::Dual<double>& s)
+{
+	multi::Result report;
+	return f_all(s, report);
+}
+
+std::array<ad::Dual<Complex>,4> Combination::f_all(const ad::Dual<double>& s, multi::Result& report)
+{
+	INSTR_COUNT("comb::Combination::f_all");
+	using D = ad::Dual<Complex>;
+	const ad::Dual<double> product = kin::kaellen_product(s);
+
+	// components: real and imaginary parts of the angular projections for i=1,...,4 and of their derivatives
+	const multi::Function integrand{[&](std::size_t n, const double* z, double* values){
+		for (std::size_t k=0; k<n; k++){
+			const ad::Dual<double> t_z = kin::t(s, z[k], product);
+			const ad::Dual<double> u_z = kin::u(s, t_z);
+			const D gp = Gp(t_z);
+			const D g0 = G0(t_z);
+			const D f12 = F12(u_z);
+			const D f0 = F0(u_z);
+			const Complex weight = 3./4*(1-std::pow(z[k],2));
+			const Complex root2 = std::sqrt(2);
+			const std::array<D,4> projection{
+				weight*(gp - g0 + f12 - f0),
+				weight*root2*(g0 + f12 + f0),
+				weight*(gp + g0 + f12 + f0),
+				weight*root2*(g0 - f12 + f0)};
+			for (std::size_t i=0; i<4; i++){
+				values[16*k+4*i] = std::real(projection[i].value);
+				values[16*k+4*i+1] = std::imag(projection[i].value);
+				values[16*k+4*i+2] = std::real(projection[i].derivative);
+				values[16*k+4*i+3] = std::imag(projection[i].derivative);
+			}
+		}
+	}};
+	report = multi::Integration(16)(integrand, -1, 1);
+
+	const D f12 = F12(s);
+	const D f0 = F0(s);
+	const Complex root2 = std::sqrt(2);
+	const std::array<D,4> F{
+		f12 - f0,
+		-root2*(f12 - f0),
+		f12 + f0,
+		root2*(f12 + f0)};
+
+	std::array<D,4> result;
+	for (std::size_t i=0; i<4; i++){
+		result[i] = F[i] + D{Complex{report.values[4*i], report.values[4*i+1]}, Complex{report.values[4*i+2], report.values[4*i+3]}};
+	}
+	return result;
+}
+
+std::vector<double> Combination::grid() const
+{
+	std::vector<double> result;
+	for(double s=kin::sth; s < smax; s+=step_size)
+	{
+		result.push_back(s);
+	}
+	return result;
+}
+
+std::uint64_t Combination::fingerprint(int i, Projection projection) const
+{
+	const double fields[]{a0, a12, b0, b12, smax, step_size, static_cast<double>(precision), static_cast<double>(projection), static_cast<double>(i)};
+	return snapshot::checksum(fields, sizeof(fields), snapshot::checksum(basis_set.data(), basis_set.size()));
+}
+
+namespace {
+// Text of the file of one partial wave, column `column` of width-wide points
+std::string table(const std::vector<double>& s, const std::vector<double>& values, std::size_t width, std::size_t column)
+{
+	std::ostringstream out;
+	for(std::size_t k=0; k<s.size(); k++)
+	{
+		out << s[k] << "\t" << values[k*width+column] << "\t" << values[k*width+column+1] << "\n";
+	}
+	return out.str();
+}
+}
+
+void Combination::output(int i, double interval)
+{
+	INSTR_SCOPE("comb::Combination::output");
+	if(i<1 || i>4){
+		throw std::domain_error("Function not defined for i!={1,2,3,4}.");
+	}
+	// the basis functions are loaded on first use, G^(+) only for i=1,3
+	std::string directory = "../../gammaKKpi_amp/";
+	std::vector<std::string> v {"F1.dat", "F2.dat", "F3.dat", "F4.dat"};
+	const std::string file = directory + v[i-1];
+
+	const std::vector<double> s = grid();
+	checkpoint::Progress progress(file + ".checkpoint", fingerprint(i), 2, interval);
+	for(std::size_t k=progress.done(); k<s.size(); k++)
+	{
+		const Complex value = f(i,s[k]);
+		const double point[]{std::real(value), std::imag(value)};
+		progress.add(point);
+	}
+	checkpoint::commit(file, table(s, progress.values(), 2, 0), s.size(), fingerprint(i));
+	progress.finish();
+}
+
+void Combination::output_all(double interval)
 {
+	INSTR_SCOPE("comb::Combination::output_all");
+	load();
 	std::string directory = "../../gammaKKpi_amp/";
 	std::vector<std::string> v {"F1.dat", "F2.dat", "F3.dat", "F4.dat"};
 
-	std::ofstream myfile(directory + v[i-1]);
-	if (myfile.is_open())
-  	{
-  		for(double s=std::pow(constants::mass_kaon()+constants::mass_pi(),2); s < smax; s+=step_size)
-  		{
-  			myfile << s << "\t" << std::real(f(i,s)) << "\t" << std::imag(f(i,s)) << std::endl;
-  		}	
-	   	myfile.close();
-  	}
-
-	return;
-}
\ No newline at end of file
+	const std::vector<double> s = grid();
+	checkpoint::Progress progress(directory + "F.checkpoint", fingerprint(0, Projection::shared), 8, interval);
+	for(std::size_t k=progress.done(); k<s.size(); k++)
+	{
+		const std::array<Complex,4> values = f_all(s[k]);
+		double point[8];
+		for(std::size_t i=0; i<4; i++)
+		{
+			point[2*i] = std::real(values[i]);
+			point[2*i+1] = std::imag(values[i]);
+		}
+		progress.add(point);
+	}
+	for(std::size_t i=0; i<4; i++)
+	{
+		checkpoint::commit(directory + v[i], table(s, progress.values(), 8, 2*i), s.size(), fingerprint(i+1, Projection::shared));
+	}
+	progress.finish();
+}
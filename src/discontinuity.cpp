@@ -1,21 +1,31 @@
 #include "discontinuity.h"
+#include "instrumentation.h"
+#include "kinematics.h"
 
 using namespace disc;
 
 Discontinuity::Discontinuity(bool charged_kaon_int)
 :
 charged_kaon_int{charged_kaon_int},
-sth{std::pow(constants::mass_pi()+constants::mass_kaon(),2.)},
+sth{kin::sth},
 absgammaKKpic{input::gammaKKpi(1,false)},
 absgammaKKpin{input::gammaKKpi(2,false)}
 {}
 
+Discontinuity::Discontinuity(bool charged_kaon_int, input::gammaKKpi absgammaKKpic, input::gammaKKpi absgammaKKpin)
+:
+charged_kaon_int{charged_kaon_int},
+sth{kin::sth},
+absgammaKKpic{std::move(absgammaKKpic)},
+absgammaKKpin{std::move(absgammaKKpin)}
+{}
+
 double Discontinuity::lambda(double s, double m1, double m2) 
 {
-	return std::pow(s,2) + std::pow(m1,4) + std::pow(m2,4) - 2. * (s * std::pow(m1,2) + s * std::pow(m2,2) + std::pow(m1*m2,2));
+	return kin::kaellen(s, m1*m1, m2*m2);
 }
 
-double Discontinuity::operator()(double s)
+double Discontinuity::evaluate(double s)
 {
 	if(s<sth)
 	{
@@ -24,20 +34,18 @@ double Discontinuity::operator()(double s)
 	else
 	{
 		if (charged_kaon_int){
-			return 1./(4.*constants::pi()*std::pow(constants::elementary_charge(),2)) * std::pow(lambda(s,constants::mass_pi(), constants::mass_kaon()), 3./2) 
-					 /(72*std::pow(s,2.)) * std::pow(absgammaKKpic(s),2.);
+			return kin::phase_space(s) * std::pow(absgammaKKpic(s),2.);
 			// don't include the i here
 		}
 		else{
-			return 1./(4.*constants::pi()*std::pow(constants::elementary_charge(),2)) * std::pow(lambda(s,constants::mass_pi(), constants::mass_kaon()), 3./2) 
-					 /(72*std::pow(s,2.)) * std::pow(absgammaKKpin(s),2.);
+			return kin::phase_space(s) * std::pow(absgammaKKpin(s),2.);
 			// don't include the i here
 		}
 
 	}
 }
 
-double Discontinuity::operator[](double s)
+double Discontinuity::evaluate_err(double s)
 {
 	if(s<sth)
 	{
@@ -46,15 +54,142 @@ double Discontinuity::operator[](double s)
 	else
 	{
 		if (charged_kaon_int){
-			return 1./(4.*constants::pi()*std::pow(constants::elementary_charge(),2)) * std::pow(lambda(s,constants::mass_pi(), constants::mass_kaon()), 3./2) 
-					 /(72*std::pow(s,2.)) * 2 *  absgammaKKpic(s) * absgammaKKpic[s];
+			return kin::phase_space(s) * 2 *  absgammaKKpic(s) * absgammaKKpic[s];
 			// don't include the i here
 		}
 		else{
-			return 1./(4.*constants::pi()*std::pow(constants::elementary_charge(),2)) * std::pow(lambda(s,constants::mass_pi(), constants::mass_kaon()), 3./2) 
-					 /(72*std::pow(s,2.)) * 2 *  absgammaKKpin(s) * absgammaKKpin[s];
+			return kin::phase_space(s) * 2 *  absgammaKKpin(s) * absgammaKKpin[s];
 			// don't include the i here
 		}
 
 	}
-}
\ No newline at end of file
+}
+
+ad::Dual<double> Discontinuity::evaluate(const ad::Dual<double>& s) const
+{
+	if(s.value<sth)
+	{
+		return 0.;
+	}
+	const input::gammaKKpi& amplitude = charged_kaon_int ? absgammaKKpic : absgammaKKpin;
+	return kin::phase_space(s) * ad::pow(amplitude.evaluate(s),2);
+}
+
+ad::Dual<double> Discontinuity::evaluate_err(const ad::Dual<double>& s) const
+{
+	if(s.value<sth)
+	{
+		return 0.;
+	}
+	const input::gammaKKpi& amplitude = charged_kaon_int ? absgammaKKpic : absgammaKKpin;
+	return kin::phase_space(s) * 2. * amplitude.evaluate(s) * amplitude.evaluate_err(s);
+}
+
+double Discontinuity::operator()(double s)
+{
+	INSTR_COUNT("disc::Discontinuity::operator()");
+	if(value_cache)
+	{
+		return (*value_cache)(s, [this](double x){return evaluate(x);});
+	}
+	return evaluate(s);
+}
+
+double Discontinuity::operator[](double s)
+{
+	INSTR_COUNT("disc::Discontinuity::operator[]");
+	if(error_cache)
+	{
+		return (*error_cache)(s, [this](double x){return evaluate_err(x);});
+	}
+	return evaluate_err(s);
+}
+
+namespace{
+// Takes values[k] from cache if present, otherwise evaluates it as f(k) and stores it
+template<class F>
+void cached(memo::Cache<double>* cache, std::size_t n, const double* s, double* values, const F& f)
+{
+	for(std::size_t k=0; k<n; k++)
+	{
+		if(cache && cache->find(s[k], values[k]))
+		{
+			continue;
+		}
+		values[k] = f(k);
+		if(cache)
+		{
+			cache->insert(s[k], values[k]);
+		}
+	}
+}
+}
+
+void Discontinuity::evaluate_batch(std::size_t n, const double* s, const double* phase_space, double* values)
+{
+	INSTR_ADD("disc::Discontinuity::operator()", n);
+	input::gammaKKpi& amplitude = charged_kaon_int ? absgammaKKpic : absgammaKKpin;
+	cached(value_cache.get(), n, s, values, [&](std::size_t k){
+		return s[k]<sth ? 0. : phase_space[k] * std::pow(amplitude(s[k]),2.);
+	});
+}
+
+void Discontinuity::evaluate_err_batch(std::size_t n, const double* s, const double* phase_space, double* values)
+{
+	INSTR_ADD("disc::Discontinuity::operator[]", n);
+	input::gammaKKpi& amplitude = charged_kaon_int ? absgammaKKpic : absgammaKKpin;
+	cached(error_cache.get(), n, s, values, [&](std::size_t k){
+		return s[k]<sth ? 0. : phase_space[k] * 2 * amplitude(s[k]) * amplitude[s[k]];
+	});
+}
+
+void Discontinuity::enable_cache(std::size_t capacity)
+{
+	value_cache = std::make_shared<memo::Cache<double>>(capacity);
+	error_cache = std::make_shared<memo::Cache<double>>(capacity);
+}
+
+void Discontinuity::disable_cache()
+{
+	value_cache.reset();
+	error_cache.reset();
+}
+
+void Discontinuity::renew_cache()
+{
+	if(value_cache)
+	{
+		value_cache = std::make_shared<memo::Cache<double>>(value_cache->capacity());
+	}
+	if(error_cache)
+	{
+		error_cache = std::make_shared<memo::Cache<double>>(error_cache->capacity());
+	}
+	absgammaKKpic.renew_cache();
+	absgammaKKpin.renew_cache();
+}
+
+memo::Statistics Discontinuity::cache_statistics() const
+{
+	memo::Statistics stat;
+	if(value_cache)
+	{
+		stat = stat + value_cache->statistics();
+	}
+	if(error_cache)
+	{
+		stat = stat + error_cache->statistics();
+	}
+	return stat;
+}
+
+void Discontinuity::compact(gsl::Precision precision)
+{
+	const bool changed = absgammaKKpic.spline_abs.precision() != precision || absgammaKKpin.spline_abs.precision() != precision;
+	absgammaKKpic.compact(precision);
+	absgammaKKpin.compact(precision);
+	if(changed)
+	{
+		renew_cache();
+	}
+}
@@ -1,14 +1,28 @@
 #include "dispersiveintegral.h"
+#include "instrumentation.h"
+#include "kinematics.h"
+#include "surrogate.h"
 
 using namespace disp;
 
 DispersiveIntegral::DispersiveIntegral(int num_sub, int err)
 :
 gammaKKpicdisc{disc::Discontinuity(true)},
-gammaKKpindisc{disc::Discontinuity(false)},
+gammaKKpindisc{disc::Discontinuity(false, gammaKKpicdisc.absgammaKKpic, gammaKKpicdisc.absgammaKKpin)},
 sth{gammaKKpicdisc.sth},
 multiply{1e3},
-subtraction_point{std::pow(constants::mass_kaon(),2)},
+subtraction_point{kin::mass_kaon2},
+num_sub{num_sub},
+err{err}
+{set_cutoff();}
+
+DispersiveIntegral::DispersiveIntegral(int num_sub, int err, disc::Discontinuity gammaKKpicdisc, disc::Discontinuity gammaKKpindisc)
+:
+gammaKKpicdisc{std::move(gammaKKpicdisc)},
+gammaKKpindisc{std::move(gammaKKpindisc)},
+sth{this->gammaKKpicdisc.sth},
+multiply{1e3},
+subtraction_point{kin::mass_kaon2},
 num_sub{num_sub},
 err{err}
 {set_cutoff();}
@@ -40,23 +54,77 @@ double DispersiveIntegral::numerator(double s){
 	}
 }
 
+std::array<double,3> DispersiveIntegral::numerators(double s, bool with_err){
+	const double value = gammaKKpicdisc(s) + gammaKKpindisc(s);
+	if (!with_err){
+		return {value*multiply, 0., 0.};
+	}
+	const double error = gammaKKpicdisc[s] + gammaKKpindisc[s];
+	return {value*multiply, (value - error)*multiply, (value + error)*multiply};
+}
+
+void DispersiveIntegral::numerators(std::size_t n, const double* s, bool with_err, double* values){
+	std::vector<double> buffer((with_err ? 5 : 3)*n);
+	double* phase_space = buffer.data();
+	double* charged = phase_space + n;
+	double* neutral = charged + n;
+	kin::phase_space(n, s, phase_space);
+	gammaKKpicdisc.evaluate_batch(n, s, phase_space, charged);
+	gammaKKpindisc.evaluate_batch(n, s, phase_space, neutral);
+	if (!with_err){
+		for (std::size_t k=0; k<n; k++){
+			values[3*k] = (charged[k] + neutral[k])*multiply;
+			values[3*k+1] = 0.;
+			values[3*k+2] = 0.;
+		}
+		return;
+	}
+	double* charged_err = neutral + n;
+	double* neutral_err = charged_err + n;
+	gammaKKpicdisc.evaluate_err_batch(n, s, phase_space, charged_err);
+	gammaKKpindisc.evaluate_err_batch(n, s, phase_space, neutral_err);
+	for (std::size_t k=0; k<n; k++){
+		const double value = charged[k] + neutral[k];
+		const double error = charged_err[k] + neutral_err[k];
+		values[3*k] = value*multiply;
+		values[3*k+1] = (value - error)*multiply;
+		values[3*k+2] = (value + error)*multiply;
+	}
+}
+
 double DispersiveIntegral::integrand_cauchy(double s, double s_prime){
        return (numerator(s_prime)-numerator(s))/(std::pow(s_prime-subtraction_point,num_sub)*(s_prime-s)); //number of subtractions
 }
 
 double DispersiveIntegral::numeric_integral_cauchy(double s, double lower_limit){
-    double mandelstam_s=s;
+    gsl::Result report;
+    const double result = numeric_integral_cauchy(s, lower_limit, report);
+    gsl::check(report.status);
+    return result;
+}
 
-    const auto integrand{[mandelstam_s,this](double s_prime){
-        return this->integrand_cauchy(mandelstam_s,s_prime); }};
-    
+double DispersiveIntegral::numeric_integral_cauchy(double s, double lower_limit, gsl::Result& report){
     auto integration = gsl::Cquad();
     integration.reserve(10000);
     integration.set_absolute(0.0);
     integration.set_relative(1e-7);
 
-    gsl::Value result_0 = integration(integrand, lower_limit, cutoff);
-    return std::get<0>(result_0);
+    return numeric_integral_cauchy(s, lower_limit, integration, report);
+}
+
+double DispersiveIntegral::numeric_integral_cauchy(double s, double lower_limit, const gsl::Integration& integration, gsl::Result& report){
+    double mandelstam_s=s;
+    const auto integrand{[mandelstam_s,this](double s_prime){
+        return this->integrand_cauchy(mandelstam_s,s_prime); }};
+
+    report = integration.integrate(integrand, lower_limit, cutoff);
+    return report.value;
+}
+
+double DispersiveIntegral::numeric_integral_principal_value(double s, double lower_limit, gsl::Result& report){
+    report = principal_value_integral([this](double s_prime){
+        return numerator(s_prime)/std::pow(s_prime-subtraction_point,num_sub); }, s, lower_limit, cutoff);
+    return report.value;
 }
 
 double DispersiveIntegral::integrand_trivial(double s, double s_prime){
@@ -64,55 +132,346 @@ double DispersiveIntegral::integrand_trivial(double s, double s_prime){
 } 
 
 double DispersiveIntegral::numeric_integral_trivial(double s, double lower_limit){
-    double mandelstam_s=s;
-    const auto integrand{[mandelstam_s,this](double s_prime){
-        return this->integrand_trivial(mandelstam_s,s_prime); }};
+    gsl::Result report;
+    const double result = numeric_integral_trivial(s, lower_limit, report);
+    gsl::check(report.status);
+    return result;
+}
 
+double DispersiveIntegral::numeric_integral_trivial(double s, double lower_limit, gsl::Result& report){
     auto integration = gsl::Cquad();
     integration.reserve(10000);
     integration.set_absolute(0.0);
     integration.set_relative(1e-7);
 
-    gsl::Value result = integration(integrand, lower_limit, cutoff);
-    return std::get<0>(result);
+    return numeric_integral_trivial(s, lower_limit, integration, report);
+}
+
+double DispersiveIntegral::numeric_integral_trivial(double s, double lower_limit, const gsl::Integration& integration, gsl::Result& report){
+    double mandelstam_s=s;
+    const auto integrand{[mandelstam_s,this](double s_prime){
+        return this->integrand_trivial(mandelstam_s,s_prime); }};
+
+    report = integration.integrate(integrand, lower_limit, cutoff);
+    return report.value;
 }
 
 double DispersiveIntegral::integral_analytic(double s, double lower_limit){
+	return numerator(s) * analytic_factor(s, lower_limit, num_sub);
+}
+
+double DispersiveIntegral::analytic_factor(double s, double lower_limit, int num_sub){
+	return disp::analytic_factor(s, lower_limit, subtraction_point, cutoff, num_sub);
+}
+
+namespace {
+template<class T>
+T analytic_factor_impl(const T& s, double lower_limit, double subtraction_point, double cutoff, int num_sub){
+	using std::log;
 	if (subtraction_point > lower_limit){
 		throw std::domain_error("Subtraction_point must be smaller than lower_limit!");
 	}
-	if (num_sub==1){
-		if(cutoff == std::numeric_limits<double>::infinity() ) {
-			return -numerator(s) * std::log((s-lower_limit)/(lower_limit - subtraction_point));
-		}
-		else{
-			return numerator(s) * (std::log((cutoff-s)/(cutoff-subtraction_point)) - std::log((s-lower_limit)/(lower_limit - subtraction_point)) );
-		}
-		
+	if (num_sub < 1){
+		throw std::domain_error("num_sub must be an integer greater or equal to 1.");
 	}
-	else if (num_sub == 2){
-		if (cutoff == std::numeric_limits<double>::infinity()){
-			return numerator(s)* (-(s-subtraction_point)/(lower_limit-subtraction_point) - std::log((s-lower_limit)/(lower_limit - subtraction_point)));
-		}
-		else{
-			throw std::domain_error("2 sutbractions for cutoff != infinty not implemented.");
+	// partial fractions: (s-a)^n/((s'-a)^n (s'-s)) = 1/(s'-s) - sum_{k=1}^n (s-a)^(k-1)/(s'-a)^k
+	const bool finite = cutoff != std::numeric_limits<double>::infinity();
+	T result = -log((s-lower_limit)/(lower_limit - subtraction_point));
+	if (finite){
+		result += log((cutoff-s)/(cutoff-subtraction_point));
+	}
+	T s_power = 1.;
+	for (int k=2; k<=num_sub; k++){
+		s_power *= s-subtraction_point;
+		double term = std::pow(lower_limit-subtraction_point, 1-k);
+		if (finite){
+			term -= std::pow(cutoff-subtraction_point, 1-k);
 		}
+		result -= s_power*term/(k-1);
 	}
-	else{
-		throw std::domain_error("Numer of subtraction not implemented.");
+	return result;
+}
+}
+
+double disp::analytic_factor(double s, double lower_limit, double subtraction_point, double cutoff, int num_sub){
+	return analytic_factor_impl(s, lower_limit, subtraction_point, cutoff, num_sub);
+}
+
+ad::Dual<double> disp::analytic_factor(const ad::Dual<double>& s, double lower_limit, double subtraction_point, double cutoff, int num_sub){
+	return analytic_factor_impl(s, lower_limit, subtraction_point, cutoff, num_sub);
+}
+
+namespace {
+template<ErrMode Mode>
+Complex dispatch(DispersiveIntegral& integral, double s, gsl::Result& report){
+	switch (integral.num_sub){
+		case 1:
+			return integral.kernel<1,Mode>()(s, report);
+		case 2:
+			return integral.kernel<2,Mode>()(s, report);
+		case 3:
+			return integral.kernel<3,Mode>()(s, report);
+		case 4:
+			return integral.kernel<4,Mode>()(s, report);
+		default:
+			return integral.evaluate_runtime(s, report);
 	}
 }
+}
 
 Complex DispersiveIntegral::operator()(double s){
+	if (surrogate && surrogate->covers(s, num_sub, err)){
+		return (*surrogate)(s);
+	}
+	gsl::Result report;
+	const Complex result = (*this)(s, report);
+	gsl::check(report.status);
+	return result;
+}
+
+Complex DispersiveIntegral::operator()(double s, gsl::Result& report){
+	INSTR_SCOPE("disp::DispersiveIntegral::operator()");
+	if (num_sub < 1){
+		throw std::domain_error("num_sub must be an integer greater or equal to 1.");
+	}
+	switch (err){
+		case 0:
+			return dispatch<ErrMode::central>(*this, s, report);
+		case 1:
+			return dispatch<ErrMode::lower>(*this, s, report);
+		case 2:
+			return dispatch<ErrMode::upper>(*this, s, report);
+		default:
+			throw std::domain_error("err must be 0 (without error), 1 (low) or 2 (up).");
+	}
+}
+
+Complex DispersiveIntegral::evaluate_runtime(double s){
+	gsl::Result report;
+	const Complex result = evaluate_runtime(s, report);
+	gsl::check(report.status);
+	return result;
+}
+
+Complex DispersiveIntegral::evaluate_runtime(double s, gsl::Result& report){
 	if (s > cutoff)
 	{
 		throw std::domain_error("s larger than cutoff of integral.");
 	}
 	else if (s < sth){
-		return 1./multiply*(std::pow(s-subtraction_point,num_sub)/(2*constants::pi())*numeric_integral_trivial(s, sth));
+		return 1./multiply*(std::pow(s-subtraction_point,num_sub)/(2*constants::pi())*numeric_integral_trivial(s, sth, report));
+	}
+	else if (principal_value && s > sth && s < cutoff){
+		return 1./multiply*(std::pow(s-subtraction_point,num_sub)/(2*constants::pi())*numeric_integral_principal_value(s, sth, report) + 1.i/2. * numerator(s) ) ;
 	}
 	else{
-		return 1./multiply*(std::pow(s-subtraction_point,num_sub)/(2*constants::pi())*numeric_integral_cauchy(s, sth) + 1./(2*constants::pi()) * integral_analytic(s, sth) + 1.i/2. * numerator(s) ) ;
+		return 1./multiply*(std::pow(s-subtraction_point,num_sub)/(2*constants::pi())*numeric_integral_cauchy(s, sth, report) + 1./(2*constants::pi()) * integral_analytic(s, sth) + 1.i/2. * numerator(s) ) ;
 	}
 
-}
\ No newline at end of file
+}
+
+ad::Dual<double> DispersiveIntegral::numerator(const ad::Dual<double>& s){
+	const ad::Dual<double> value = gammaKKpicdisc.evaluate(s) + gammaKKpindisc.evaluate(s);
+	if (err == 0){
+		return value*multiply;
+	}
+	const ad::Dual<double> error = gammaKKpicdisc.evaluate_err(s) + gammaKKpindisc.evaluate_err(s);
+	if (err == 1){
+		return (value - error)*multiply;
+	}
+	else if (err == 2){
+		return (value + error)*multiply;
+	}
+	else{
+		throw std::domain_error("err must be 0 (without error), 1 (low) or 2 (up).");
+	}
+}
+
+ad::Dual<Complex> DispersiveIntegral::operator()(const ad::Dual<double>& s){
+	multi::Result report;
+	return (*this)(s, report);
+}
+
+ad::Dual<Complex> DispersiveIntegral::operator()(const ad::Dual<double>& s, multi::Result& report){
+	INSTR_SCOPE("disp::DispersiveIntegral::operator()");
+	if (num_sub < 1){
+		throw std::domain_error("num_sub must be an integer greater or equal to 1.");
+	}
+	if (err < 0 || err > 2){
+		throw std::domain_error("err must be 0 (without error), 1 (low) or 2 (up).");
+	}
+	if (s.value > cutoff)
+	{
+		throw std::domain_error("s larger than cutoff of integral.");
+	}
+	// differentiate with respect to s, the chain rule for the variable of s is applied at the end
+	const ad::Dual<double> x = ad::variable(s.value);
+	// below threshold the integral is trivial, i.e. nothing is subtracted
+	const bool trivial = s.value < sth;
+	const ad::Dual<double> numerator_s = trivial ? ad::Dual<double>{0.} : numerator(x);
+
+	// components: the integral and its derivative,
+	// d/ds (N(s')-N(s))/(s'-s) = (N(s')-N(s)-N'(s)(s'-s))/(s'-s)^2
+	std::vector<double> numerator_s_prime;
+	const multi::Function integrand{[&](std::size_t n, const double* s_prime, double* values){
+		numerator_s_prime.resize(3*n);
+		numerators(n, s_prime, err != 0, numerator_s_prime.data());
+		for (std::size_t i=0; i<n; i++){
+			const double denominator = std::pow(s_prime[i]-subtraction_point,num_sub);
+			const double distance = s_prime[i]-s.value;
+			const double difference = numerator_s_prime[3*i+err] - numerator_s.value;
+			values[2*i] = difference/(denominator*distance);
+			values[2*i+1] = (difference - numerator_s.derivative*distance)/(denominator*distance*distance);
+		}
+	}};
+
+	auto integration = multi::Integration(2);
+	integration.reserve(10000);
+	integration.set_absolute(0.0);
+	integration.set_relative(1e-7);
+
+	report = integration(integrand, sth, cutoff);
+
+	const ad::Dual<double> numerical{report.values[0], report.values[1]};
+	ad::Dual<Complex> result = ad::pow(x-subtraction_point,num_sub)/(2*constants::pi())*numerical;
+	if (!trivial){
+		const ad::Dual<double> analytic = numerator_s*disp::analytic_factor(x, sth, subtraction_point, cutoff, num_sub)/(2*constants::pi());
+		result += ad::Dual<Complex>(analytic) + 0.5i*ad::Dual<Complex>(numerator_s);
+	}
+	result = 1./multiply*result;
+	return {result.value, result.derivative*s.derivative};
+}
+
+std::vector<Complex> DispersiveIntegral::evaluate(double s, const std::vector<Variant>& variants){
+	multi::Result report;
+	return evaluate(s, variants, report);
+}
+
+std::vector<Complex> DispersiveIntegral::evaluate(double s, const std::vector<Variant>& variants, multi::Result& report){
+	INSTR_SCOPE("disp::DispersiveIntegral::evaluate");
+	if (s > cutoff)
+	{
+		throw std::domain_error("s larger than cutoff of integral.");
+	}
+	bool with_err = false;
+	int max_sub = 0;
+	for (const auto& variant: variants){
+		if (variant.num_sub < 1){
+			throw std::domain_error("num_sub must be an integer greater or equal to 1.");
+		}
+		if (variant.err < 0 || variant.err > 2){
+			throw std::domain_error("err must be 0 (without error), 1 (low) or 2 (up).");
+		}
+		with_err = with_err || variant.err != 0;
+		max_sub = std::max(max_sub, variant.num_sub);
+	}
+	const std::size_t dim = variants.size();
+	if (dim == 0){
+		return {};
+	}
+
+	// below threshold the integrals are trivial, i.e. nothing is subtracted
+	const bool trivial = s < sth;
+	const std::array<double,3> numerator_s = trivial ? std::array<double,3>{0., 0., 0.} : numerators(s, with_err);
+
+	// the principal value weights 1/(s'-s) exactly, hence one integration per variant instead of shared nodes
+	if (principal_value && s > sth && s < cutoff){
+		report = multi::Result{};
+		report.values.resize(dim);
+		report.errors.resize(dim);
+		std::vector<Complex> result(dim);
+		for (std::size_t k=0; k<dim; k++){
+			const int n = variants[k].num_sub;
+			const int e = variants[k].err;
+			const gsl::Result variant = principal_value_integral([&](double s_prime){
+				return numerators(s_prime, e != 0)[e]/std::pow(s_prime-subtraction_point,n); }, s, sth, cutoff);
+			gsl::check(variant.status);
+			report.values[k] = variant.value;
+			report.errors[k] = variant.error;
+			report.evaluations += variant.evaluations;
+			report.intervals += variant.intervals;
+			result[k] = 1./multiply*(std::pow(s-subtraction_point,n)/(2*constants::pi())*variant.value + 1.i/2. * numerator_s[e]);
+		}
+		return result;
+	}
+
+	std::vector<double> powers(max_sub + 1);
+	std::vector<double> numerator_s_prime;
+	const multi::Function integrand{[&](std::size_t n, const double* s_prime, double* values){
+		numerator_s_prime.resize(3*n);
+		numerators(n, s_prime, with_err, numerator_s_prime.data());
+		for (std::size_t i=0; i<n; i++){
+			powers[0] = 1.;
+			for (int k=1; k<=max_sub; k++){
+				powers[k] = powers[k-1]*(s_prime[i]-subtraction_point);
+			}
+			for (std::size_t k=0; k<dim; k++){
+				const int e = variants[k].err;
+				values[i*dim+k] = (numerator_s_prime[3*i+e]-numerator_s[e])/(powers[variants[k].num_sub]*(s_prime[i]-s));
+			}
+		}
+	}};
+
+	auto integration = multi::Integration(dim);
+	integration.reserve(10000);
+	integration.set_absolute(0.0);
+	integration.set_relative(1e-7);
+
+	report = integration(integrand, sth, cutoff);
+
+	std::vector<Complex> result(dim);
+	for (std::size_t k=0; k<dim; k++){
+		const int n = variants[k].num_sub;
+		const double numerical = std::pow(s-subtraction_point,n)/(2*constants::pi())*report.values[k];
+		if (trivial){
+			result[k] = 1./multiply*numerical;
+		}
+		else{
+			const double num = numerator_s[variants[k].err];
+			result[k] = 1./multiply*(numerical + 1./(2*constants::pi()) * num * analytic_factor(s, sth, n) + 1.i/2. * num);
+		}
+	}
+	return result;
+}
+
+void DispersiveIntegral::enable_cache(std::size_t capacity){
+	gammaKKpicdisc.enable_cache(capacity);
+	gammaKKpindisc.enable_cache(capacity);
+}
+
+void DispersiveIntegral::compact(gsl::Precision precision){
+	INSTR_SCOPE("disp::DispersiveIntegral::compact");
+	// the neutral amplitudes may take the compacted charged interpolators below, such that their compact no longer sees the change
+	const bool changed = gammaKKpindisc.absgammaKKpic.spline_abs.precision() != precision || gammaKKpindisc.absgammaKKpin.spline_abs.precision() != precision;
+	gammaKKpicdisc.compact(precision);
+	// amplitudes on the same grid are copies of each other, keep sharing the interpolators
+	for(auto amplitude: {std::make_pair(&gammaKKpicdisc.absgammaKKpic, &gammaKKpindisc.absgammaKKpic), std::make_pair(&gammaKKpicdisc.absgammaKKpin, &gammaKKpindisc.absgammaKKpin)}){
+		input::gammaKKpi& charged = *amplitude.first;
+		input::gammaKKpi& neutral = *amplitude.second;
+		if(charged.spline_abs.share_grid() == neutral.spline_abs.share_grid()){
+			neutral.spline_abs = charged.spline_abs;
+			neutral.spline_abs_err = charged.spline_abs_err;
+		}
+	}
+	gammaKKpindisc.compact(precision);
+	if(changed){
+		gammaKKpindisc.renew_cache();
+	}
+}
+
+void DispersiveIntegral::disable_cache(){
+	gammaKKpicdisc.disable_cache();
+	gammaKKpindisc.disable_cache();
+}
+
+memo::Statistics DispersiveIntegral::cache_statistics() const{
+	return gammaKKpicdisc.cache_statistics() + gammaKKpindisc.cache_statistics();
+}
+
+void DispersiveIntegral::enable_surrogate(double lower, double upper){
+	surrogate = std::make_shared<const Surrogate>(Surrogate::build(*this, lower, upper));
+}
+
+void DispersiveIntegral::disable_surrogate(){
+	surrogate.reset();
+}
@@ -0,0 +1,357 @@
+#include "fit.h"
+#include "basis.h"
+#include "combination.h"
+#include "instrumentation.h"
+#include "snapshot.h"
+
+#include <gsl/gsl_blas.h>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_multifit_nlinear.h>
+#include <gsl/gsl_vector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace fit {
+
+namespace {
+constexpr char magic[8]{'K','A','O','N','F','I','T','\0'};
+constexpr std::uint32_t version{1};
+
+struct Workspace_deleter {
+    void operator()(gsl_multifit_nlinear_workspace* p) const
+    {
+        gsl_multifit_nlinear_free(p);
+    }
+};
+struct Vector_deleter {
+    void operator()(gsl_vector* p) const {gsl_vector_free(p);}
+};
+struct Matrix_deleter {
+    void operator()(gsl_matrix* p) const {gsl_matrix_free(p);}
+};
+
+std::array<double,4> parameters(const pipeline::Constants& c)
+{
+    return {c.a0,c.a12,c.b0,c.b12};
+}
+
+pipeline::Constants constants(const double* p)
+{
+    return pipeline::Constants{p[0],p[1],p[2],p[3]};
+}
+} // anonymous namespace
+
+/// Entry points of gsl_multifit_nlinear, `params` points to the `Fit`.
+struct Callbacks {
+    static int f(const gsl_vector* x, void* params, gsl_vector* r)
+    {
+        const auto p{position(x)};
+        std::vector<double> values(r->size);
+        static_cast<const Fit*>(params)->evaluate(p.data(),values.data(),
+                nullptr);
+        for (std::size_t k=0; k<values.size(); ++k)
+            gsl_vector_set(r,k,values[k]);
+        return GSL_SUCCESS;
+    }
+
+    static int df(const gsl_vector* x, void* params, gsl_matrix* jacobian)
+    {
+        const auto p{position(x)};
+        std::vector<double> residuals(jacobian->size1);
+        std::vector<double> values(jacobian->size1*4);
+        static_cast<const Fit*>(params)->evaluate(p.data(),residuals.data(),
+                values.data());
+        for (std::size_t k=0; k<jacobian->size1; ++k)
+            for (std::size_t j=0; j<4; ++j)
+                gsl_matrix_set(jacobian,k,j,values[4*k+j]);
+        return GSL_SUCCESS;
+    }
+
+    static std::array<double,4> position(const gsl_vector* x)
+    {
+        return {gsl_vector_get(x,0),gsl_vector_get(x,1),gsl_vector_get(x,2),
+            gsl_vector_get(x,3)};
+    }
+};
+
+Fit::Fit(std::vector<Point> data, const Options& options)
+    : data_{std::move(data)}, options{options}
+{
+    if (data_.size()<4)
+        throw std::invalid_argument{"fit needs at least four data points"};
+    for (const auto& point: data_) {
+        if (!(point.error>0))
+            throw std::invalid_argument{"fit needs positive errors"};
+        if (point.i<1 || point.i>4)
+            throw std::invalid_argument{"fit needs i in 1..4"};
+    }
+    comb::Registry::instance().set(options.basis);
+
+    key = snapshot::checksum(options.basis.data(),options.basis.size());
+    for (const auto& point: data_) {
+        const double fields[]{static_cast<double>(point.i),point.s,
+            static_cast<double>(point.part),point.value,point.error};
+        key = snapshot::checksum(fields,sizeof(fields),key);
+    }
+
+    if (!read_checkpoint())
+        evaluate_responses();
+}
+
+void Fit::evaluate_responses()
+{
+    INSTR_SCOPE("fit::Fit::evaluate_responses");
+    std::vector<double> s;
+    s.reserve(data_.size());
+    for (const auto& point: data_)
+        s.push_back(point.s);
+    std::sort(s.begin(),s.end());
+    s.erase(std::unique(s.begin(),s.end()),s.end());
+
+    // one task per distinct s and set of constants: zero and the unit
+    // vectors of a0, a12, b0, b12. f_all yields all four partial waves.
+    const std::size_t tasks{5*s.size()};
+    std::vector<std::array<Complex,4>> values(tasks);
+
+    // the tables are shared, every worker owns its splines, since
+    // `comb::Combination` is not thread-safe
+    comb::Combination prototype{0,0,0,0,2,0.001,false};
+    prototype.use_basis(options.basis);
+    prototype.load();
+    std::size_t threads{options.threads};
+    if (!threads)
+        threads = std::max(1u,std::thread::hardware_concurrency());
+    const std::size_t n{std::min(threads,tasks)};
+    std::vector<comb::Combination> copies(n,prototype);
+    std::vector<std::exception_ptr> errors(n);
+    auto work = [&](std::size_t w)
+    {
+        try {
+            comb::Combination& c{copies[w]};
+            for (std::size_t k=w*tasks/n; k<(w+1)*tasks/n; ++k) {
+                const std::size_t set{k%5};
+                c.a0 = set==1;
+                c.a12 = set==2;
+                c.b0 = set==3;
+                c.b12 = set==4;
+                values[k] = c.f_all(s[k/5]);
+            }
+        }
+        catch (...) {
+            errors[w] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (std::size_t w=1; w<n; ++w)
+        pool.emplace_back(work,w);
+    if (n)
+        work(0);
+    for (auto& t: pool)
+        t.join();
+    for (const auto& e: errors)
+        if (e)
+            std::rethrow_exception(e);
+
+    response.resize(data_.size());
+    for (std::size_t k=0; k<data_.size(); ++k) {
+        const std::size_t j{static_cast<std::size_t>(
+                std::lower_bound(s.begin(),s.end(),data_[k].s)-s.begin())};
+        const std::size_t i{static_cast<std::size_t>(data_[k].i-1)};
+        const Complex zero{values[5*j][i]};
+        response[k][0] = zero;
+        for (std::size_t set=1; set<5; ++set)
+            response[k][set] = values[5*j+set][i]-zero;
+    }
+}
+
+bool Fit::read_checkpoint()
+{
+    if (options.checkpoint.empty())
+        return false;
+    try {
+        const snapshot::Mapping file{options.checkpoint};
+        snapshot::Reader in{snapshot::open_file(file,magic,version,
+                options.checkpoint)};
+        if (in.u64()!=key)
+            return false;
+        const std::size_t iterations{in.u64()};
+        const auto p{in.array()};
+        const auto flat{in.array()};
+        if (!in.done() || p.size()!=4 || flat.size()!=10*data_.size())
+            return false;
+        response.resize(data_.size());
+        for (std::size_t k=0; k<data_.size(); ++k)
+            for (std::size_t set=0; set<5; ++set)
+                response[k][set] = Complex{flat[10*k+2*set],
+                    flat[10*k+2*set+1]};
+        checkpoint_iterations = iterations;
+        checkpoint_constants = constants(p.data());
+        checkpoint_loaded = true;
+        resume = true;
+        return true;
+    }
+    catch (const snapshot::Error&) {
+        return false;
+    }
+}
+
+void Fit::write_checkpoint(const pipeline::Constants& c,
+        std::size_t iterations) const
+{
+    if (options.checkpoint.empty())
+        return;
+    snapshot::Writer out;
+    out.u64(key);
+    out.u64(iterations);
+    const auto p{parameters(c)};
+    out.array(std::vector<double>(p.begin(),p.end()));
+    std::vector<double> flat;
+    flat.reserve(10*response.size());
+    for (const auto& r: response)
+        for (const Complex& x: r) {
+            flat.push_back(x.real());
+            flat.push_back(x.imag());
+        }
+    out.array(flat);
+    snapshot::write_file(options.checkpoint,magic,version,out);
+}
+
+Complex Fit::model(std::size_t k, const pipeline::Constants& c) const
+{
+    const auto p{parameters(c)};
+    const auto& r{response.at(k)};
+    return r[0]+p[0]*r[1]+p[1]*r[2]+p[2]*r[3]+p[3]*r[4];
+}
+
+std::vector<double> Fit::residuals(const pipeline::Constants& c) const
+{
+    const auto p{parameters(c)};
+    std::vector<double> r(data_.size());
+    evaluate(p.data(),r.data(),nullptr);
+    return r;
+}
+
+void Fit::evaluate(const double* p, double* r, double* jacobian) const
+{
+    for (std::size_t k=0; k<data_.size(); ++k) {
+        const Point& point{data_[k]};
+        const auto& d{response[k]};
+        const Complex value{d[0]+p[0]*d[1]+p[1]*d[2]+p[2]*d[3]+p[3]*d[4]};
+        const double modulus{std::abs(value)};
+        switch (point.part) {
+        case Part::real:
+            r[k] = (value.real()-point.value)/point.error;
+            break;
+        case Part::imag:
+            r[k] = (value.imag()-point.value)/point.error;
+            break;
+        case Part::modulus:
+            r[k] = (modulus-point.value)/point.error;
+            break;
+        }
+        if (!jacobian)
+            continue;
+        for (std::size_t j=0; j<4; ++j) {
+            const Complex dv{d[j+1]};
+            double derivative{0};
+            switch (point.part) {
+            case Part::real:
+                derivative = dv.real();
+                break;
+            case Part::imag:
+                derivative = dv.imag();
+                break;
+            case Part::modulus:
+                // d|f| = Re(conj(f) df)/|f|, not differentiable at f=0
+                if (modulus>0)
+                    derivative = std::real(std::conj(value)*dv)/modulus;
+                break;
+            }
+            jacobian[4*k+j] = derivative/point.error;
+        }
+    }
+}
+
+Result Fit::run(const pipeline::Constants& start)
+{
+    INSTR_SCOPE("fit::Fit::run");
+    const std::size_t n{data_.size()};
+    Result result;
+    result.resumed = resume;
+    result.iterations = resume ? checkpoint_iterations : 0;
+    const auto p0{parameters(resume ? checkpoint_constants : start)};
+    resume = false;
+
+    gsl_multifit_nlinear_parameters parameters_gsl{
+        gsl_multifit_nlinear_default_parameters()};
+    std::unique_ptr<gsl_multifit_nlinear_workspace,Workspace_deleter>
+        workspace{gsl_multifit_nlinear_alloc(gsl_multifit_nlinear_trust,
+                &parameters_gsl,n,4)};
+    std::unique_ptr<gsl_vector,Vector_deleter> x{gsl_vector_alloc(4)};
+    if (!workspace || !x)
+        throw std::bad_alloc{};
+    for (std::size_t j=0; j<4; ++j)
+        gsl_vector_set(x.get(),j,p0[j]);
+
+    gsl_multifit_nlinear_fdf fdf;
+    fdf.f = Callbacks::f;
+    fdf.df = Callbacks::df;
+    fdf.fvv = nullptr;
+    fdf.n = n;
+    fdf.p = 4;
+    fdf.params = this;
+    result.status = gsl_multifit_nlinear_init(x.get(),&fdf,workspace.get());
+    if (result.status)
+        throw std::runtime_error{std::string{"fit: "}
+            +gsl_strerror(result.status)};
+
+    const gsl_vector* position{gsl_multifit_nlinear_position(workspace.get())};
+    auto current = [position]
+    {
+        const auto p{Callbacks::position(position)};
+        return constants(p.data());
+    };
+    // the responses are saved before the first iteration
+    write_checkpoint(current(),result.iterations);
+    result.status = GSL_CONTINUE;
+    while (result.status==GSL_CONTINUE
+            && result.iterations<options.max_iterations) {
+        result.status = gsl_multifit_nlinear_iterate(workspace.get());
+        if (result.status)
+            break;
+        ++result.iterations;
+        write_checkpoint(current(),result.iterations);
+        int info{0};
+        result.status = gsl_multifit_nlinear_test(options.xtol,options.gtol,
+                options.ftol,&info,workspace.get());
+    }
+    if (result.status==GSL_CONTINUE)
+        result.status = GSL_EMAXITER;
+
+    result.constants = current();
+    const double norm{gsl_blas_dnrm2(
+            gsl_multifit_nlinear_residual(workspace.get()))};
+    result.chi2 = norm*norm;
+    result.dof = n-4;
+
+    std::unique_ptr<gsl_matrix,Matrix_deleter> covariance{
+        gsl_matrix_alloc(4,4)};
+    if (!covariance)
+        throw std::bad_alloc{};
+    gsl_multifit_nlinear_covar(gsl_multifit_nlinear_jac(workspace.get()),0.,
+            covariance.get());
+    for (std::size_t i=0; i<4; ++i) {
+        for (std::size_t j=0; j<4; ++j)
+            result.covariance[i][j] = gsl_matrix_get(covariance.get(),i,j);
+        result.errors[i] = std::sqrt(result.covariance[i][i]);
+    }
+    return result;
+}
+
+} // fit
@@ -32,45 +32,6 @@ void check(int status)
 }
 
 
-// -- general helpers ---------------------------------------------------------
-
-double unwrap(double x, void* p)
-    // Call *p with x, where *p should be a std::function<double(double)>.
-    // `unwrap` provides the signature needed by the gsl integration routine.
-{
-    auto fp = static_cast<std::function<double(double)>*>(p);
-    return (*fp)(x);
-}
-
-// Wrap a general function such that in can be used by the gsl routines.
-// ATTENTION: instances of this class are passed via pointers to the gsl
-// routines. In addition, they own a function.
-// Hence to be safe one needs to ensure that the instance exists
-// for the entire run time of the gsl routine, which is achieved best via
-// first defining the instance and on a next line invoking the gsl-routine,
-// instead of the dangerous `gsl_routine(&Wrapper{f}, ...)`.
-class Wrapper {
-public:
-    explicit Wrapper(Function f) : function{std::move(f)}
-    {
-        // Use the `void*`, which points to parameters usually, to pass a
-        // `Function` to the gsl routine. `unwrap` takes care of everything,
-        // i.e., applies this function. This way, the gsl routine can be used
-        // both with function objects and ordinary functions.
-        gsl_func.function = unwrap;
-        gsl_func.params = &function;
-    }
-    
-    gsl_function* operator&()
-    {
-        return &gsl_func;
-    }
-private:
-    Function function;
-    gsl_function gsl_func;
-};
-
-
 // -- Integration: Gauss-Legendre  --------------------------------------------
 
 GaussLegendre::GaussLegendre(std::size_t s)
@@ -114,8 +75,7 @@ std::pair<double,double> GaussLegendre::point(double lower, double upper,
 double GaussLegendre::operator()(const Function& f, double lower,
         double upper) const
 {
-    Wrapper wrapper{f};
-    return gsl_integration_glfixed(&wrapper,lower,upper,table.get());
+    return this->operator()<Function>(f,lower,upper);
 }
 
 void GaussLegendre::resize(std::size_t s)
@@ -147,33 +107,43 @@ Qag::Qag(const Settings& set)
 
 Value Qag::operator()(const Function& f, double lower, double upper) const
 {
-    int sign{signed_interval(lower,upper) ? 1 : -1};
+    const Result result{integrate(f,lower,upper)};
+    check(result.status);
+    return Value{result.value,result.error};
+}
 
-    Wrapper wrapper{f};
+Result Qag::integrate(const Function& f, double lower, double upper) const
+{
+    return integrate<Function>(f,lower,upper);
+}
 
-    double result{0.0};
-    double error{0.0};
+void Qag::reserve(std::size_t space)
+{
+    workspace.reserve(space);
+    limit = space;
+}
 
-    bool lower_inf{std::isinf(lower)};
-    bool upper_inf{std::isinf(upper)};
+Qawc::Qawc(const Settings& set)
+: absolute_precision{set.absolute_precision},
+    relative_precision{set.relative_precision},
+    limit{set.space},
+    workspace{set.space}
+{
+}
 
-    if (lower_inf && upper_inf)
-        call(gsl_integration_qagi,&wrapper,absolute_precision,
-                relative_precision,limit,workspace.data(),&result,&error);
-    else if (lower_inf)
-        call(gsl_integration_qagil,&wrapper,upper,absolute_precision,
-                relative_precision,limit,workspace.data(),&result,&error);
-    else if (upper_inf)
-        call(gsl_integration_qagiu,&wrapper,lower,absolute_precision,
-                relative_precision,limit,workspace.data(),&result,&error);
-    else
-        call(gsl_integration_qags,&wrapper,lower,upper,absolute_precision,
-                relative_precision,limit,workspace.data(),&result,&error);
+Value Qawc::operator()(const Function& f, double lower, double upper,
+        double c) const
+{
+    return this->operator()<Function>(f,lower,upper,c);
+}
 
-    return Value{sign*result,error};
+Result Qawc::integrate(const Function& f, double lower, double upper,
+        double c) const
+{
+    return integrate<Function>(f,lower,upper,c);
 }
 
-void Qag::reserve(std::size_t space)
+void Qawc::reserve(std::size_t space)
 {
     workspace.reserve(space);
     limit = space;
@@ -188,39 +158,14 @@ Cquad::Cquad(const Settings& set)
 
 Value Cquad::operator()(const Function& f, double lower, double upper) const
 {
-    int sign{signed_interval(lower,upper) ? 1 : -1};
-
-    bool lower_inf{std::isinf(lower)};
-    bool upper_inf{std::isinf(upper)};
-
-    // `gsl_integration_cquad` does not provide functions for the integration
-    // of infinite intervals. Hence, the required change of variables is
-    // performed explicitly.
-    Function integrand{f};
-    if (lower_inf && upper_inf) {
-        integrand = [&f](double x){return (f((1-x)/x) + f((x-1)/x)) / (x*x);};
-        lower = 0.0;
-        upper = 1.0;
-    }
-    else if (lower_inf) {
-        integrand = [&f,upper](double x){return f(upper+(x-1)/x) / (x*x);};
-        lower = 0.0;
-        upper = 1.0;
-    }
-    else if (upper_inf) {
-        integrand = [&f,lower](double x){return f(lower+(1-x)/x) / (x*x);};
-        lower = 0.0;
-        upper = 1.0;
-    }
-
-    Wrapper wrapper{integrand};
-    double result{0.0};
-    double error{0.0};
+    const Result result{integrate(f,lower,upper)};
+    check(result.status);
+    return Value{result.value,result.error};
+}
 
-    std::size_t evaluations{0}; // dummy variable for function call
-    call(gsl_integration_cquad,&wrapper,lower,upper,absolute_precision,
-            relative_precision,workspace.data(),&result,&error,&evaluations);
-    return Value{sign*result,error};
+Result Cquad::integrate(const Function& f, double lower, double upper) const
+{
+    return integrate<Function>(f,lower,upper);
 }
 
 void Cquad::reserve(std::size_t space)
@@ -232,78 +177,152 @@ void Cquad::reserve(std::size_t space)
 
 Interpolate::Interpolate(const std::vector<double>& x,
         const std::vector<double>& y, InterpolationMethod m, bool tolerant)
-    : x_data{x}, y_data{y}, method{m}, tolerant{tolerant}
+    : Interpolate{std::make_shared<const Interval>(x),
+        std::make_shared<const std::vector<double>>(y),m,tolerant}
+{}
+
+Interpolate::Interpolate(std::shared_ptr<const Interval> x,
+        std::shared_ptr<const std::vector<double>> y, InterpolationMethod m,
+        bool tolerant, Precision precision)
+    : x_data{std::move(x)}, y_data{std::move(y)}, method{m},
+    tolerant{tolerant}
 {
-    if (x_data.size()!=y_data.size())
+    if (x_data->size()!=y_data->size())
         throw std::invalid_argument("x and y need to have the same size");
-    if (x_data.size()<method.min_size())
+    if (x_data->size()<method.min_size())
         throw std::invalid_argument("not enough data points for the choosen \
 interpolation method");
-    spline = gsl_interp_alloc(method.get_method(),x_data.size());
-    call(gsl_interp_init,spline,x_data.data(),y_data.data(),x.size());
+    initialize(precision);
 }
 
-Interpolate::Interpolate(const Interpolate& other)
-    : x_data{other.x_data}, y_data{other.y_data}, method{other.method},
-    tolerant{other.tolerant}
+void Interpolate::initialize(Precision precision)
 {
-    spline = gsl_interp_alloc(method.get_method(),x_data.size());
-    call(gsl_interp_init,spline,x_data.data(),y_data.data(),x_data.size());
+    const std::size_t n{x_data->size()};
+    const Interval& x{*x_data};
+    const std::vector<double>& y{*y_data};
+    if (precision==Precision::double_precision) {
+        gsl_interp* p{gsl_interp_alloc(method.get_method(),n)};
+        if (!p)
+            throw Allocation_error{"could not allocate the interpolation"};
+        spline = std::shared_ptr<const gsl_interp>{p,Interp_deleter{}};
+        call(gsl_interp_init,p,x.data(),y.data(),n);
+        return;
+    }
+    if (method.get_method()!=gsl_interp_cspline)
+        throw std::invalid_argument("single precision needs cubic \
+interpolation");
+
+    // natural cubic spline like gsl_interp_cspline: solve
+    // h[k-1] c[k-1] + 2 (h[k-1]+h[k]) c[k] + h[k] c[k+1]
+    //     = 6 ((y[k+1]-y[k])/h[k] - (y[k]-y[k-1])/h[k-1])
+    // with c[0] = c[n-1] = 0
+    std::vector<double> c(n,0.);
+    std::vector<double> diagonal(n,0.);
+    for (std::size_t k=1; k+1<n; ++k) {
+        const double left{x[k]-x[k-1]};
+        const double right{x[k+1]-x[k]};
+        diagonal[k] = 2*(left+right);
+        c[k] = 6*((y[k+1]-y[k])/right-(y[k]-y[k-1])/left);
+    }
+    for (std::size_t k=2; k+1<n; ++k) {
+        const double factor{(x[k]-x[k-1])/diagonal[k-1]};
+        diagonal[k] -= factor*(x[k]-x[k-1]);
+        c[k] -= factor*c[k-1];
+    }
+    for (std::size_t k=n-2; k>0; --k)
+        c[k] = (c[k]-(x[k+1]-x[k])*c[k+1])/diagonal[k];
+
+    auto store = std::make_shared<Single>();
+    store->y.assign(y.begin(),y.end());
+    store->second.assign(c.begin(),c.end());
+    constexpr double eps{std::numeric_limits<float>::epsilon()/2};
+    const double curvature{1./(9*std::sqrt(3.))};
+    store->bound = 0;
+    for (std::size_t k=0; k+1<n; ++k) {
+        const double h{x[k+1]-x[k]};
+        store->bound = std::max(store->bound,eps*(std::max(std::abs(y[k]),
+                    std::abs(y[k+1]))+curvature*h*h*(std::abs(c[k])
+                    +std::abs(c[k+1]))));
+    }
+    single = std::move(store);
+    y_data.reset();
+}
+
+double Interpolate::evaluate_single(int order, double x) const
+{
+    const Interval& grid{*x_data};
+    if (!(x>=grid.front() && x<=grid.back()))
+        throw Domain_error{"input domain error"};
+    const std::size_t k{gsl_interp_accel_find(acc,grid.data(),grid.size(),
+            x)};
+    const double h{grid[k+1]-grid[k]};
+    const double a{(grid[k+1]-x)/h};
+    const double b{1.-a};
+    const double y0{single->y[k]};
+    const double y1{single->y[k+1]};
+    const double c0{single->second[k]};
+    const double c1{single->second[k+1]};
+    switch (order) {
+    case 0:
+        return a*y0+b*y1+((a*a*a-a)*c0+(b*b*b-b)*c1)*h*h/6.;
+    case 1:
+        return (y1-y0)/h+(-(3*a*a-1)*c0+(3*b*b-1)*c1)*h/6.;
+    default:
+        return a*c0+b*c1;
+    }
 }
 
+Interpolate::Interpolate(const Interpolate& other)
+    : x_data{other.x_data}, y_data{other.y_data}, method{other.method},
+    tolerant{other.tolerant}, spline{other.spline}, single{other.single}
+{}
+
 Interpolate::Interpolate(Interpolate&& other)
     : x_data{std::move(other.x_data)}, y_data{std::move(other.y_data)},
     method{other.method}, tolerant{other.tolerant},
-    acc{other.acc}, spline{other.spline}
+    acc{other.acc}, spline{std::move(other.spline)},
+    single{std::move(other.single)}
 {
     other.acc = nullptr;
-    other.spline = nullptr;
 }
 
 Interpolate::Interpolate()
-    : method{InterpolationMethod::linear}
-{
-    spline = gsl_interp_alloc(method.get_method(),0); 
-}
+    : x_data{std::make_shared<const Interval>()},
+    y_data{std::make_shared<const std::vector<double>>()},
+    method{InterpolationMethod::linear}, tolerant{true}
+{}
 
 Interpolate& Interpolate::operator=(const Interpolate& other)
 {
-    // free old data
-    gsl_interp_free(spline);
-
-    // copy
+    // the data is shared, only the accelerator is owned
     x_data = other.x_data;
     y_data = other.y_data;
     method = other.method;
     tolerant = other.tolerant;
-    spline = gsl_interp_alloc(method.get_method(),x_data.size());
-    call(gsl_interp_init,spline,x_data.data(),y_data.data(),x_data.size());
-
+    spline = other.spline;
+    single = other.single;
+    if (acc)
+        gsl_interp_accel_reset(acc);
+    else
+        acc = gsl_interp_accel_alloc();
     return *this;
 }
 
 Interpolate& Interpolate::operator=(Interpolate&& other)
 {
-    // free old data
-    gsl_interp_free(spline);
-
-    // copy
     x_data = std::move(other.x_data);
     y_data = std::move(other.y_data);
     method = other.method;
-    spline = other.spline;
     tolerant = other.tolerant;
-
-    // empty old object
-    other.acc = nullptr;
-    other.spline = nullptr;
-
+    spline = std::move(other.spline);
+    single = std::move(other.single);
+    std::swap(acc,other.acc);
     return *this;
 }
 
 double Interpolate::operator()(double x) const
 {
-    return evaluate(gsl_interp_eval_e, x);
+    return evaluate(gsl_interp_eval_e, 0, x);
 }
 
 double Interpolate::eval(double x) const
@@ -313,17 +332,31 @@ double Interpolate::eval(double x) const
 
 double Interpolate::derivative(double x) const
 {
-    return evaluate(gsl_interp_eval_deriv_e, x);
+    return evaluate(gsl_interp_eval_deriv_e, 1, x);
 }
 
 double Interpolate::derivative2(double x) const
 {
-    return evaluate(gsl_interp_eval_deriv2_e, x);
+    return evaluate(gsl_interp_eval_deriv2_e, 2, x);
+}
+
+ad::Dual<double> Interpolate::operator()(const ad::Dual<double>& x) const
+{
+    const double value{evaluate(gsl_interp_eval_e, 0, x.value)};
+    if (tolerant && (x.value<front() || x.value>back()))
+        return {value,0.};
+    return {value,evaluate(gsl_interp_eval_deriv_e, 1, x.value)*x.derivative};
+}
+
+std::vector<double> Interpolate::values() const
+{
+    if (single)
+        return std::vector<double>(single->y.begin(),single->y.end());
+    return *y_data;
 }
 
 Interpolate::~Interpolate() noexcept
 {
-    gsl_interp_free(spline);
     gsl_interp_accel_free(acc);
 }
 
@@ -358,10 +391,7 @@ InterpolationMethod::InterpolationMethod(InterpolationMethod::Method m)
 Interpolate sample(const Function& f, const Interval& i,
         InterpolationMethod m, bool tolerant)
 {
-    std::vector<double> y_values(i.size());
-    std::transform(i.cbegin(),i.cend(),y_values.begin(),f);
-
-    return Interpolate{i,y_values,m,tolerant};
+    return sample<Function>(f,i,m,tolerant);
 }
 
 // -- 2D Interpolation -----------------------------------------------------------
@@ -508,22 +538,6 @@ Interpolate2D sample_2d(const std::function<double(double, double)>& f, const In
 Value derivative(const Function& f, double value, double step_size,
         DerivativeMethod method)
 {
-    Wrapper wrapper{f};
-    double result{0.0};
-    double abs_error{0.0};
-    switch (method) {
-        case DerivativeMethod::central:
-            gsl_deriv_central(&wrapper, value, step_size, &result, &abs_error);
-            break;
-        case DerivativeMethod::forward:
-            gsl_deriv_forward(&wrapper, value, step_size, &result, &abs_error);
-            break;
-        case DerivativeMethod::backward:
-            gsl_deriv_backward(&wrapper, value, step_size, &result, &abs_error);
-            break;
-        default:
-            throw std::runtime_error{"switch does not cover all cases"};
-    }
-    return Value{result, abs_error};
+    return derivative<Function>(f,value,step_size,method);
 }
 } // gsl
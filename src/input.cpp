@@ -1,13 +1,186 @@
 #include "input.h"
+#include "checkpoint.h"
+#include "instrumentation.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
 
 using namespace input;
 
+namespace {
+std::string read_file(const std::string& file)
+{
+	std::ifstream in(file, std::ios::binary);
+	if(!in){
+		throw std::runtime_error("could not open " + file);
+	}
+	return std::string{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+}
+
+// Converts the next row at position into row, returns false if it is incomplete or not numeric
+bool read_row(const char*& position, std::vector<double>& row)
+{
+	for(std::size_t k=0; k<row.size(); k++){
+		char* end;
+		row[k] = std::strtod(position, &end);
+		if(end == position){
+			return false;
+		}
+		position = end;
+	}
+	return true;
+}
+}
+
+std::vector<std::vector<double>> input::read_table(const std::string& file, std::size_t columns)
+{
+	INSTR_SCOPE("input::read_table");
+	const std::string content = read_file(file);
+
+	std::vector<std::vector<double>> table(columns);
+	std::vector<double> row(columns);
+	const char* position = content.c_str();
+	while(read_row(position, row)){
+		for(std::size_t k=0; k<columns; k++){
+			table[k].push_back(row[k]);
+		}
+	}
+	return table;
+}
+
+std::vector<std::vector<double>> input::read_table(const std::string& file, std::size_t columns, double lower, double upper, std::size_t margin)
+{
+	INSTR_SCOPE("input::read_table");
+	const std::string content = read_file(file);
+
+	// skip the rows before lower, keeping the starts of the last margin of them
+	std::deque<const char*> before;
+	const char* position = content.c_str();
+	while(true){
+		char* end;
+		const double first = std::strtod(position, &end);
+		if(end == position || !(first < lower)){
+			break;
+		}
+		before.push_back(position);
+		if(before.size() > margin){
+			before.pop_front();
+		}
+		const char* newline = std::strchr(end, '\n');
+		position = newline ? newline+1 : end + std::strlen(end);
+	}
+	if(!before.empty()){
+		position = before.front();
+	}
+
+	std::vector<std::vector<double>> table(columns);
+	std::vector<double> row(columns);
+	std::size_t beyond = 0;
+	while(read_row(position, row)){
+		if(row[0] > upper && beyond++ == margin){
+			break;
+		}
+		for(std::size_t k=0; k<columns; k++){
+			table[k].push_back(row[k]);
+		}
+	}
+	return table;
+}
+
+std::vector<std::vector<double>> input::read_amplitude(int i, const comb::Combination& combination)
+{
+	const std::string file = gammaKKpi::file(i, false);
+	auto table = read_table(file, 3);
+	const std::size_t rows = table[0].size();
+	const checkpoint::Completion marker = checkpoint::completion(file);
+	if(marker.complete){
+		const bool known = marker.fingerprint == combination.fingerprint(i) || marker.fingerprint == combination.fingerprint(i, comb::Combination::Projection::shared);
+		if(marker.rows != rows || !known){
+			throw std::runtime_error(file + " was written for other parameters or is damaged, remove it to create it again");
+		}
+		return table;
+	}
+
+	// written before the completion markers, accepted if it covers the whole grid
+	const std::vector<double> grid = combination.grid();
+	bool complete = rows == grid.size();
+	for(std::size_t k=0; complete && k<rows; k++){
+		complete = std::abs(table[0][k] - grid[k]) < 0.5*combination.step_size;
+	}
+	if(!complete){
+		throw std::runtime_error(file + " is incomplete, remove it to create it again");
+	}
+	return table;
+}
+
 gammaKKpi::gammaKKpi(int i, bool use_err)
 :
 matchpoint{std::pow(1.,2)}, //in GeV^2
-combination{0.9,1.0,-0.4,2.7,2,0.001} //Subtraktionconstants are set here
+combination{0.9,1.0,-0.4,2.7,2,0.001,false} //Subtraktionconstants are set here
 {which_readin(i, use_err); spline(); spline_err(); match();}
 
+gammaKKpi::gammaKKpi(State state)
+:
+s_list{std::move(state.s_list)},
+real_list{std::move(state.real_list)},
+imag_list{std::move(state.imag_list)},
+real_err_list{std::move(state.real_err_list)},
+imag_err_list{std::move(state.imag_err_list)},
+abs_list{std::move(state.abs_list)},
+abs_err_list{std::move(state.abs_err_list)},
+a{state.a},
+b{state.b},
+a_err{state.a_err},
+b_err{state.b_err},
+matchpoint{state.matchpoint},
+combination{0.9,1.0,-0.4,2.7,2,0.001,false}
+{
+	const auto grid = std::make_shared<const gsl::Interval>(s_list);
+	spline_abs = gsl::Interpolate(grid, std::make_shared<const std::vector<double>>(abs_list), gsl::InterpolationMethod::cubic, true, state.precision);
+	spline_abs_err = gsl::Interpolate(grid, std::make_shared<const std::vector<double>>(abs_err_list), gsl::InterpolationMethod::cubic, true, state.precision);
+	compacted = state.compacted;
+	if(compacted){
+		for(auto* list: {&s_list, &abs_list, &abs_err_list}){
+			std::vector<double>().swap(*list);
+		}
+	}
+}
+
+gammaKKpi::State gammaKKpi::state() const
+{
+	if(compacted){
+		return State{spline_abs.grid(), {}, {}, {}, {}, spline_abs.values(), spline_abs_err.values(), a, b, a_err, b_err, matchpoint, spline_abs.precision(), true};
+	}
+	return State{s_list, real_list, imag_list, real_err_list, imag_err_list, abs_list, abs_err_list, a, b, a_err, b_err, matchpoint, spline_abs.precision(), false};
+}
+
+gammaKKpi::gammaKKpi(std::vector<double> s_list, std::vector<double> real_list, std::vector<double> imag_list, double matchpoint)
+:
+s_list{std::move(s_list)},
+real_list{std::move(real_list)},
+imag_list{std::move(imag_list)},
+matchpoint{matchpoint},
+combination{0.9,1.0,-0.4,2.7,2,0.001,false}
+{
+	spline(); spline_err(); match();
+}
+
+std::string gammaKKpi::file(int i, bool use_err)
+{
+	if(i<1 || i>4){
+		throw std::domain_error("Function not defined for i!={1,2,3,4}.");
+	}
+	if(use_err){
+		return "../../gammaKKpi_amp/F" + std::to_string(i) + "_2sub.txt";
+	}
+	return "../../gammaKKpi_amp/F" + std::to_string(i) + ".dat";
+}
+
 void gammaKKpi::which_readin(int i, bool use_err)
 {
 	if(use_err){
@@ -20,102 +193,90 @@ void gammaKKpi::which_readin(int i, bool use_err)
 
 void gammaKKpi::readin(int i)
 {
-	std::string file;
-	if(i==1){
-		file = "../../gammaKKpi_amp/F1.dat";
-	}
-	else if(i==2){
-		file = "../../gammaKKpi_amp/F2.dat";
-	}
-	else if(i==3){
-		file = "../../gammaKKpi_amp/F3.dat";
-	}
-	else if(i==4){
-		file = "../../gammaKKpi_amp/F4.dat";
-	}
-	else{
-		throw std::domain_error("Function not defined for i!={1,2,3,4}.");
-	}
-	
-    double s, real, imag;
+	INSTR_SCOPE("input::gammaKKpi::readin");
+	const std::string file = gammaKKpi::file(i, false);
+
     std::ifstream testfile(file);
     if(!testfile){
     	combination.output(i);
     }
-    std::ifstream myfile(file);
-    while (myfile >> s >> real >> imag) {
-        s_list.push_back(s);
-        real_list.push_back(real);
-        imag_list.push_back(imag);
-        real_err_list.push_back(real); //err not included
-        imag_err_list.push_back(imag); //err not included
-    }
+    auto table = read_amplitude(i, combination);
+    s_list = std::move(table[0]);
+    real_list = std::move(table[1]);
+    imag_list = std::move(table[2]);
+    //err not included, see spline_err
     return;
 }
 
 void gammaKKpi::readin_old(int i)
 {
-	std::string file;
-	if(i==1){
-		file = "../../gammaKKpi_amp/F1_2sub.txt";
-	}
-	else if(i==2){
-		file = "../../gammaKKpi_amp/F2_2sub.txt";
-	}
-	else if(i==3){
-		file = "../../gammaKKpi_amp/F3_2sub.txt";
-	}
-	else if(i==4){
-		file = "../../gammaKKpi_amp/F4_2sub.txt";
-	}
-	else{
-		throw std::domain_error("Function not defined for i!={1,2,3,4}.");
-	}
+	INSTR_SCOPE("input::gammaKKpi::readin_old");
+	const std::string file = gammaKKpi::file(i, true);
 
-    double s, real, imag, real_err, imag_err, cross, cross_err;
-    std::ifstream myfile(file);
-    while (myfile >> s >> real >> imag >> real_err >> imag_err >> cross >> cross_err) {
-        s_list.push_back(s);
-        real_list.push_back(real);
-        imag_list.push_back(imag);
-        real_err_list.push_back(real_err);
-        imag_err_list.push_back(imag_err);
-    }
+    // the last two columns (cross section and its uncertainty) are not used
+    auto table = read_table(file, 7);
+    s_list = std::move(table[0]);
+    real_list = std::move(table[1]);
+    imag_list = std::move(table[2]);
+    real_err_list = std::move(table[3]);
+    imag_err_list = std::move(table[4]);
     return;
 }
 
 void gammaKKpi::spline()
 {
+	INSTR_SCOPE("input::gammaKKpi::spline");
 	for(std::size_t i=0; i<real_list.size(); i++){
 		abs_list.push_back(std::sqrt(std::pow(real_list[i],2)+ std::pow(imag_list[i],2)));
 	}
-	spline_abs = gsl::Interpolate(s_list,abs_list,gsl::InterpolationMethod::cubic);
+	spline_abs = gsl::Interpolate(std::make_shared<const gsl::Interval>(s_list), std::make_shared<const std::vector<double>>(abs_list), gsl::InterpolationMethod::cubic);
 }
 
 
 void gammaKKpi::spline_err()
 {
+	INSTR_SCOPE("input::gammaKKpi::spline_err");
+	const bool with_err = !real_err_list.empty();
 	for(std::size_t i=0; i<real_list.size(); i++){
-		abs_err_list.push_back(std::sqrt(std::pow(real_list[i]*real_err_list[i]/abs_list[i],2)+ std::pow(imag_list[i]*imag_err_list[i]/abs_list[i],2)));
+		const double real_err = with_err ? real_err_list[i] : real_list[i];
+		const double imag_err = with_err ? imag_err_list[i] : imag_list[i];
+		abs_err_list.push_back(std::sqrt(std::pow(real_list[i]*real_err/abs_list[i],2)+ std::pow(imag_list[i]*imag_err/abs_list[i],2)));
 	}
-	spline_abs_err = gsl::Interpolate(s_list,abs_err_list,gsl::InterpolationMethod::cubic);
+	spline_abs_err = gsl::Interpolate(spline_abs.share_grid(), std::make_shared<const std::vector<double>>(abs_err_list), gsl::InterpolationMethod::cubic);
+}
+
+void gammaKKpi::compact(gsl::Precision precision)
+{
+	INSTR_SCOPE("input::gammaKKpi::compact");
+	if(precision != spline_abs.precision()){
+		const auto grid = spline_abs.share_grid();
+		spline_abs = gsl::Interpolate(grid, std::make_shared<const std::vector<double>>(spline_abs.values()), gsl::InterpolationMethod::cubic, true, precision);
+		spline_abs_err = gsl::Interpolate(grid, std::make_shared<const std::vector<double>>(spline_abs_err.values()), gsl::InterpolationMethod::cubic, true, precision);
+		renew_cache();
+	}
+	for(auto* list: {&s_list, &real_list, &imag_list, &real_err_list, &imag_err_list, &abs_list, &abs_err_list}){
+		std::vector<double>().swap(*list);
+	}
+	compacted = true;
 }
 
 
 void gammaKKpi::match()
 {
-	double step = 10e-3;
-	double y = spline_abs(matchpoint);
-	double y_err = spline_abs_err(matchpoint);
-	std::pair<double, double> m;
-	std::pair<double, double> m_err;
-	m = gsl::derivative(spline_abs, matchpoint, step);
-	m_err = gsl::derivative(spline_abs_err, matchpoint, step);
-	
-	a = -pow(y,2)/m.first;
-	b = -matchpoint-y/m.first;
-	a_err = -pow(y_err,2)/m_err.first;
-	b_err = -matchpoint-y_err/m_err.first;
+	INSTR_SCOPE("input::gammaKKpi::match");
+	const Match m = match_at(matchpoint);
+	a = m.a;
+	b = m.b;
+	a_err = m.a_err;
+	b_err = m.b_err;
+}
+
+gammaKKpi::Match gammaKKpi::match_at(double matchpoint) const
+{
+	const ad::Dual<double> y = spline_abs(ad::variable(matchpoint));
+	const ad::Dual<double> y_err = spline_abs_err(ad::variable(matchpoint));
+
+	return Match{-pow(y.value,2)/y.derivative, -matchpoint-y.value/y.derivative, -pow(y_err.value,2)/y_err.derivative, -matchpoint-y_err.value/y_err.derivative};
 }
 
 
@@ -130,7 +291,7 @@ double gammaKKpi::cont_err(double s)
 }
 
 
-double gammaKKpi::operator()(double s)
+double gammaKKpi::evaluate(double s)
 {
 	if(s <= matchpoint)
 	{
@@ -146,7 +307,7 @@ double gammaKKpi::operator()(double s)
 	}
 }
 
-double gammaKKpi::operator[](double s)
+double gammaKKpi::evaluate_err(double s)
 {
 	if(s <= matchpoint)
 	{
@@ -160,4 +321,157 @@ double gammaKKpi::operator[](double s)
 	{
 		throw std::domain_error{"s value is out of range!"};
 	}
-}
\ No newline at end of file
+}
+
+ad::Dual<double> gammaKKpi::evaluate(const ad::Dual<double>& s) const
+{
+	if(s.value <= matchpoint)
+	{
+		return spline_abs(s);
+	}
+	return a/(s+b);
+}
+
+ad::Dual<double> gammaKKpi::evaluate_err(const ad::Dual<double>& s) const
+{
+	if(s.value <= matchpoint)
+	{
+		return spline_abs_err(s);
+	}
+	return a_err/(s+b_err);
+}
+
+double gammaKKpi::operator()(double s)
+{
+	if(value_cache)
+	{
+		return (*value_cache)(s, [this](double x){return evaluate(x);});
+	}
+	return evaluate(s);
+}
+
+double gammaKKpi::operator[](double s)
+{
+	if(error_cache)
+	{
+		return (*error_cache)(s, [this](double x){return evaluate_err(x);});
+	}
+	return evaluate_err(s);
+}
+
+void gammaKKpi::enable_cache(std::size_t capacity)
+{
+	value_cache = std::make_shared<memo::Cache<double>>(capacity);
+	error_cache = std::make_shared<memo::Cache<double>>(capacity);
+}
+
+void gammaKKpi::disable_cache()
+{
+	value_cache.reset();
+	error_cache.reset();
+}
+
+void gammaKKpi::renew_cache()
+{
+	if(value_cache)
+	{
+		value_cache = std::make_shared<memo::Cache<double>>(value_cache->capacity());
+	}
+	if(error_cache)
+	{
+		error_cache = std::make_shared<memo::Cache<double>>(error_cache->capacity());
+	}
+}
+
+memo::Statistics gammaKKpi::cache_statistics() const
+{
+	memo::Statistics stat;
+	if(value_cache)
+	{
+		stat = stat + value_cache->statistics();
+	}
+	if(error_cache)
+	{
+		stat = stat + error_cache->statistics();
+	}
+	return stat;
+}
+
+TChannel::TChannel(const std::string& file)
+{
+	INSTR_SCOPE("input::TChannel::TChannel");
+	auto table = read_table(file, 2);
+	t_list = std::move(table[0]);
+	value_list = std::move(table[1]);
+	const std::size_t n = t_list.size();
+	if(n < 3){
+		throw std::invalid_argument("t-channel amplitude needs at least 3 points, " + file);
+	}
+	step = (t_list.back() - t_list.front())/(n-1);
+	for(std::size_t k=0; k<n; k++){
+		if(!(step > 0) || std::abs(t_list[k] - (t_list.front() + k*step)) > 1e-8*step){
+			throw std::invalid_argument("t-channel amplitude is not on a uniform ascending grid, " + file);
+		}
+	}
+
+	// natural cubic spline like gsl::InterpolationMethod::cubic: solve the tridiagonal system
+	// second[k-1] + 4 second[k] + second[k+1] = 6/step^2 (value[k+1] - 2 value[k] + value[k-1]) with second[0] = second[n-1] = 0
+	second.assign(n, 0.);
+	std::vector<double> diagonal(n, 4.);
+	for(std::size_t k=1; k<n-1; k++){
+		second[k] = 6./(step*step)*(value_list[k+1] - 2*value_list[k] + value_list[k-1]);
+	}
+	for(std::size_t k=2; k<n-1; k++){
+		const double factor = 1./diagonal[k-1];
+		diagonal[k] -= factor;
+		second[k] -= factor*second[k-1];
+	}
+	for(std::size_t k=n-2; k>0; k--){
+		second[k] = (second[k] - second[k+1])/diagonal[k];
+	}
+}
+
+std::string TChannel::file()
+{
+	return "../../dispersive_t_channel/k0pp.dat";
+}
+
+std::shared_ptr<const TChannel> TChannel::shared()
+{
+	static std::once_flag flag;
+	static std::shared_ptr<const TChannel> instance;
+	std::call_once(flag, []{instance = std::make_shared<const TChannel>();});
+	return instance;
+}
+
+double TChannel::evaluate(double t) const
+{
+	const std::size_t last = t_list.size()-2;
+	const double position = (t - t_list.front())/step;
+	const std::size_t k = position < last ? static_cast<std::size_t>(position) : last;
+	const double b = position - k;
+	const double a = 1. - b;
+	return a*value_list[k] + b*value_list[k+1] + ((a*a*a - a)*second[k] + (b*b*b - b)*second[k+1])*step*step/6.;
+}
+
+double TChannel::operator()(double t) const
+{
+	if(t < front() || t > back()){
+		throw std::domain_error("t outside of the range of the t-channel amplitude.");
+	}
+	return evaluate(t);
+}
+
+void TChannel::operator()(std::size_t n, const double* t, double* values) const
+{
+	for(std::size_t k=0; k<n; k++){
+		values[k] = (*this)(t[k]);
+	}
+}
+
+std::vector<double> TChannel::operator()(const std::vector<double>& t) const
+{
+	std::vector<double> values(t.size());
+	(*this)(t.size(), t.data(), values.data());
+	return values;
+}
@@ -0,0 +1,153 @@
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+namespace instr {
+// -- Counter -----------------------------------------------------------------
+
+Counter::Slot& Counter::slot() noexcept
+{
+    static thread_local const std::size_t index{
+            std::hash<std::thread::id>{}(std::this_thread::get_id())%slots};
+    return data[index];
+}
+
+std::uint64_t Counter::count() const noexcept
+{
+    std::uint64_t sum{0};
+    for (const auto& s: data)
+        sum += s.count.load(std::memory_order_relaxed);
+    return sum;
+}
+
+double Counter::seconds() const noexcept
+{
+    std::uint64_t sum{0};
+    for (const auto& s: data)
+        sum += s.nanoseconds.load(std::memory_order_relaxed);
+    return sum*1e-9;
+}
+
+void Counter::reset() noexcept
+{
+    for (auto& s: data) {
+        s.count = 0;
+        s.nanoseconds = 0;
+    }
+}
+
+// -- Registry ----------------------------------------------------------------
+
+namespace {
+void write_report_at_exit();
+
+struct Registry {
+    std::mutex mutex;
+    std::map<std::string,std::unique_ptr<Counter>> counters;
+
+    Registry()
+    {
+        if (std::getenv("KAON_INSTRUMENTATION_REPORT"))
+            std::atexit(write_report_at_exit);
+    }
+};
+
+Registry& registry()
+{
+    // never destroyed, such that counters can be used during static
+    // destruction and in the report written at exit
+    static Registry* r{new Registry};
+    return *r;
+}
+
+void write_report_at_exit()
+{
+    const std::string path{std::getenv("KAON_INSTRUMENTATION_REPORT")};
+    std::ofstream text{path+".txt"};
+    write_text(text);
+    std::ofstream json{path+".json"};
+    write_json(json);
+}
+
+std::string escape(const std::string& s)
+{
+    std::string result;
+    for (char c: s) {
+        if (c=='"' || c=='\\')
+            result += '\\';
+        result += c;
+    }
+    return result;
+}
+} // anonymous namespace
+
+Counter& counter(const std::string& name)
+{
+    Registry& r{registry()};
+    std::lock_guard<std::mutex> lock{r.mutex};
+    auto& c{r.counters[name]};
+    if (!c)
+        c.reset(new Counter{name});
+    return *c;
+}
+
+std::vector<Record> report()
+{
+    Registry& r{registry()};
+    std::lock_guard<std::mutex> lock{r.mutex};
+    std::vector<Record> records;
+    for (const auto& c: r.counters)
+        records.push_back(Record{c.first,c.second->count(),
+                c.second->seconds()});
+    return records;
+}
+
+void write_text(std::ostream& out)
+{
+    const auto records{report()};
+    std::size_t width{4};
+    for (const auto& r: records)
+        width = std::max(width,r.name.size());
+    out<<std::left<<std::setw(width)<<"name"<<std::right<<std::setw(16)
+        <<"count"<<std::setw(16)<<"seconds"<<std::setw(16)<<"us/call"<<'\n';
+    for (const auto& r: records) {
+        out<<std::left<<std::setw(width)<<r.name<<std::right<<std::setw(16)
+            <<r.count;
+        if (r.seconds>0)
+            out<<std::setw(16)<<std::fixed<<std::setprecision(6)<<r.seconds
+                <<std::setw(16)<<std::setprecision(3)<<1e6*r.seconds/r.count
+                <<std::defaultfloat;
+        out<<'\n';
+    }
+}
+
+void write_json(std::ostream& out)
+{
+    const auto records{report()};
+    out<<"{\n  \"counters\": [";
+    for (std::size_t i=0; i<records.size(); ++i) {
+        out<<(i ? ",\n" : "\n")<<"    {\"name\": \""<<escape(records[i].name)
+            <<"\", \"count\": "<<records[i].count<<", \"seconds\": "
+            <<std::setprecision(9)<<records[i].seconds<<"}";
+    }
+    out<<"\n  ]\n}\n";
+}
+
+void reset()
+{
+    Registry& r{registry()};
+    std::lock_guard<std::mutex> lock{r.mutex};
+    for (auto& c: r.counters)
+        c.second->reset();
+}
+
+} // instr
@@ -0,0 +1,237 @@
+#include "kaon_c_api.h"
+
+#include "combination.h"
+#include "dispersiveintegral.h"
+#include "gsl_interface.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct kaon_dispersive {
+    disp::DispersiveIntegral integral;
+};
+
+struct kaon_combination {
+    comb::Combination combination;
+};
+
+namespace {
+thread_local std::string last_error;
+
+kaon_status fail(kaon_status status, const std::string& message)
+{
+    last_error = message;
+    return status;
+}
+
+template<class Body>
+kaon_status guarded(Body body)
+    // Run `body` and translate exceptions to status codes, since they must
+    // not cross the C interface.
+{
+    last_error.clear();
+    try {
+        body();
+        return KAON_OK;
+    }
+    catch (const std::invalid_argument& e) {
+        return fail(KAON_INVALID_ARGUMENT,e.what());
+    }
+    catch (const std::domain_error& e) {
+        return fail(KAON_DOMAIN_ERROR,e.what());
+    }
+    catch (const gsl::Domain_error& e) {
+        return fail(KAON_DOMAIN_ERROR,e.what());
+    }
+    catch (const gsl::Error& e) {
+        return fail(KAON_INTEGRATION_ERROR,e.what());
+    }
+    catch (const std::exception& e) {
+        return fail(KAON_RUNTIME_ERROR,e.what());
+    }
+    catch (...) {
+        return fail(KAON_UNKNOWN_ERROR,"unknown error");
+    }
+}
+
+void require(bool condition, const char* message)
+{
+    if (!condition)
+        throw std::invalid_argument{message};
+}
+
+template<class Handle, class Body>
+void parallel_for(const Handle& handle, std::size_t n, int threads,
+        Body body)
+    // Call `body(local,k)` for k in [0,n), where the points are split into
+    // contiguous blocks. Every thread works on its own copy `local` of
+    // `handle`, since the interpolation accelerators of GSL and the
+    // public state (e.g. DispersiveIntegral::err) must not be shared.
+{
+    if (!n)
+        return;
+    std::size_t workers{threads>0 ? static_cast<std::size_t>(threads)
+        : std::max(1u,std::thread::hardware_concurrency())};
+    workers = std::max<std::size_t>(1,std::min(workers,n));
+
+    std::vector<std::exception_ptr> errors(workers);
+    auto work = [&](std::size_t w)
+    {
+        try {
+            Handle local{handle};
+            for (std::size_t k=w*n/workers; k<(w+1)*n/workers; ++k)
+                body(local,k);
+        }
+        catch (...) {
+            errors[w] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (std::size_t w=1; w<workers; ++w)
+        pool.emplace_back(work,w);
+    work(0);
+    for (auto& t: pool)
+        t.join();
+    for (const auto& e: errors)
+        if (e)
+            std::rethrow_exception(e);
+}
+} // anonymous namespace
+
+extern "C" {
+
+int kaon_c_api_version(void)
+{
+    return KAON_C_API_VERSION;
+}
+
+const char* kaon_last_error(void)
+{
+    return last_error.c_str();
+}
+
+// -- DispersiveIntegral ------------------------------------------------------
+
+kaon_status kaon_dispersive_create(kaon_dispersive** handle)
+{
+    return guarded([&]
+    {
+        require(handle,"handle must not be NULL");
+        *handle = nullptr;
+        *handle = new kaon_dispersive{disp::DispersiveIntegral{1,0}};
+    });
+}
+
+void kaon_dispersive_destroy(kaon_dispersive* handle)
+{
+    delete handle;
+}
+
+kaon_status kaon_dispersive_evaluate(kaon_dispersive* handle, int num_sub,
+        int err, const double* s, size_t n, double* real, double* imag,
+        int threads)
+{
+    return guarded([&]
+    {
+        require(handle,"handle must not be NULL");
+        require(num_sub>=1,"num_sub must be greater or equal to 1");
+        require(err>=0 && err<=2,"err must be 0, 1 or 2");
+        require(!n || (s && real && imag),"buffers must not be NULL");
+        disp::DispersiveIntegral prototype{handle->integral};
+        prototype.num_sub = num_sub;
+        prototype.err = err;
+        prototype.set_cutoff();
+        parallel_for(prototype,n,threads,
+                [s,real,imag](disp::DispersiveIntegral& integral,
+                    std::size_t k)
+                {
+                    const Complex value{integral(s[k])};
+                    real[k] = value.real();
+                    imag[k] = value.imag();
+                });
+    });
+}
+
+kaon_status kaon_discontinuity_evaluate(kaon_dispersive* handle, int charged,
+        const double* s, size_t n, double* values, double* errors,
+        int threads)
+{
+    return guarded([&]
+    {
+        require(handle,"handle must not be NULL");
+        require(!n || (s && values),"buffers must not be NULL");
+        const disc::Discontinuity& discontinuity{charged
+            ? handle->integral.gammaKKpicdisc
+            : handle->integral.gammaKKpindisc};
+        parallel_for(discontinuity,n,threads,
+                [s,values,errors](disc::Discontinuity& d, std::size_t k)
+                {
+                    values[k] = d(s[k]);
+                    if (errors)
+                        errors[k] = d[s[k]];
+                });
+    });
+}
+
+// -- Combination -------------------------------------------------------------
+
+kaon_status kaon_combination_create(double a0, double a12, double b0,
+        double b12, kaon_combination** handle)
+{
+    return guarded([&]
+    {
+        require(handle,"handle must not be NULL");
+        *handle = nullptr;
+        // smax and step_size only concern Combination::output
+        *handle = new kaon_combination{
+            comb::Combination{a0,a12,b0,b12,2,0.001}};
+    });
+}
+
+void kaon_combination_destroy(kaon_combination* handle)
+{
+    delete handle;
+}
+
+kaon_status kaon_combination_evaluate(kaon_combination* handle, int i,
+        const double* s, size_t n, double* real, double* imag, int threads)
+{
+    return guarded([&]
+    {
+        require(handle,"handle must not be NULL");
+        require(i>=1 && i<=4,"i must be 1, 2, 3 or 4");
+        require(!n || (s && real && imag),"buffers must not be NULL");
+        parallel_for(handle->combination,n,threads,
+                [i,s,real,imag](comb::Combination& c, std::size_t k)
+                {
+                    const Complex value{c.f(i,s[k])};
+                    real[k] = value.real();
+                    imag[k] = value.imag();
+                });
+    });
+}
+
+kaon_status kaon_combination_evaluate_all(kaon_combination* handle,
+        const double* s, size_t n, double* real, double* imag, int threads)
+{
+    return guarded([&]
+    {
+        require(handle,"handle must not be NULL");
+        require(!n || (s && real && imag),"buffers must not be NULL");
+        parallel_for(handle->combination,n,threads,
+                [s,real,imag](comb::Combination& c, std::size_t k)
+                {
+                    const auto values{c.f_all(s[k])};
+                    for (std::size_t i=0; i<4; ++i) {
+                        real[4*k+i] = values[i].real();
+                        imag[4*k+i] = values[i].imag();
+                    }
+                });
+    });
+}
+
+} // extern "C"
@@ -0,0 +1,287 @@
+#include "multi_integration.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace multi {
+// -- Gauss-Kronrod rule ------------------------------------------------------
+
+namespace {
+// Abscissae and weights of the 7-15 point Gauss-Kronrod rule, taken from
+// QUADPACK (qk15). The Gauss points are the abscissae with odd index.
+constexpr std::array<double,8> xgk{
+    0.991455371120812639206854697526329,
+    0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926,
+    0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013,
+    0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245,
+    0.000000000000000000000000000000000};
+
+constexpr std::array<double,8> wgk{
+    0.022935322010529224963732008058970,
+    0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518,
+    0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550,
+    0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649,
+    0.209482141084727828012999174891714};
+
+constexpr std::array<double,4> wg{
+    0.129484966168869693270611432679082,
+    0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975,
+    0.417959183673469387755102040816327};
+
+constexpr std::size_t rule_size{15};
+
+constexpr double epsilon{std::numeric_limits<double>::epsilon()};
+
+/// A subinterval together with the integral of all components over it.
+struct Segment {
+    double lower;
+    double upper;
+    std::vector<double> values;
+    std::vector<double> errors;
+    std::vector<double> absolutes; // integral of the modulus
+};
+
+// Write the nodes of the rule for [lower,upper] to `x`.
+void nodes(double lower, double upper, double* x)
+{
+    const double center{0.5*(lower+upper)};
+    const double half{0.5*(upper-lower)};
+    x[0] = center;
+    for (std::size_t j=0; j<7; ++j) {
+        x[1+2*j] = center-half*xgk[j];
+        x[2+2*j] = center+half*xgk[j];
+    }
+}
+
+// Apply the rule to the values `f` (row-major, layout as given by `nodes`).
+void apply_rule(Segment& seg, const double* f, std::size_t dim)
+{
+    const double half{0.5*(seg.upper-seg.lower)};
+    seg.values.assign(dim,0.0);
+    seg.errors.assign(dim,0.0);
+    seg.absolutes.assign(dim,0.0);
+    for (std::size_t k=0; k<dim; ++k) {
+        const double fc{f[k]};
+        double kronrod{wgk[7]*fc};
+        double gauss{wg[3]*fc};
+        double absolute{wgk[7]*std::abs(fc)};
+        for (std::size_t j=0; j<7; ++j) {
+            const double f1{f[(1+2*j)*dim+k]};
+            const double f2{f[(2+2*j)*dim+k]};
+            kronrod += wgk[j]*(f1+f2);
+            absolute += wgk[j]*(std::abs(f1)+std::abs(f2));
+            if (j%2==1)
+                gauss += wg[j/2]*(f1+f2);
+        }
+        const double mean{0.5*kronrod};
+        double asc{wgk[7]*std::abs(fc-mean)};
+        for (std::size_t j=0; j<7; ++j)
+            asc += wgk[j]*(std::abs(f[(1+2*j)*dim+k]-mean)
+                    +std::abs(f[(2+2*j)*dim+k]-mean));
+
+        // error estimate as in QUADPACK
+        double error{std::abs((kronrod-gauss)*half)};
+        asc *= std::abs(half);
+        absolute *= std::abs(half);
+        if (asc!=0 && error!=0)
+            error = asc*std::min(1.,std::pow(200*error/asc,1.5));
+        if (absolute>std::numeric_limits<double>::min()/(50*epsilon))
+            error = std::max(50*epsilon*absolute,error);
+
+        seg.values[k] = kronrod*half;
+        seg.errors[k] = error;
+        seg.absolutes[k] = absolute;
+    }
+}
+
+/// @brief Map an infinite interval to [0,1], cf. `gsl::Cquad`, and count
+/// the evaluations of the integrand.
+class Mapped {
+public:
+    Mapped(const Function& f, std::size_t dim, double lower, double upper)
+        : f{f}, dim{dim}, lower{lower}, upper{upper}
+    {
+        const bool lower_inf{std::isinf(lower)};
+        const bool upper_inf{std::isinf(upper)};
+        if (lower_inf && upper_inf)
+            kind = Kind::both;
+        else if (lower_inf)
+            kind = Kind::lower;
+        else if (upper_inf)
+            kind = Kind::upper;
+    }
+
+    double front() const {return kind==Kind::finite ? lower : 0.0;}
+    double back() const {return kind==Kind::finite ? upper : 1.0;}
+    std::size_t evaluations() const noexcept {return count;}
+
+    void operator()(std::size_t n, const double* t, double* values)
+    {
+        if (kind==Kind::finite) {
+            f(n,t,values);
+            count += n;
+            return;
+        }
+        const std::size_t points{kind==Kind::both ? 2*n : n};
+        x.resize(points);
+        buffer.resize(points*dim);
+        for (std::size_t i=0; i<n; ++i) {
+            switch (kind) {
+                case Kind::both:
+                    x[i] = (1-t[i])/t[i];
+                    x[n+i] = (t[i]-1)/t[i];
+                    break;
+                case Kind::lower:
+                    x[i] = upper+(t[i]-1)/t[i];
+                    break;
+                case Kind::upper:
+                    x[i] = lower+(1-t[i])/t[i];
+                    break;
+                case Kind::finite:
+                    break;
+            }
+        }
+        f(points,x.data(),buffer.data());
+        count += points;
+        for (std::size_t i=0; i<n; ++i) {
+            const double jacobian{1./(t[i]*t[i])};
+            for (std::size_t k=0; k<dim; ++k) {
+                double value{buffer[i*dim+k]};
+                if (kind==Kind::both)
+                    value += buffer[(n+i)*dim+k];
+                values[i*dim+k] = value*jacobian;
+            }
+        }
+    }
+private:
+    enum class Kind {finite, lower, upper, both};
+
+    const Function& f;
+    std::size_t dim;
+    double lower;
+    double upper;
+    Kind kind{Kind::finite};
+    std::size_t count{0};
+    std::vector<double> x;
+    std::vector<double> buffer;
+};
+} // anonymous namespace
+
+// -- Integration -------------------------------------------------------------
+
+Integration::Integration(std::size_t dimension, const gsl::Settings& set)
+    : dim{dimension},
+    absolute_precision{set.absolute_precision},
+    relative_precision{set.relative_precision},
+    limit{set.space}
+{
+    if (!dim)
+        throw std::invalid_argument{"multi::Integration needs at least one \
+component"};
+}
+
+Result Integration::operator()(const Function& f, double lower,
+        double upper) const
+{
+    INSTR_COUNT("multi::Integration::operator()");
+    const int sign{gsl::signed_interval(lower,upper) ? 1 : -1};
+
+    Result result;
+    result.values.assign(dim,0.0);
+    result.errors.assign(dim,0.0);
+    if (lower==upper)
+        return result;
+
+    Mapped integrand{f,dim,lower,upper};
+    std::vector<double> x(2*rule_size);
+    std::vector<double> fx(2*rule_size*dim);
+
+    std::vector<Segment> segments(1);
+    segments[0].lower = integrand.front();
+    segments[0].upper = integrand.back();
+    nodes(segments[0].lower,segments[0].upper,x.data());
+    integrand(rule_size,x.data(),fx.data());
+    apply_rule(segments[0],fx.data(),dim);
+
+    std::vector<double> tolerance(dim);
+    std::vector<double> absolute(dim);
+    while (true) {
+        std::fill(result.values.begin(),result.values.end(),0.0);
+        std::fill(result.errors.begin(),result.errors.end(),0.0);
+        std::fill(absolute.begin(),absolute.end(),0.0);
+        for (const auto& seg: segments) {
+            for (std::size_t k=0; k<dim; ++k) {
+                result.values[k] += seg.values[k];
+                result.errors[k] += seg.errors[k];
+                absolute[k] += seg.absolutes[k];
+            }
+        }
+
+        bool converged{true};
+        for (std::size_t k=0; k<dim; ++k) {
+            tolerance[k] = std::max({absolute_precision,
+                    relative_precision*std::abs(result.values[k]),
+                    50*epsilon*absolute[k]});
+            if (result.errors[k]>tolerance[k])
+                converged = false;
+        }
+        if (converged)
+            break;
+        if (segments.size()>=limit)
+            throw gsl::Subdivision_error{"maximum number of subdivisions \
+reached in multi::Integration"};
+
+        // bisect the segment with the largest error relative to the
+        // requested accuracy of each component
+        std::size_t worst{0};
+        double largest{-1};
+        for (std::size_t i=0; i<segments.size(); ++i) {
+            for (std::size_t k=0; k<dim; ++k) {
+                if (tolerance[k]==0)
+                    continue;
+                const double ratio{segments[i].errors[k]/tolerance[k]};
+                if (ratio>largest) {
+                    largest = ratio;
+                    worst = i;
+                }
+            }
+        }
+
+        Segment left{segments[worst]};
+        Segment right{segments[worst]};
+        const double mid{0.5*(left.lower+left.upper)};
+        if (!(left.lower<mid && mid<left.upper))
+            throw gsl::Roundoff_error{"interval too small to be bisected in \
+multi::Integration"};
+        left.upper = mid;
+        right.lower = mid;
+
+        // both halves are evaluated in one call of the integrand
+        nodes(left.lower,left.upper,x.data());
+        nodes(right.lower,right.upper,x.data()+rule_size);
+        integrand(2*rule_size,x.data(),fx.data());
+        apply_rule(left,fx.data(),dim);
+        apply_rule(right,fx.data()+rule_size*dim,dim);
+
+        segments[worst] = std::move(left);
+        segments.push_back(std::move(right));
+    }
+
+    for (double& v: result.values)
+        v *= sign;
+    result.evaluations = integrand.evaluations();
+    INSTR_ADD("multi::Integration integrand evaluations",result.evaluations);
+    result.intervals = segments.size();
+    return result;
+}
+
+} // multi
@@ -0,0 +1,173 @@
+#include "pipeline.h"
+#include "instrumentation.h"
+
+#include <fstream>
+#include <stdexcept>
+
+namespace pipeline {
+
+namespace {
+// The splines are matched at this fixed point, such that "spline i" does not
+// depend on the matchpoint. "match i" continues them at the matchpoint.
+constexpr double spline_matchpoint{1.};
+} // anonymous namespace
+
+Pipeline::Pipeline()
+    : basis_stage{"basis",{&basis_},[this]
+        {
+            const Constants& c{constants_.get()};
+            auto combination = std::make_shared<comb::Combination>(c.a0,
+                    c.a12,c.b0,c.b12,2,0.001,false);
+            combination->use_basis(basis_.get());
+            combination->load();
+            return combination;
+        }},
+    data_stage{"data",{&constants_,&basis_},[this]{return compute_data();}}
+{
+    for (std::size_t k=0; k<2; ++k) {
+        spline_stage[k] = std::make_unique<Stage<input::gammaKKpi>>(
+                "spline "+std::to_string(k+1),std::vector<Node*>{&data_stage},
+                [this,k]
+                {
+                    const Amplitude& a{data_stage.get()[k]};
+                    return input::gammaKKpi{a.s,a.real,a.imag,
+                        spline_matchpoint};
+                });
+        match_stage[k] = std::make_unique<Stage<input::gammaKKpi>>(
+                "match "+std::to_string(k+1),
+                std::vector<Node*>{spline_stage[k].get(),&matchpoint_},
+                [this,k]{return compute_match(k);});
+    }
+    integral_stage = std::make_unique<Stage<disp::DispersiveIntegral>>(
+            "integral",std::vector<Node*>{match_stage[0].get(),
+            match_stage[1].get()},
+            [this]{return compute_integral();});
+}
+
+void Pipeline::set_basis(const std::string& name)
+{
+    comb::Registry::instance().set(name);
+    basis_.set(name);
+}
+
+comb::Combination& Pipeline::combination()
+{
+    return *basis_stage.get();
+}
+
+const std::array<Amplitude,2>& Pipeline::data()
+{
+    return data_stage.get();
+}
+
+const input::gammaKKpi& Pipeline::amplitude(int i)
+{
+    return match_stage[index(i)]->get();
+}
+
+input::gammaKKpi::Match Pipeline::match(int i)
+{
+    const input::gammaKKpi& amplitude{match_stage[index(i)]->get()};
+    return input::gammaKKpi::Match{amplitude.a,amplitude.b,amplitude.a_err,
+        amplitude.b_err};
+}
+
+disp::DispersiveIntegral& Pipeline::integral(int num_sub, int err)
+{
+    disp::DispersiveIntegral& result{integral_stage->get()};
+    result.num_sub = num_sub;
+    result.err = err;
+    result.set_cutoff();
+    return result;
+}
+
+std::map<std::string,std::size_t> Pipeline::computations() const
+{
+    std::map<std::string,std::size_t> result;
+    result[basis_stage.name()] = basis_stage.computations();
+    result[data_stage.name()] = data_stage.computations();
+    for (std::size_t k=0; k<2; ++k) {
+        result[spline_stage[k]->name()] = spline_stage[k]->computations();
+        result[match_stage[k]->name()] = match_stage[k]->computations();
+    }
+    result[integral_stage->name()] = integral_stage->computations();
+    return result;
+}
+
+std::array<Amplitude,2> Pipeline::compute_data()
+{
+    INSTR_SCOPE("pipeline::Pipeline::compute_data");
+    std::array<Amplitude,2> result;
+
+    // the files belong to the defaults, see input::gammaKKpi::readin
+    if (constants_.get()==Constants{} && basis_.get()=="standard") {
+        const std::string file1{input::gammaKKpi::file(1,false)};
+        const std::string file2{input::gammaKKpi::file(2,false)};
+        if (std::ifstream{file1} && std::ifstream{file2}) {
+            const comb::Combination defaults{0.9,1.0,-0.4,2.7,2,0.001,false};
+            try {
+                for (std::size_t k=0; k<2; ++k) {
+                    auto table = input::read_amplitude(k+1,defaults);
+                    result[k] = Amplitude{std::move(table[0]),
+                        std::move(table[1]),std::move(table[2])};
+                }
+                return result;
+            }
+            catch (const std::runtime_error&) {
+                // incomplete file, compute the amplitudes instead
+                result = {};
+            }
+        }
+    }
+
+    comb::Combination& combination{*basis_stage.get()};
+    const Constants& c{constants_.get()};
+    combination.a0 = c.a0;
+    combination.a12 = c.a12;
+    combination.b0 = c.b0;
+    combination.b12 = c.b12;
+    // the projection of Combination::output, which writes the files
+    const std::vector<double> grid{combination.grid()};
+    for (std::size_t k=0; k<2; ++k) {
+        result[k].s = grid;
+        for (double s: grid) {
+            const Complex value{combination.f(static_cast<int>(k)+1,s)};
+            result[k].real.push_back(value.real());
+            result[k].imag.push_back(value.imag());
+        }
+    }
+    return result;
+}
+
+input::gammaKKpi Pipeline::compute_match(std::size_t k)
+{
+    INSTR_SCOPE("pipeline::Pipeline::compute_match");
+    input::gammaKKpi amplitude{spline_stage[k]->get()};
+    const input::gammaKKpi::Match m{amplitude.match_at(matchpoint_.get())};
+    amplitude.matchpoint = matchpoint_.get();
+    amplitude.a = m.a;
+    amplitude.b = m.b;
+    amplitude.a_err = m.a_err;
+    amplitude.b_err = m.b_err;
+    return amplitude;
+}
+
+disp::DispersiveIntegral Pipeline::compute_integral()
+{
+    INSTR_SCOPE("pipeline::Pipeline::compute_integral");
+    input::gammaKKpi charged_amplitude{match_stage[0]->get()};
+    input::gammaKKpi neutral_amplitude{match_stage[1]->get()};
+    disc::Discontinuity charged{true,charged_amplitude,neutral_amplitude};
+    disc::Discontinuity neutral{false,std::move(charged_amplitude),
+        std::move(neutral_amplitude)};
+    return disp::DispersiveIntegral{1,0,std::move(charged),std::move(neutral)};
+}
+
+std::size_t Pipeline::index(int i)
+{
+    if (i<1 || i>2)
+        throw std::domain_error{"pipeline covers the amplitudes i=1,2 only"};
+    return static_cast<std::size_t>(i-1);
+}
+
+} // pipeline
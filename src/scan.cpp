@@ -0,0 +1,437 @@
+#include "scan.h"
+#include "basis.h"
+#include "checkpoint.h"
+#include "instrumentation.h"
+#include "kinematics.h"
+#include "snapshot.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace scan {
+
+namespace {
+constexpr char magic[8]{'K','A','O','N','S','C','A','N'};
+constexpr std::uint32_t version{1};
+
+double point_cost(double s)
+{
+    return s<kin::sth ? 1. : 2.;
+}
+} // anonymous namespace
+
+std::uint64_t Job::fingerprint() const
+{
+    snapshot::Writer out;
+    out.array(s);
+    for (const auto& v: variants) {
+        out.u64(static_cast<std::uint64_t>(v.num_sub));
+        out.u64(static_cast<std::uint64_t>(v.err));
+    }
+    for (const auto& p: parameters) {
+        out.f64(p.constants.a0);
+        out.f64(p.constants.a12);
+        out.f64(p.constants.b0);
+        out.f64(p.constants.b12);
+        out.string(p.basis);
+    }
+    return snapshot::checksum(out.buffer().data(),out.buffer().size());
+}
+
+Job Job::read(const std::string& path)
+{
+    std::ifstream in{path};
+    if (!in)
+        throw std::runtime_error{"could not open "+path};
+    Job job;
+    std::string line;
+    std::size_t number{0};
+    while (std::getline(in,line)) {
+        ++number;
+        line = line.substr(0,line.find('#'));
+        std::istringstream fields{line};
+        std::string key;
+        if (!(fields>>key))
+            continue;
+        auto fail = [&]
+        {
+            return std::runtime_error{path+":"+std::to_string(number)
+                +": malformed "+key};
+        };
+        if (key=="grid") {
+            double lower, upper, step;
+            if (!(fields>>lower>>upper>>step) || !(step>0) || upper<lower)
+                throw fail();
+            // relative to the step, such that rounding keeps the last point
+            for (std::size_t k=0; lower+k*step<=upper+1e-9*step; ++k)
+                job.s.push_back(lower+k*step);
+        }
+        else if (key=="points") {
+            double s;
+            while (fields>>s)
+                job.s.push_back(s);
+            if (!fields.eof())
+                throw fail();
+        }
+        else if (key=="variant") {
+            disp::Variant v;
+            if (!(fields>>v.num_sub>>v.err) || v.num_sub<1 || v.err<0
+                    || v.err>2)
+                throw fail();
+            job.variants.push_back(v);
+        }
+        else if (key=="parameters") {
+            Parameters p;
+            pipeline::Constants& c{p.constants};
+            if (!(fields>>c.a0>>c.a12>>c.b0>>c.b12))
+                throw fail();
+            std::string basis;
+            if (fields>>basis) {
+                const auto names{comb::Registry::instance().names()};
+                if (std::find(names.begin(),names.end(),basis)==names.end())
+                    throw std::runtime_error{path+":"+std::to_string(number)
+                        +": unknown basis set "+basis};
+                p.basis = basis;
+            }
+            job.parameters.push_back(p);
+        }
+        else if (key=="setup_cost") {
+            if (!(fields>>job.setup_cost) || job.setup_cost<0)
+                throw fail();
+        }
+        else {
+            throw std::runtime_error{path+":"+std::to_string(number)
+                +": unknown entry "+key};
+        }
+    }
+    if (job.variants.empty())
+        job.variants.push_back(disp::Variant{1,0});
+    if (job.parameters.empty())
+        job.parameters.push_back(Parameters{});
+    return job;
+}
+
+namespace {
+// Cost of the points [begin,end) from the cumulative point costs
+double cost(const Job& job, const std::vector<double>& cumulative,
+        std::size_t begin, std::size_t end)
+{
+    if (!(begin<end))
+        return 0.;
+    const std::size_t n{job.s.size()};
+    return cumulative[end]-cumulative[begin]
+        +job.setup_cost*((end-1)/n-begin/n+1);
+}
+
+std::vector<double> cumulative_cost(const Job& job)
+{
+    std::vector<double> result(job.size()+1,0.);
+    for (std::size_t k=0; k<job.size(); ++k)
+        result[k+1] = result[k]+point_cost(job.s[k%job.s.size()]);
+    return result;
+}
+} // anonymous namespace
+
+double cost(const Job& job, std::size_t begin, std::size_t end)
+{
+    return cost(job,cumulative_cost(job),begin,end);
+}
+
+std::vector<Shard> partition(const Job& job, std::size_t count)
+{
+    const std::size_t n{job.size()};
+    if (!count || n<count)
+        throw std::invalid_argument{"scan needs at least one point per shard"};
+    const auto cumulative{cumulative_cost(job)};
+
+    // end of the longest shard starting at `begin` whose cost does not
+    // exceed `bound`, at least one point
+    auto extend = [&](std::size_t begin, double bound)
+    {
+        std::size_t lower{begin+1};
+        std::size_t upper{n};
+        while (lower<upper) {
+            const std::size_t middle{upper-(upper-lower)/2};
+            if (cost(job,cumulative,begin,middle)<=bound)
+                lower = middle;
+            else
+                upper = middle-1;
+        }
+        return lower;
+    };
+    auto feasible = [&](double bound)
+    {
+        std::size_t shards{0};
+        for (std::size_t begin{0}; begin<n; ++shards) {
+            const std::size_t end{extend(begin,bound)};
+            if (cost(job,cumulative,begin,end)>bound || shards==count)
+                return false;
+            begin = end;
+        }
+        return true;
+    };
+
+    // Bisect the smallest bound on the cost of the most expensive shard. A
+    // shard starting within a parameter set pays its setup again, hence
+    // the shards end preferably at the edges of the sets.
+    double lower{0};
+    double upper{cost(job,cumulative,0,n)};
+    for (int i=0; i<100 && upper-lower>1e-9*upper; ++i) {
+        const double middle{0.5*(lower+upper)};
+        (feasible(middle) ? upper : lower) = middle;
+    }
+
+    std::vector<Shard> shards;
+    std::size_t begin{0};
+    for (std::size_t i=0; i<count; ++i) {
+        // leave at least one point for each remaining shard
+        const std::size_t end{i+1<count ? std::min(extend(begin,upper),
+                n-(count-i-1)) : n};
+        shards.push_back(Shard{i,count,begin,end});
+        begin = end;
+    }
+    return shards;
+}
+
+std::string partial_path(const std::string& directory, const Shard& shard)
+{
+    return directory+"/shard-"+std::to_string(shard.index)+"-of-"
+        +std::to_string(shard.count)+".bin";
+}
+
+Partial run_shard(const Job& job, const Shard& shard,
+        const std::string& checkpoint)
+{
+    INSTR_SCOPE("scan::run_shard");
+    Partial result{job.fingerprint(),shard,{}};
+    const std::size_t m{job.variants.size()};
+    result.values.reserve((shard.end-shard.begin)*m);
+
+    // the checkpoint belongs to the job and the points of the shard
+    const std::uint64_t range[]{shard.begin,shard.end};
+    std::unique_ptr<checkpoint::Progress> progress;
+    std::size_t begin{shard.begin};
+    if (!checkpoint.empty()) {
+        progress = std::make_unique<checkpoint::Progress>(checkpoint,
+                snapshot::checksum(range,sizeof(range),result.fingerprint),
+                2*m);
+        const auto& saved{progress->values()};
+        for (std::size_t i=0; i<saved.size(); i+=2)
+            result.values.emplace_back(saved[i],saved[i+1]);
+        begin += std::min(progress->done(),shard.end-shard.begin);
+    }
+
+    const std::size_t n{job.s.size()};
+    pipeline::Pipeline chain;
+    std::vector<double> point(2*m);
+    for (std::size_t k=begin; k<shard.end; ++k) {
+        const Parameters& p{job.parameters[k/n]};
+        chain.set_constants(p.constants);
+        chain.set_basis(p.basis);
+        const auto values{chain.integral(1,0).evaluate(job.s[k%n],
+                job.variants)};
+        result.values.insert(result.values.end(),values.begin(),
+                values.end());
+        if (progress) {
+            for (std::size_t j=0; j<m; ++j) {
+                point[2*j] = values[j].real();
+                point[2*j+1] = values[j].imag();
+            }
+            progress->add(point.data());
+        }
+    }
+    return result;
+}
+
+void complete_shard(const Job& job, const std::string& directory,
+        const Shard& shard)
+{
+    const std::string path{partial_path(directory,shard)};
+    write_partial(path,run_shard(job,shard,path+".checkpoint"));
+    std::remove((path+".checkpoint").c_str());
+}
+
+void write_partial(const std::string& path, const Partial& partial)
+{
+    snapshot::Writer out;
+    out.u64(partial.fingerprint);
+    out.u64(partial.shard.index);
+    out.u64(partial.shard.count);
+    out.u64(partial.shard.begin);
+    out.u64(partial.shard.end);
+    std::vector<double> flat;
+    flat.reserve(2*partial.values.size());
+    for (const auto& v: partial.values) {
+        flat.push_back(v.real());
+        flat.push_back(v.imag());
+    }
+    out.array(flat);
+    snapshot::write_file(path,magic,version,out);
+}
+
+Partial read_partial(const std::string& path)
+{
+    const snapshot::Mapping file{path};
+    snapshot::Reader in{snapshot::open_file(file,magic,version,path)};
+    Partial result;
+    result.fingerprint = in.u64();
+    result.shard.index = in.u64();
+    result.shard.count = in.u64();
+    result.shard.begin = in.u64();
+    result.shard.end = in.u64();
+    const auto flat{in.array()};
+    if (!in.done() || flat.size()%2)
+        throw snapshot::Error{path+" is not a consistent partial result"};
+    result.values.resize(flat.size()/2);
+    for (std::size_t i=0; i<result.values.size(); ++i)
+        result.values[i] = Complex{flat[2*i],flat[2*i+1]};
+    return result;
+}
+
+namespace {
+// Throws std::runtime_error unless `partial` is the result of `shard`.
+void validate(const Job& job, const Shard& shard, const Partial& partial,
+        const std::string& path)
+{
+    if (partial.fingerprint!=job.fingerprint())
+        throw std::runtime_error{path+" belongs to another job"};
+    if (partial.shard.index!=shard.index || partial.shard.count!=shard.count
+            || partial.shard.begin!=shard.begin
+            || partial.shard.end!=shard.end)
+        throw std::runtime_error{path+" covers points ["
+            +std::to_string(partial.shard.begin)+","
+            +std::to_string(partial.shard.end)+"), expected ["
+            +std::to_string(shard.begin)+","+std::to_string(shard.end)+")"};
+    if (partial.values.size()!=(shard.end-shard.begin)*job.variants.size())
+        throw std::runtime_error{path+" has the wrong number of values"};
+}
+} // anonymous namespace
+
+bool has_partial(const Job& job, const std::string& directory,
+        const Shard& shard)
+{
+    const std::string path{partial_path(directory,shard)};
+    try {
+        validate(job,shard,read_partial(path),path);
+        return true;
+    }
+    catch (const std::runtime_error&) {
+        return false;
+    }
+}
+
+Table merge(const Job& job, const std::string& directory, std::size_t count)
+{
+    INSTR_SCOPE("scan::merge");
+    Table table{job,{}};
+    table.values.reserve(job.size()*job.variants.size());
+    std::vector<std::string> missing;
+    for (const auto& shard: partition(job,count)) {
+        const std::string path{partial_path(directory,shard)};
+        Partial partial;
+        try {
+            partial = read_partial(path);
+        }
+        catch (const snapshot::Error&) {
+            missing.push_back(std::to_string(shard.index));
+            continue;
+        }
+        validate(job,shard,partial,path);
+        table.values.insert(table.values.end(),partial.values.begin(),
+                partial.values.end());
+    }
+    if (!missing.empty()) {
+        std::string list;
+        for (const auto& m: missing)
+            list += (list.empty() ? "" : ",")+m;
+        throw std::runtime_error{"missing or corrupt partial results of \
+shards "+list};
+    }
+    return table;
+}
+
+void Table::write(const std::string& path) const
+{
+    std::ostringstream out;
+    out<<std::setprecision(std::numeric_limits<double>::max_digits10);
+    out<<"# parameter set, s";
+    for (const auto& v: job.variants)
+        out<<", f(num_sub="<<v.num_sub<<",err="<<v.err<<")";
+    out<<'\n';
+    const std::size_t n{job.s.size()};
+    const std::size_t m{job.variants.size()};
+    for (std::size_t k=0; k<job.size(); ++k) {
+        out<<k/n<<'\t'<<job.s[k%n];
+        for (std::size_t j=0; j<m; ++j)
+            out<<'\t'<<values[k*m+j].real()<<'\t'<<values[k*m+j].imag();
+        out<<'\n';
+    }
+    checkpoint::commit(path,out.str(),job.size(),job.fingerprint());
+}
+
+std::vector<std::size_t> run_local(const Job& job, const Options& options)
+{
+    INSTR_SCOPE("scan::run_local");
+    std::vector<Shard> open;
+    for (const auto& shard: partition(job,options.shards))
+        if (!has_partial(job,options.directory,shard))
+            open.push_back(shard);
+
+    const std::size_t workers{std::max<std::size_t>(1,options.workers)};
+    std::map<pid_t,std::size_t> running;
+    std::vector<std::size_t> failed;
+    auto wait_one = [&]
+    {
+        int status{0};
+        const pid_t pid{waitpid(-1,&status,0)};
+        if (pid<0)
+            throw std::runtime_error{"waitpid failed"};
+        const auto it{running.find(pid)};
+        if (it==running.end())
+            return;
+        if (!WIFEXITED(status) || WEXITSTATUS(status))
+            failed.push_back(it->second);
+        running.erase(it);
+    };
+    for (const auto& shard: open) {
+        while (running.size()>=workers)
+            wait_one();
+        std::cout.flush();
+        std::cerr.flush();
+        const pid_t pid{fork()};
+        if (pid<0)
+            throw std::runtime_error{"could not fork"};
+        if (pid==0) {
+            int code{EXIT_SUCCESS};
+            try {
+                complete_shard(job,options.directory,shard);
+            }
+            catch (const std::exception& e) {
+                std::cerr<<"shard "<<shard.index<<": "<<e.what()<<'\n';
+                code = EXIT_FAILURE;
+            }
+            std::cerr.flush();
+            _exit(code);
+        }
+        running[pid] = shard.index;
+    }
+    while (!running.empty())
+        wait_one();
+    std::sort(failed.begin(),failed.end());
+    return failed;
+}
+
+} // scan
@@ -0,0 +1,312 @@
+#include "server.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+
+namespace server {
+// -- Instances ---------------------------------------------------------------
+
+Instances::Lease::~Lease()
+{
+    if (!instance)
+        return;
+    std::lock_guard<std::mutex> lock{pool->mutex};
+    pool->entries.at(key).idle.push_back(std::move(instance));
+}
+
+Instances::Entry& Instances::entry(const Key& key)
+{
+    if (key.first<1)
+        throw std::invalid_argument{"num_sub must be greater or equal to 1"};
+    if (key.second<0 || key.second>2)
+        throw std::invalid_argument{"err must be 0, 1 or 2"};
+    std::lock_guard<std::mutex> lock{mutex};
+    return entries[key];
+}
+
+void Instances::preload(int num_sub, int err)
+{
+    Entry& e{entry({num_sub,err})};
+    // the input files are read once per key, outside of the lock such that
+    // other keys are served meanwhile
+    std::call_once(e.loaded,[&]
+    {
+        auto prototype{std::make_unique<disp::DispersiveIntegral>(num_sub,
+                err)};
+        std::lock_guard<std::mutex> lock{mutex};
+        e.prototype = std::move(prototype);
+        ++constructed;
+    });
+}
+
+Instances::Lease Instances::acquire(int num_sub, int err)
+{
+    const Key key{num_sub,err};
+    preload(num_sub,err);
+    Entry& e{entry(key)};
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (!e.idle.empty()) {
+            auto instance{std::move(e.idle.back())};
+            e.idle.pop_back();
+            return Lease{*this,key,std::move(instance)};
+        }
+    }
+    // the prototype is never evaluated, copying it concurrently is safe
+    auto instance{std::make_unique<disp::DispersiveIntegral>(*e.prototype)};
+    std::lock_guard<std::mutex> lock{mutex};
+    ++constructed;
+    return Lease{*this,key,std::move(instance)};
+}
+
+std::size_t Instances::size() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return constructed;
+}
+
+// -- Server ------------------------------------------------------------------
+
+namespace {
+[[noreturn]] void fail(const std::string& what)
+{
+    throw std::system_error{errno,std::generic_category(),what};
+}
+
+bool send_error(int fd, Status status, const std::string& message)
+{
+    Response response;
+    response.status = status;
+    response.message_length = message.size();
+    return write_all(fd,&response,sizeof(response))
+        && write_all(fd,message.data(),message.size());
+}
+} // anonymous namespace
+
+Server::Server(Options options)
+    : options{std::move(options)}
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (this->options.path.empty()
+            || this->options.path.size()>=sizeof(address.sun_path))
+        throw std::invalid_argument{"invalid socket path "
+            +this->options.path};
+    std::strcpy(address.sun_path,this->options.path.c_str());
+
+    // remove a socket left behind by a previous run, but nothing else
+    struct stat info;
+    if (::stat(address.sun_path,&info)==0) {
+        if (!S_ISSOCK(info.st_mode))
+            throw std::runtime_error{this->options.path
+                +" exists and is not a socket"};
+        ::unlink(address.sun_path);
+    }
+
+    listener = ::socket(AF_UNIX,SOCK_STREAM|SOCK_CLOEXEC,0);
+    if (listener<0)
+        fail("socket");
+    if (::bind(listener,reinterpret_cast<sockaddr*>(&address),
+                sizeof(address))<0 || ::listen(listener,128)<0) {
+        const int error{errno};
+        ::close(listener);
+        errno = error;
+        fail("bind "+this->options.path);
+    }
+    if (::pipe2(wake,O_CLOEXEC|O_NONBLOCK)<0) {
+        ::close(listener);
+        fail("pipe");
+    }
+
+    if (!this->options.workers)
+        this->options.workers = std::max(1u,
+                std::thread::hardware_concurrency());
+    for (const auto& key: this->options.preload)
+        pool.preload(key.first,key.second);
+}
+
+Server::~Server()
+{
+    ::close(listener);
+    ::unlink(options.path.c_str());
+    ::close(wake[0]);
+    ::close(wake[1]);
+}
+
+void Server::stop() noexcept
+{
+    stop_requested = true;
+    const char c{'s'};
+    [[maybe_unused]] const ssize_t r{::write(wake[1],&c,1)};
+}
+
+void Server::run()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = false;
+    }
+    std::vector<std::thread> workers;
+    for (std::size_t i=0; i<options.workers; ++i)
+        workers.emplace_back([this]{work();});
+
+    std::vector<int> watched; // idle connections waiting for a request
+    std::vector<pollfd> fds;
+    while (!stop_requested) {
+        fds.clear();
+        fds.push_back({wake[0],POLLIN,0});
+        fds.push_back({listener,POLLIN,0});
+        for (int fd: watched)
+            fds.push_back({fd,POLLIN,0});
+        if (::poll(fds.data(),fds.size(),-1)<0) {
+            if (errno==EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[0].revents) {
+            char buffer[64];
+            while (::read(wake[0],buffer,sizeof(buffer))>0) {}
+            std::lock_guard<std::mutex> lock{mutex};
+            watched.insert(watched.end(),idle.begin(),idle.end());
+            idle.clear();
+        }
+        if (fds[1].revents&POLLIN) {
+            const int fd{::accept4(listener,nullptr,nullptr,SOCK_CLOEXEC)};
+            if (fd>=0)
+                watched.push_back(fd);
+        }
+
+        std::vector<int> requests;
+        for (std::size_t i=2; i<fds.size(); ++i) {
+            if (fds[i].revents) {
+                requests.push_back(fds[i].fd);
+                watched.erase(std::find(watched.begin(),watched.end(),
+                            fds[i].fd));
+            }
+        }
+        if (!requests.empty()) {
+            std::lock_guard<std::mutex> lock{mutex};
+            pending.insert(pending.end(),requests.begin(),requests.end());
+            ready.notify_all();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    ready.notify_all();
+    for (auto& w: workers)
+        w.join();
+    for (int fd: watched)
+        ::close(fd);
+    for (int fd: idle)
+        ::close(fd);
+    for (int fd: pending)
+        ::close(fd);
+    idle.clear();
+    pending.clear();
+    stop_requested = false;
+}
+
+void Server::work()
+{
+    while (true) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            ready.wait(lock,[this]{return stopping || !pending.empty();});
+            if (stopping)
+                return;
+            fd = pending.front();
+            pending.pop_front();
+        }
+        if (answer(fd))
+            release(fd);
+        else
+            ::close(fd);
+    }
+}
+
+void Server::release(int fd)
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    idle.push_back(fd);
+    const char c{'r'};
+    [[maybe_unused]] const ssize_t r{::write(wake[1],&c,1)};
+}
+
+bool Server::answer(int fd)
+    // Answer one request, return false if the connection is to be closed.
+{
+    Request request;
+    if (!read_all(fd,&request,sizeof(request)))
+        return false;
+    if (request.magic!=magic || request.version!=version)
+        return send_error(fd,Status::bad_request,"unknown protocol"),false;
+    if (request.n>max_points)
+        return send_error(fd,Status::bad_request,"too many points"),false;
+
+    std::vector<double> s(request.n);
+    if (!read_all(fd,s.data(),s.size()*sizeof(double)))
+        return false;
+
+    Response response;
+    response.n = request.n;
+    std::vector<double> result(2*request.n);
+    try {
+        switch (request.kind) {
+            case Kind::ping:
+                response.n = 0;
+                result.clear();
+                break;
+            case Kind::dispersive: {
+                const auto integral{pool.acquire(request.num_sub,
+                        request.err)};
+                for (std::size_t k=0; k<s.size(); ++k) {
+                    const Complex value{(*integral)(s[k])};
+                    result[k] = value.real();
+                    result[s.size()+k] = value.imag();
+                }
+                break;
+            }
+            case Kind::discontinuity: {
+                if (request.charged!=0 && request.charged!=1)
+                    throw std::invalid_argument{"charged must be 0 or 1"};
+                const auto integral{pool.acquire(1,0)};
+                disc::Discontinuity& d{request.charged
+                    ? integral->gammaKKpicdisc : integral->gammaKKpindisc};
+                for (std::size_t k=0; k<s.size(); ++k) {
+                    result[k] = d(s[k]);
+                    result[s.size()+k] = d[s[k]];
+                }
+                break;
+            }
+            default:
+                return send_error(fd,Status::bad_request,
+                        "unknown request kind");
+        }
+    }
+    catch (const std::invalid_argument& e) {
+        return send_error(fd,Status::bad_request,e.what());
+    }
+    catch (const std::exception& e) {
+        return send_error(fd,Status::evaluation_error,e.what());
+    }
+    return write_all(fd,&response,sizeof(response))
+        && write_all(fd,result.data(),result.size()*sizeof(double));
+}
+
+} // server
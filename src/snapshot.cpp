@@ -0,0 +1,308 @@
+#include "snapshot.h"
+#include "instrumentation.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace snapshot {
+
+namespace {
+constexpr char magic[8]{'K','A','O','N','S','N','A','P'};
+constexpr std::uint32_t byte_order{0x01020304};
+
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t payload_size;
+    std::uint64_t payload_checksum;
+    std::uint64_t reserved;
+};
+
+void write_amplitude(Writer& out, const input::gammaKKpi& amplitude)
+{
+    // the lists of a compacted amplitude are taken from its interpolators
+    const input::gammaKKpi::State state{amplitude.state()};
+    out.f64(state.a);
+    out.f64(state.b);
+    out.f64(state.a_err);
+    out.f64(state.b_err);
+    out.f64(state.matchpoint);
+    out.u64(static_cast<std::uint64_t>(state.precision));
+    out.u64(state.compacted);
+    for (const auto* v: {&state.s_list,&state.real_list,&state.imag_list,
+            &state.real_err_list,&state.imag_err_list,&state.abs_list,
+            &state.abs_err_list})
+        out.array(*v);
+}
+
+input::gammaKKpi read_amplitude(Reader& in)
+{
+    input::gammaKKpi::State state;
+    state.a = in.f64();
+    state.b = in.f64();
+    state.a_err = in.f64();
+    state.b_err = in.f64();
+    state.matchpoint = in.f64();
+    const std::uint64_t precision{in.u64()};
+    if (precision>static_cast<std::uint64_t>(gsl::Precision::single_precision))
+        throw Error{"unknown precision of amplitude in snapshot"};
+    state.precision = static_cast<gsl::Precision>(precision);
+    state.compacted = in.u64()!=0;
+    for (auto* v: {&state.s_list,&state.real_list,&state.imag_list,
+            &state.real_err_list,&state.imag_err_list,&state.abs_list,
+            &state.abs_err_list})
+        *v = in.array();
+    if (state.abs_list.size()!=state.s_list.size()
+            || state.abs_err_list.size()!=state.s_list.size())
+        throw Error{"inconsistent amplitude in snapshot"};
+    return input::gammaKKpi{std::move(state)};
+}
+
+void write_discontinuity(Writer& out, const disc::Discontinuity& d)
+{
+    out.u64(d.charged_kaon_int);
+    out.f64(d.sth);
+    write_amplitude(out,d.absgammaKKpic);
+    write_amplitude(out,d.absgammaKKpin);
+}
+
+disc::Discontinuity read_discontinuity(Reader& in)
+{
+    const bool charged{in.u64()!=0};
+    const double sth{in.f64()};
+    input::gammaKKpi c{read_amplitude(in)};
+    input::gammaKKpi n{read_amplitude(in)};
+    disc::Discontinuity d{charged,std::move(c),std::move(n)};
+    d.sth = sth;
+    return d;
+}
+} // anonymous namespace
+
+std::uint64_t checksum(const void* data, std::size_t size, std::uint64_t seed)
+{
+    const unsigned char* p{static_cast<const unsigned char*>(data)};
+    std::uint64_t hash{seed};
+    for (std::size_t i=0; i<size; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+Source source(const std::string& path)
+{
+    std::ifstream in{path,std::ios::binary};
+    if (!in)
+        throw Stale_error{"could not read input file "+path};
+    const std::string content{std::istreambuf_iterator<char>{in},
+        std::istreambuf_iterator<char>{}};
+    return Source{path,content.size(),checksum(content.data(),
+            content.size())};
+}
+
+std::vector<Source> sources()
+{
+    // disc::Discontinuity uses the amplitudes 1 and 2 without uncertainties
+    return {source(input::gammaKKpi::file(1,false)),
+        source(input::gammaKKpi::file(2,false))};
+}
+
+void save(const disp::DispersiveIntegral& integral, const std::string& path)
+{
+    INSTR_SCOPE("snapshot::save");
+    Writer out;
+    out.sources(sources());
+    out.u64(static_cast<std::uint64_t>(integral.num_sub));
+    out.u64(static_cast<std::uint64_t>(integral.err));
+    out.f64(integral.sth);
+    out.f64(integral.multiply);
+    out.f64(integral.cutoff);
+    out.f64(integral.subtraction_point);
+    write_discontinuity(out,integral.gammaKKpicdisc);
+    write_discontinuity(out,integral.gammaKKpindisc);
+    write_file(path,magic,version,out);
+}
+
+disp::DispersiveIntegral restore(const std::string& path, bool verify_sources)
+{
+    INSTR_SCOPE("snapshot::restore");
+    const Mapping file{path};
+    Reader in{open_file(file,magic,version,path)};
+    in.sources(path,verify_sources);
+
+    const int num_sub{static_cast<int>(in.u64())};
+    const int err{static_cast<int>(in.u64())};
+    const double sth{in.f64()};
+    const double multiply{in.f64()};
+    const double cutoff{in.f64()};
+    const double subtraction_point{in.f64()};
+    disc::Discontinuity charged{read_discontinuity(in)};
+    disc::Discontinuity neutral{read_discontinuity(in)};
+    if (!in.done())
+        throw Error{"snapshot "+path+" has trailing data"};
+
+    disp::DispersiveIntegral integral{num_sub,err,std::move(charged),
+        std::move(neutral)};
+    integral.sth = sth;
+    integral.multiply = multiply;
+    integral.cutoff = cutoff;
+    integral.subtraction_point = subtraction_point;
+    return integral;
+}
+
+disp::DispersiveIntegral load_or_build(const std::string& path, int num_sub,
+        int err)
+{
+    try {
+        disp::DispersiveIntegral integral{restore(path)};
+        // the stored state does not depend on num_sub and err
+        integral.num_sub = num_sub;
+        integral.err = err;
+        integral.set_cutoff();
+        return integral;
+    }
+    catch (const Error&) {
+    }
+    disp::DispersiveIntegral integral{num_sub,err};
+    save(integral,path);
+    return integral;
+}
+
+// -- Building blocks ---------------------------------------------------------
+
+void Writer::sources(const std::vector<Source>& inputs)
+{
+    u64(inputs.size());
+    for (const auto& s: inputs) {
+        string(s.path);
+        u64(s.size);
+        u64(s.checksum);
+    }
+}
+
+std::string Reader::string()
+{
+    const std::uint64_t n{u64()};
+    need(n);
+    std::string s{pos,static_cast<std::size_t>(n)};
+    pos += n;
+    const std::size_t offset(pos-begin);
+    const std::size_t padding{(8-offset%8)%8};
+    need(padding);
+    pos += padding;
+    return s;
+}
+
+std::vector<double> Reader::array()
+{
+    const std::uint64_t n{u64()};
+    if (n>static_cast<std::uint64_t>(end-pos)/sizeof(double))
+        throw Error{"snapshot truncated"};
+    std::vector<double> v(n);
+    std::memcpy(v.data(),pos,n*sizeof(double));
+    pos += n*sizeof(double);
+    return v;
+}
+
+void Reader::sources(const std::string& path, bool verify)
+{
+    const std::uint64_t count{u64()};
+    for (std::uint64_t i=0; i<count; ++i) {
+        Source stored;
+        stored.path = string();
+        stored.size = u64();
+        stored.checksum = u64();
+        if (verify) {
+            const Source current{source(stored.path)};
+            if (current.size!=stored.size
+                    || current.checksum!=stored.checksum)
+                throw Stale_error{stored.path+" changed since "+path
+                    +" was written"};
+        }
+    }
+}
+
+Mapping::Mapping(const std::string& path)
+{
+    const int fd{::open(path.c_str(),O_RDONLY|O_CLOEXEC)};
+    if (fd<0)
+        throw Error{"could not open "+path};
+    struct stat info;
+    if (::fstat(fd,&info)<0) {
+        ::close(fd);
+        throw Error{"could not stat "+path};
+    }
+    length = info.st_size;
+    if (length) {
+        address = ::mmap(nullptr,length,PROT_READ,MAP_PRIVATE,fd,0);
+        if (address==MAP_FAILED) {
+            address = nullptr;
+            ::close(fd);
+            throw Error{"could not map "+path};
+        }
+    }
+    ::close(fd);
+}
+
+Mapping::~Mapping()
+{
+    if (address)
+        ::munmap(address,length);
+}
+
+void write_file(const std::string& path, const char (&magic)[8],
+        std::uint32_t version, const Writer& payload)
+{
+    Header header{};
+    std::memcpy(header.magic,magic,sizeof(magic));
+    header.version = version;
+    header.byte_order = byte_order;
+    header.payload_size = payload.buffer().size();
+    header.payload_checksum = checksum(payload.buffer().data(),
+            payload.buffer().size());
+
+    const std::string temporary{path+".tmp"};
+    {
+        std::ofstream file{temporary,std::ios::binary|std::ios::trunc};
+        file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+        file.write(payload.buffer().data(),payload.buffer().size());
+        if (!file)
+            throw Error{"could not write "+temporary};
+    }
+    if (std::rename(temporary.c_str(),path.c_str()))
+        throw Error{"could not rename "+temporary+" to "+path};
+}
+
+Reader open_file(const Mapping& file, const char (&magic)[8],
+        std::uint32_t version, const std::string& path)
+{
+    Header header;
+    if (file.size()<sizeof(header))
+        throw Error{path+" is truncated"};
+    std::memcpy(&header,file.data(),sizeof(header));
+    if (std::memcmp(header.magic,magic,sizeof(magic)))
+        throw Error{path+" has the wrong file type"};
+    if (header.version!=version || header.byte_order!=byte_order) {
+        std::ostringstream message;
+        message<<path<<" has version "<<header.version<<", expected "
+            <<version<<" in native byte order";
+        throw Error{message.str()};
+    }
+    const char* payload{file.data()+sizeof(header)};
+    if (header.payload_size!=file.size()-sizeof(header)
+            || header.payload_checksum!=checksum(payload,
+                header.payload_size))
+        throw Error{path+" is corrupt"};
+    return Reader{payload,header.payload_size};
+}
+
+} // snapshot
@@ -0,0 +1,316 @@
+#include "surrogate.h"
+#include "constants.h"
+#include "instrumentation.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace disp {
+
+namespace {
+constexpr char magic[8]{'K','A','O','N','S','U','R','R'};
+constexpr std::uint32_t version{1};
+
+struct Panel {
+    double lower;
+    double upper;
+    std::vector<Complex> coefficients;
+    bool converged{true};
+};
+
+/// Evaluates the integral at many points in parallel, every thread on its
+/// own copy, since `DispersiveIntegral` is not thread-safe.
+class Workers {
+public:
+    Workers(const DispersiveIntegral& prototype, std::size_t threads)
+    {
+        if (!threads)
+            threads = std::max(1u,std::thread::hardware_concurrency());
+        copies.reserve(threads);
+        for (std::size_t i=0; i<threads; ++i) {
+            copies.push_back(prototype);
+            copies.back().disable_surrogate();
+        }
+    }
+
+    std::vector<Complex> operator()(const std::vector<double>& s)
+    {
+        std::vector<Complex> values(s.size());
+        const std::size_t n{std::min(copies.size(),s.size())};
+        std::vector<std::exception_ptr> errors(n);
+        auto work = [&](std::size_t w)
+        {
+            try {
+                for (std::size_t k=w*s.size()/n; k<(w+1)*s.size()/n; ++k)
+                    values[k] = copies[w](s[k]);
+            }
+            catch (...) {
+                errors[w] = std::current_exception();
+            }
+        };
+        std::vector<std::thread> pool;
+        for (std::size_t w=1; w<n; ++w)
+            pool.emplace_back(work,w);
+        if (n)
+            work(0);
+        for (auto& t: pool)
+            t.join();
+        for (const auto& e: errors)
+            if (e)
+                std::rethrow_exception(e);
+        return values;
+    }
+private:
+    std::vector<DispersiveIntegral> copies;
+};
+
+// Chebyshev nodes of the first kind on [-1,1]. They exclude the end points,
+// such that the integral is never evaluated exactly at the threshold.
+std::vector<double> chebyshev_nodes(std::size_t n)
+{
+    std::vector<double> x(n);
+    for (std::size_t j=0; j<n; ++j)
+        x[j] = std::cos(constants::pi()*(j+0.5)/n);
+    return x;
+}
+
+std::vector<Complex> chebyshev_coefficients(const Complex* f, std::size_t n)
+{
+    std::vector<Complex> c(n);
+    for (std::size_t k=0; k<n; ++k) {
+        Complex sum{0};
+        for (std::size_t j=0; j<n; ++j)
+            sum += f[j]*std::cos(constants::pi()*k*(j+0.5)/n);
+        c[k] = sum*(2./n);
+    }
+    c[0] *= 0.5;
+    return c;
+}
+
+Complex clenshaw(const Complex* c, std::size_t n, double x)
+{
+    Complex b1{0};
+    Complex b2{0};
+    for (std::size_t k=n-1; k>0; --k) {
+        const Complex b0{2*x*b1-b2+c[k]};
+        b2 = b1;
+        b1 = b0;
+    }
+    return c[0]+x*b1-b2;
+}
+
+double tolerance(const Surrogate::Options& options, double scale)
+{
+    return options.absolute+options.relative*scale;
+}
+
+// Evaluate all panels at their nodes and decide which are converged.
+// Returns the panels that have to be bisected.
+std::vector<Panel> fit(std::vector<Panel>& panels, Workers& workers,
+        const Surrogate::Options& options)
+{
+    const std::size_t n{options.degree+1};
+    const auto x{chebyshev_nodes(n)};
+    std::vector<double> s;
+    s.reserve(panels.size()*n);
+    for (const auto& p: panels)
+        for (double xj: x)
+            s.push_back(0.5*(p.lower+p.upper)+0.5*(p.upper-p.lower)*xj);
+    const auto values{workers(s)};
+
+    std::vector<Panel> open;
+    for (std::size_t i=0; i<panels.size(); ++i) {
+        Panel& p{panels[i]};
+        p.coefficients = chebyshev_coefficients(&values[i*n],n);
+        double scale{0};
+        for (std::size_t j=0; j<n; ++j)
+            scale = std::max(scale,std::abs(values[i*n+j]));
+        // the neglected coefficients are estimated by the last ones, the
+        // factor 2 accounts for aliasing
+        double tail{0};
+        for (std::size_t k=n-std::min<std::size_t>(n-1,3); k<n; ++k)
+            tail += 2*std::abs(p.coefficients[k]);
+        p.converged = tail<=tolerance(options,scale);
+        if (!p.converged && 0.5*(p.upper-p.lower)>=options.min_width)
+            open.push_back(p);
+    }
+    return open;
+}
+} // anonymous namespace
+
+Surrogate Surrogate::build(const DispersiveIntegral& integral, double lower,
+        double upper, const Options& options)
+{
+    INSTR_SCOPE("disp::Surrogate::build");
+    if (!(lower<upper))
+        throw std::invalid_argument{"surrogate needs lower<upper"};
+    if (options.degree<2)
+        throw std::invalid_argument{"surrogate needs degree>=2"};
+
+    Workers workers{integral,options.threads};
+
+    // the integral is not smooth at the threshold
+    std::vector<Panel> panels;
+    if (lower<integral.sth && integral.sth<upper) {
+        panels.push_back(Panel{lower,integral.sth,{},true});
+        panels.push_back(Panel{integral.sth,upper,{},true});
+    }
+    else {
+        panels.push_back(Panel{lower,upper,{},true});
+    }
+
+    // Bisect `open` panels and fit the halves until all are converged.
+    // Panels are identified by their lower edge.
+    auto refine = [&](std::vector<Panel> open)
+    {
+        while (!open.empty()) {
+            std::vector<Panel> halves;
+            for (const auto& p: open) {
+                if (panels.size()+halves.size()/2>=options.max_panels)
+                    break;
+                const double mid{0.5*(p.lower+p.upper)};
+                halves.push_back(Panel{p.lower,mid,{},true});
+                halves.push_back(Panel{mid,p.upper,{},true});
+                panels.erase(std::find_if(panels.begin(),panels.end(),
+                            [&p](const Panel& q){return q.lower==p.lower;}));
+            }
+            if (halves.empty())
+                break;
+            open = fit(halves,workers,options);
+            panels.insert(panels.end(),halves.begin(),halves.end());
+        }
+    };
+    refine(fit(panels,workers,options));
+
+    Surrogate result;
+    result.num_sub_ = integral.num_sub;
+    result.err_ = integral.err;
+    result.degree = options.degree;
+    auto assemble = [&]
+    {
+        std::sort(panels.begin(),panels.end(),
+                [](const Panel& a, const Panel& b){return a.lower<b.lower;});
+        result.edges.clear();
+        result.coefficients.clear();
+        result.converged_ = true;
+        for (const auto& p: panels) {
+            result.edges.push_back(p.lower);
+            result.coefficients.insert(result.coefficients.end(),
+                    p.coefficients.begin(),p.coefficients.end());
+            result.converged_ = result.converged_ && p.converged;
+        }
+        result.edges.push_back(panels.back().upper);
+    };
+    assemble();
+
+    // validate at held-out points, refine the panels which fail. Besides
+    // random points, every panel is checked between its edges and the
+    // outermost nodes, where errors from the non-smooth behaviour at the
+    // threshold show up first.
+    std::mt19937 generator{1};
+    std::uniform_real_distribution<double> uniform{lower,upper};
+    const double outer{0.5*(1+chebyshev_nodes(options.degree+1)[0])};
+    for (std::size_t round=0; round<=options.refinements; ++round) {
+        std::vector<double> s(options.validation_points);
+        for (double& x: s)
+            x = uniform(generator);
+        for (const auto& p: panels) {
+            const double center{0.5*(p.lower+p.upper)};
+            const double half{0.5*(p.upper-p.lower)};
+            s.push_back(center-half*outer);
+            s.push_back(center+half*outer);
+        }
+        const auto direct{workers(s)};
+
+        result.validation_ = Validation{};
+        result.validation_.points = s.size();
+        std::vector<Panel> failed;
+        for (std::size_t k=0; k<s.size(); ++k) {
+            const double ratio{std::abs(result(s[k])-direct[k])
+                /tolerance(options,std::abs(direct[k]))};
+            if (ratio>result.validation_.max_ratio) {
+                result.validation_.max_ratio = ratio;
+                result.validation_.worst_s = s[k];
+            }
+            if (ratio<=1)
+                continue;
+            const auto p{std::find_if(panels.begin(),panels.end(),
+                    [&s,k](const Panel& q)
+                    {return q.lower<=s[k] && s[k]<=q.upper;})};
+            const bool known{std::any_of(failed.begin(),failed.end(),
+                    [&p](const Panel& q){return q.lower==p->lower;})};
+            if (!known && 0.5*(p->upper-p->lower)>=options.min_width)
+                failed.push_back(*p);
+        }
+        if (failed.empty() || round==options.refinements)
+            break;
+        refine(failed);
+        assemble();
+    }
+    return result;
+}
+
+Complex Surrogate::operator()(double s) const
+{
+    if (!covers(s))
+        throw std::domain_error{"s outside of the range of the surrogate"};
+    const auto i{static_cast<std::size_t>(std::upper_bound(edges.begin()+1,
+                edges.end()-1,s)-(edges.begin()+1))};
+    const double a{edges[i]};
+    const double b{edges[i+1]};
+    return clenshaw(&coefficients[i*(degree+1)],degree+1,(2*s-a-b)/(b-a));
+}
+
+void Surrogate::save(const std::string& path) const
+{
+    snapshot::Writer out;
+    out.sources(snapshot::sources());
+    out.u64(static_cast<std::uint64_t>(num_sub_));
+    out.u64(static_cast<std::uint64_t>(err_));
+    out.u64(degree);
+    out.u64(converged_);
+    out.u64(validation_.points);
+    out.f64(validation_.max_ratio);
+    out.f64(validation_.worst_s);
+    out.array(edges);
+    std::vector<double> flat;
+    flat.reserve(2*coefficients.size());
+    for (const auto& c: coefficients) {
+        flat.push_back(c.real());
+        flat.push_back(c.imag());
+    }
+    out.array(flat);
+    snapshot::write_file(path,magic,version,out);
+}
+
+Surrogate Surrogate::load(const std::string& path, bool verify_sources)
+{
+    const snapshot::Mapping file{path};
+    snapshot::Reader in{snapshot::open_file(file,magic,version,path)};
+    in.sources(path,verify_sources);
+
+    Surrogate result;
+    result.num_sub_ = static_cast<int>(in.u64());
+    result.err_ = static_cast<int>(in.u64());
+    result.degree = in.u64();
+    result.converged_ = in.u64()!=0;
+    result.validation_.points = in.u64();
+    result.validation_.max_ratio = in.f64();
+    result.validation_.worst_s = in.f64();
+    result.edges = in.array();
+    const auto flat{in.array()};
+    if (!in.done() || result.edges.size()<2 || result.degree<2
+            || flat.size()!=2*(result.edges.size()-1)*(result.degree+1))
+        throw snapshot::Error{path+" is not a consistent surrogate"};
+    result.coefficients.resize(flat.size()/2);
+    for (std::size_t i=0; i<result.coefficients.size(); ++i)
+        result.coefficients[i] = Complex{flat[2*i],flat[2*i+1]};
+    return result;
+}
+
+} // disp
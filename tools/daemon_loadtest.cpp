@@ -0,0 +1,106 @@
+// Load test for kaon_daemon: several concurrent clients send batched
+// requests for random points s and the latency distribution and the
+// throughput are reported.
+//
+// Usage: daemon_loadtest <socket> [clients] [requests per client]
+//        [points per request] [num_sub] [err]
+
+#include "client.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    if (argc<2) {
+        std::cerr<<"usage: daemon_loadtest <socket> [clients] [requests] \
+[points] [num_sub] [err]\n";
+        return EXIT_FAILURE;
+    }
+    const std::string path{argv[1]};
+    const int clients{argc>2 ? std::stoi(argv[2]) : 4};
+    const int requests{argc>3 ? std::stoi(argv[3]) : 100};
+    const std::size_t points{argc>4 ? std::stoul(argv[4]) : 16};
+    const int num_sub{argc>5 ? std::stoi(argv[5]) : 1};
+    const int err{argc>6 ? std::stoi(argv[6]) : 0};
+
+    // warm up: the first request constructs the instance
+    try {
+        server::Client client{path};
+        client.ping();
+        client.dispersive(num_sub,err,std::vector<double>{1.});
+    }
+    catch (const std::exception& e) {
+        std::cerr<<"daemon_loadtest: "<<e.what()<<'\n';
+        return EXIT_FAILURE;
+    }
+
+    std::mutex mutex;
+    std::vector<double> latencies;
+    int failures{0};
+    const auto start{std::chrono::steady_clock::now()};
+    std::vector<std::thread> threads;
+    for (int c=0; c<clients; ++c) {
+        threads.emplace_back([&,c]
+        {
+            std::vector<double> local;
+            int failed{0};
+            try {
+                server::Client client{path};
+                std::mt19937 generator(c);
+                std::uniform_real_distribution<double> uniform{0.1,2.};
+                std::vector<double> s(points);
+                for (int r=0; r<requests; ++r) {
+                    for (double& x: s)
+                        x = uniform(generator);
+                    const auto begin{std::chrono::steady_clock::now()};
+                    try {
+                        client.dispersive(num_sub,err,s);
+                    }
+                    catch (const std::runtime_error&) {
+                        ++failed;
+                    }
+                    local.push_back(std::chrono::duration<double>(
+                            std::chrono::steady_clock::now()-begin).count());
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr<<"client "<<c<<": "<<e.what()<<'\n';
+                failed = requests;
+            }
+            std::lock_guard<std::mutex> lock{mutex};
+            latencies.insert(latencies.end(),local.begin(),local.end());
+            failures += failed;
+        });
+    }
+    for (auto& t: threads)
+        t.join();
+    const double seconds{std::chrono::duration<double>(
+            std::chrono::steady_clock::now()-start).count()};
+
+    std::sort(latencies.begin(),latencies.end());
+    auto quantile = [&latencies](double q)
+    {
+        if (latencies.empty())
+            return 0.;
+        return latencies[static_cast<std::size_t>(q*(latencies.size()-1))];
+    };
+    std::cout<<std::fixed<<std::setprecision(3)
+        <<"clients "<<clients<<", requests "<<latencies.size()
+        <<", points per request "<<points<<", failures "<<failures<<'\n'
+        <<"throughput "<<latencies.size()/seconds<<" requests/s, "
+        <<latencies.size()*points/seconds<<" points/s\n"
+        <<"latency [ms] p50 "<<1e3*quantile(0.5)<<", p90 "
+        <<1e3*quantile(0.9)<<", p99 "<<1e3*quantile(0.99)<<", max "
+        <<1e3*quantile(1.)<<'\n';
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
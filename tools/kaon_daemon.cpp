@@ -0,0 +1,82 @@
+// Evaluation daemon: keeps DispersiveIntegral instances in memory and answers
+// batched requests over a Unix domain socket, see server.h. Clients use
+// server::Client from client.h.
+//
+// Usage: kaon_daemon <socket> [--workers n] [--preload num_sub,err]...
+// Stops on SIGINT or SIGTERM and removes the socket.
+// Like the library, it expects the data in ../../gammaKKpi_amp/.
+
+#include "server.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+server::Server* running{nullptr};
+
+extern "C" void handle_signal(int)
+{
+    if (running)
+        running->stop();
+}
+
+void usage()
+{
+    std::cerr<<"usage: kaon_daemon <socket> [--workers n] \
+[--preload num_sub,err]...\n";
+}
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    if (argc<2) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    server::Options options;
+    options.path = argv[1];
+    for (int i=2; i<argc; i+=2) {
+        if (i+1==argc) {
+            // an option without value
+            usage();
+            return EXIT_FAILURE;
+        }
+        const std::string key{argv[i]};
+        const std::string value{argv[i+1]};
+        if (key=="--workers") {
+            options.workers = std::stoul(value);
+        }
+        else if (key=="--preload") {
+            const auto comma{value.find(',')};
+            if (comma==std::string::npos) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            options.preload.emplace_back(std::stoi(value.substr(0,comma)),
+                    std::stoi(value.substr(comma+1)));
+        }
+        else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        server::Server daemon{options};
+        running = &daemon;
+        std::signal(SIGINT,handle_signal);
+        std::signal(SIGTERM,handle_signal);
+        std::cerr<<"kaon_daemon: listening on "<<options.path<<'\n';
+        daemon.run();
+        running = nullptr;
+        std::cerr<<"kaon_daemon: stopped, "<<daemon.instances().size()
+            <<" instances were constructed\n";
+    }
+    catch (const std::exception& e) {
+        std::cerr<<"kaon_daemon: "<<e.what()<<'\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
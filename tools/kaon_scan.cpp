@@ -0,0 +1,103 @@
+// Sharded scan runner for DispersiveIntegral, see scan.h.
+//
+// Usage:
+//   kaon_scan plan <job> <directory> <shards>
+//       print one `kaon_scan shard` command per shard, e.g. for a batch
+//       system, together with the points and estimated cost of the shard
+//   kaon_scan shard <job> <directory> <shards> <index>
+//       compute shard <index> and write its partial result, continuing
+//       from the checkpoint of an interrupted run
+//   kaon_scan run <job> <directory> <shards> [--workers n] [--output table]
+//       compute all shards without a valid partial in n local processes,
+//       then merge if an output is given
+//   kaon_scan merge <job> <directory> <shards> <table>
+//       check the partials and write the table
+// The job file format is described at scan::Job::read. Exits with a
+// non-zero status if a shard fails or the partials are incomplete.
+// Like the library, it expects the data in ../../gammaKKpi_amp/.
+
+#include "scan.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+void usage()
+{
+    std::cerr<<"usage: kaon_scan plan|shard|run|merge <job> <directory> \
+<shards> [index|table] [--workers n] [--output table]\n";
+}
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    if (argc<5) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    try {
+        const std::string mode{argv[1]};
+        const std::string path{argv[2]};
+        const scan::Job job{scan::Job::read(path)};
+        scan::Options options;
+        options.directory = argv[3];
+        options.shards = std::stoul(argv[4]);
+
+        if (mode=="plan") {
+            for (const auto& shard: scan::partition(job,options.shards))
+                std::cout<<argv[0]<<" shard "<<path<<' '<<options.directory
+                    <<' '<<shard.count<<' '<<shard.index<<"\t# points ["
+                    <<shard.begin<<","<<shard.end<<"), cost "
+                    <<scan::cost(job,shard.begin,shard.end)<<'\n';
+            return EXIT_SUCCESS;
+        }
+        if (mode=="shard" && argc==6) {
+            const auto shards{scan::partition(job,options.shards)};
+            const auto& shard{shards.at(std::stoul(argv[5]))};
+            scan::complete_shard(job,options.directory,shard);
+            return EXIT_SUCCESS;
+        }
+        if (mode=="merge" && argc==6) {
+            scan::merge(job,options.directory,options.shards).write(argv[5]);
+            return EXIT_SUCCESS;
+        }
+        if (mode=="run") {
+            std::string output;
+            for (int i=5; i<argc; i+=2) {
+                if (i+1==argc) {
+                    // an option without value
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                const std::string option{argv[i]};
+                if (option=="--workers")
+                    options.workers = std::stoul(argv[i+1]);
+                else if (option=="--output")
+                    output = argv[i+1];
+                else {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+            }
+            const auto failed{scan::run_local(job,options)};
+            if (!failed.empty()) {
+                std::cerr<<"failed shards:";
+                for (auto i: failed)
+                    std::cerr<<' '<<i;
+                std::cerr<<'\n';
+                return EXIT_FAILURE;
+            }
+            if (!output.empty())
+                scan::merge(job,options.directory,options.shards)
+                    .write(output);
+            return EXIT_SUCCESS;
+        }
+        usage();
+        return EXIT_FAILURE;
+    }
+    catch (const std::exception& e) {
+        std::cerr<<"kaon_scan: "<<e.what()<<'\n';
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,472 @@
+// Performance regression harness for end-to-end workloads.
+//
+// The workloads are
+//   construct: cold construction of DispersiveIntegral(1,0),
+//   scan:      500-point scan of DispersiveIntegral for err=0,1,2,
+//   output:    regeneration of the partial waves F1-F4 with Combination::f on
+//              the grid, as done by Combination::output(i) and hence by
+//              gammaKKpi::readin (in memory, the files are not touched),
+//   output_all: the same with Combination::f_all, as done by
+//              Combination::output_all.
+// Each workload runs in its own process, such that the peak resident set
+// size can be attributed to it. Wall time, peak RSS, the number of integrand
+// evaluations and a set of numerical results are recorded.
+//
+// Usage:
+//   perf_regression record <baseline.json> [options]
+//   perf_regression compare <baseline.json> [options]
+// Options:
+//   --repeat n               run every workload n times, keep the fastest
+//   --time-threshold x       allowed relative increase of wall time (0.10)
+//   --rss-threshold x        allowed relative increase of peak RSS (0.10)
+//   --evaluations-threshold x allowed relative increase of evaluations (0.05)
+//   --value-tolerance x      allowed relative deviation of results (1e-6)
+// `compare` exits with a non-zero status if any threshold is exceeded.
+//
+// Like the library, it expects the data in ../../gammaKKpi_amp/.
+
+#include "combination.h"
+#include "dispersiveintegral.h"
+#include "facilities.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+struct Measurement {
+    std::string name;
+    double seconds{0};
+    long peak_rss_kb{0};
+    double evaluations{0};
+    std::vector<double> values;
+};
+
+struct Options {
+    int repeat{1};
+    double time_threshold{0.10};
+    double rss_threshold{0.10};
+    double evaluations_threshold{0.05};
+    double value_tolerance{1e-6};
+};
+
+// -- Workloads ---------------------------------------------------------------
+
+void construct(Measurement& m)
+{
+    const disp::DispersiveIntegral integral{1,0};
+    auto& amplitude = integral.gammaKKpicdisc.absgammaKKpic;
+    m.values = {amplitude.a,amplitude.b,amplitude.a_err,amplitude.b_err,
+            integral.gammaKKpicdisc.absgammaKKpin.a,
+            integral.gammaKKpicdisc.absgammaKKpin.b};
+}
+
+void scan(Measurement& m)
+{
+    disp::DispersiveIntegral integral{1,0};
+    const auto grid{facilities::linspace(0.1,2.0,500)};
+    for (int err=0; err<=2; ++err) {
+        integral.err = err;
+        for (std::size_t k=0; k<grid.size(); ++k) {
+            gsl::Result report;
+            const Complex value{integral(grid[k],report)};
+            gsl::check(report.status);
+            m.evaluations += report.evaluations;
+            if (k%100==0 || k+1==grid.size()) {
+                m.values.push_back(value.real());
+                m.values.push_back(value.imag());
+            }
+        }
+    }
+}
+
+void output(Measurement& m)
+{
+    comb::Combination combination{0.9,1.0,-0.4,2.7,2,0.001};
+    const auto grid{combination.grid()};
+    for (int i=1; i<=4; ++i) {
+        for (std::size_t k=0; k<grid.size(); ++k) {
+            cauchy::ComplexResult report;
+            const Complex value{combination.f(i,grid[k],report)};
+            gsl::check(report.real.status);
+            gsl::check(report.imag.status);
+            m.evaluations += report.evaluations();
+            if (k%500==0) {
+                m.values.push_back(value.real());
+                m.values.push_back(value.imag());
+            }
+        }
+    }
+}
+
+void output_all(Measurement& m)
+{
+    comb::Combination combination{0.9,1.0,-0.4,2.7,2,0.001};
+    const auto grid{combination.grid()};
+    for (std::size_t k=0; k<grid.size(); ++k) {
+        multi::Result report;
+        const auto values{combination.f_all(grid[k],report)};
+        m.evaluations += report.evaluations;
+        if (k%500==0) {
+            for (const auto& v: values) {
+                m.values.push_back(v.real());
+                m.values.push_back(v.imag());
+            }
+        }
+    }
+}
+
+const std::map<std::string,void(*)(Measurement&)> workloads{
+    {"construct",construct},
+    {"scan",scan},
+    {"output",output},
+    {"output_all",output_all}};
+
+// -- Serialization -----------------------------------------------------------
+
+std::string serialize(const Measurement& m)
+{
+    std::ostringstream out;
+    out<<std::setprecision(17)<<"{\"name\": \""<<m.name<<"\", \"seconds\": "
+        <<m.seconds<<", \"peak_rss_kb\": "<<m.peak_rss_kb
+        <<", \"evaluations\": "<<m.evaluations<<", \"values\": [";
+    for (std::size_t i=0; i<m.values.size(); ++i)
+        out<<(i ? ", " : "")<<m.values[i];
+    out<<"]}";
+    return out.str();
+}
+
+/// Minimal reader for the JSON written by this program.
+class Reader {
+public:
+    explicit Reader(std::string text) : text{std::move(text)} {}
+
+    std::vector<Measurement> baseline()
+    {
+        std::vector<Measurement> result;
+        expect('{');
+        while (true) {
+            const std::string key{string()};
+            expect(':');
+            if (key=="workloads") {
+                expect('[');
+                while (peek()!=']') {
+                    result.push_back(measurement());
+                    if (peek()==',')
+                        ++pos;
+                }
+                expect(']');
+            }
+            else {
+                skip_value();
+            }
+            if (peek()==',') {
+                ++pos;
+                continue;
+            }
+            break;
+        }
+        expect('}');
+        return result;
+    }
+
+    Measurement measurement()
+    {
+        Measurement m;
+        expect('{');
+        while (peek()!='}') {
+            const std::string key{string()};
+            expect(':');
+            if (key=="name")
+                m.name = string();
+            else if (key=="seconds")
+                m.seconds = number();
+            else if (key=="peak_rss_kb")
+                m.peak_rss_kb = static_cast<long>(number());
+            else if (key=="evaluations")
+                m.evaluations = number();
+            else if (key=="values") {
+                expect('[');
+                while (peek()!=']') {
+                    m.values.push_back(number());
+                    if (peek()==',')
+                        ++pos;
+                }
+                expect(']');
+            }
+            else
+                skip_value();
+            if (peek()==',')
+                ++pos;
+        }
+        expect('}');
+        return m;
+    }
+private:
+    std::string text;
+    std::size_t pos{0};
+
+    char peek()
+    {
+        while (pos<text.size() && std::isspace(text[pos]))
+            ++pos;
+        if (pos==text.size())
+            throw std::runtime_error{"unexpected end of baseline"};
+        return text[pos];
+    }
+    void expect(char c)
+    {
+        if (peek()!=c)
+            throw std::runtime_error{std::string{"baseline: expected "}+c};
+        ++pos;
+    }
+    std::string string()
+    {
+        expect('"');
+        const std::size_t end{text.find('"',pos)};
+        if (end==std::string::npos)
+            throw std::runtime_error{"baseline: unterminated string"};
+        std::string s{text.substr(pos,end-pos)};
+        pos = end+1;
+        return s;
+    }
+    double number()
+    {
+        peek();
+        std::size_t length{0};
+        const double x{std::stod(text.substr(pos),&length)};
+        pos += length;
+        return x;
+    }
+    void skip_value()
+    {
+        const char c{peek()};
+        if (c=='"') {
+            string();
+            return;
+        }
+        if (c=='{' || c=='[') {
+            int depth{0};
+            do {
+                if (text[pos]=='{' || text[pos]=='[')
+                    ++depth;
+                else if (text[pos]=='}' || text[pos]==']')
+                    --depth;
+                ++pos;
+            } while (depth && pos<text.size());
+            return;
+        }
+        number();
+    }
+};
+
+// -- Running -----------------------------------------------------------------
+
+Measurement run_isolated(const std::string& name)
+    // Run the workload in a child process and read its measurement via a pipe.
+{
+    int fd[2];
+    if (pipe(fd))
+        throw std::runtime_error{"could not create pipe"};
+    const pid_t pid{fork()};
+    if (pid<0)
+        throw std::runtime_error{"could not fork"};
+    if (pid==0) {
+        close(fd[0]);
+        int status{EXIT_SUCCESS};
+        std::string message;
+        try {
+            Measurement m;
+            m.name = name;
+            const auto start{std::chrono::steady_clock::now()};
+            workloads.at(name)(m);
+            m.seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now()-start).count();
+            rusage usage;
+            getrusage(RUSAGE_SELF,&usage);
+            m.peak_rss_kb = usage.ru_maxrss;
+            message = serialize(m);
+        }
+        catch (const std::exception& e) {
+            std::cerr<<name<<": "<<e.what()<<'\n';
+            status = EXIT_FAILURE;
+        }
+        std::size_t written{0};
+        while (written<message.size()) {
+            const ssize_t n{write(fd[1],message.data()+written,
+                    message.size()-written)};
+            if (n<=0)
+                break;
+            written += n;
+        }
+        close(fd[1]);
+        _exit(status);
+    }
+    close(fd[1]);
+    std::string message;
+    char buffer[4096];
+    ssize_t n;
+    while ((n=read(fd[0],buffer,sizeof(buffer)))>0)
+        message.append(buffer,n);
+    close(fd[0]);
+    int status{0};
+    waitpid(pid,&status,0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)!=EXIT_SUCCESS)
+        throw std::runtime_error{"workload "+name+" failed"};
+    return Reader{message}.measurement();
+}
+
+std::vector<Measurement> run_all(const Options& options)
+{
+    std::vector<Measurement> result;
+    for (const auto& w: workloads) {
+        Measurement best;
+        for (int r=0; r<options.repeat; ++r) {
+            const Measurement m{run_isolated(w.first)};
+            if (r==0 || m.seconds<best.seconds)
+                best = m;
+        }
+        std::cerr<<std::left<<std::setw(10)<<best.name<<std::right
+            <<std::fixed<<std::setprecision(3)<<std::setw(10)<<best.seconds
+            <<" s "<<std::setw(10)<<best.peak_rss_kb<<" kB "
+            <<std::setprecision(0)<<std::setw(14)<<best.evaluations
+            <<" evaluations\n"<<std::defaultfloat;
+        result.push_back(best);
+    }
+    return result;
+}
+
+bool exceeds(double current, double baseline, double threshold)
+{
+    return baseline>0 && current>baseline*(1+threshold);
+}
+
+bool compare(const std::vector<Measurement>& baseline,
+        const std::vector<Measurement>& current, const Options& options)
+{
+    bool ok{true};
+    for (const auto& c: current) {
+        const auto b{std::find_if(baseline.begin(),baseline.end(),
+                [&c](const Measurement& m){return m.name==c.name;})};
+        if (b==baseline.end()) {
+            std::cout<<c.name<<": not in baseline\n";
+            continue;
+        }
+        std::vector<std::string> failures;
+        if (exceeds(c.seconds,b->seconds,options.time_threshold))
+            failures.push_back("wall time");
+        if (exceeds(c.peak_rss_kb,b->peak_rss_kb,options.rss_threshold))
+            failures.push_back("peak RSS");
+        if (exceeds(c.evaluations,b->evaluations,
+                    options.evaluations_threshold))
+            failures.push_back("evaluations");
+        bool values_ok{c.values.size()==b->values.size()};
+        for (std::size_t i=0; values_ok && i<c.values.size(); ++i) {
+            const double scale{std::max(std::abs(b->values[i]),1e-300)};
+            values_ok = std::abs(c.values[i]-b->values[i])
+                <= options.value_tolerance*scale;
+        }
+        if (!values_ok)
+            failures.push_back("numerical results");
+
+        std::cout<<std::left<<std::setw(10)<<c.name<<std::right<<std::fixed
+            <<std::setprecision(3)<<"time "<<b->seconds<<" -> "<<c.seconds
+            <<" s, RSS "<<b->peak_rss_kb<<" -> "<<c.peak_rss_kb
+            <<" kB, evaluations "<<std::setprecision(0)<<b->evaluations
+            <<" -> "<<c.evaluations<<std::defaultfloat;
+        if (failures.empty()) {
+            std::cout<<"  ok\n";
+        }
+        else {
+            ok = false;
+            std::cout<<"  REGRESSION:";
+            for (const auto& f: failures)
+                std::cout<<' '<<f;
+            std::cout<<'\n';
+        }
+    }
+    return ok;
+}
+
+void usage()
+{
+    std::cerr<<"usage: perf_regression record|compare <baseline.json> \
+[--repeat n] [--time-threshold x] [--rss-threshold x] \
+[--evaluations-threshold x] [--value-tolerance x]\n";
+}
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    if (argc<3) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    const std::string mode{argv[1]};
+    const std::string path{argv[2]};
+    Options options;
+    for (int i=3; i<argc; i+=2) {
+        if (i+1==argc) {
+            // an option without value
+            usage();
+            return EXIT_FAILURE;
+        }
+        const std::string key{argv[i]};
+        const double value{std::stod(argv[i+1])};
+        if (key=="--repeat")
+            options.repeat = std::max(1,static_cast<int>(value));
+        else if (key=="--time-threshold")
+            options.time_threshold = value;
+        else if (key=="--rss-threshold")
+            options.rss_threshold = value;
+        else if (key=="--evaluations-threshold")
+            options.evaluations_threshold = value;
+        else if (key=="--value-tolerance")
+            options.value_tolerance = value;
+        else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        if (mode=="record") {
+            const auto measurements{run_all(options)};
+            auto out{facilities::open_write(path,17)};
+            out<<"{\"workloads\": [\n";
+            for (std::size_t i=0; i<measurements.size(); ++i)
+                out<<"  "<<serialize(measurements[i])
+                    <<(i+1<measurements.size() ? ",\n" : "\n");
+            out<<"]}\n";
+            return EXIT_SUCCESS;
+        }
+        if (mode=="compare") {
+            auto in{facilities::open_read(path)};
+            std::stringstream text;
+            text<<in.rdbuf();
+            const auto baseline{Reader{text.str()}.baseline()};
+            const auto current{run_all(options)};
+            return compare(baseline,current,options) ? EXIT_SUCCESS
+                : EXIT_FAILURE;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr<<"perf_regression: "<<e.what()<<'\n';
+        return EXIT_FAILURE;
+    }
+    usage();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,268 @@
+// Accuracy-versus-cost study of the quadrature rules available for the
+// dispersive integral (DispersiveIntegral::numeric_integral_cauchy/_trivial)
+// and the angular projection (Combination::f).
+//
+// Every rule and tolerance is run over representative grids of s in the
+// subthreshold, threshold, resonance and tail region and compared to a
+// high-precision reference. For each region a table of the maximal relative
+// error versus wall time is printed, Pareto-optimal settings are marked
+// with '*'.
+//
+// Usage: quadrature_study [points_per_region]
+// Like the library, it expects the data in ../../gammaKKpi_amp/.
+
+#include "combination.h"
+#include "dispersiveintegral.h"
+#include "facilities.h"
+#include "gsl_interface.h"
+#include "multi_integration.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+using Integrator = std::function<gsl::Result(const gsl::Function&,double,
+        double)>;
+
+struct Method {
+    std::string name;
+    Integrator integrate;
+};
+
+struct Region {
+    std::string name;
+    double lower;
+    double upper;
+};
+
+struct Measurement {
+    std::string method;
+    double error{0};
+    double seconds{0};
+    std::size_t evaluations{0};
+    bool failed{false};
+};
+
+/// A family of integrals to be studied, e.g. f(s') for a grid of s.
+struct Problem {
+    std::string name;
+    std::vector<Region> regions;
+    std::function<std::vector<gsl::Function>(double s)> integrands;
+        // several integrands per s, e.g. real and imaginary part
+    double lower;
+    std::function<double(double s)> upper;
+};
+
+gsl::Settings settings(double relative)
+{
+    gsl::Settings set;
+    set.relative_precision = relative;
+    set.space = 10000;
+    return set;
+}
+
+gsl::Result gauss_legendre(const gsl::GaussLegendre& rule,
+        const gsl::Function& f, double lower, double upper)
+{
+    // infinite upper limits are mapped to [0,1] as in gsl::Cquad
+    gsl::Result r;
+    const bool infinite{std::isinf(upper)};
+    const double a{infinite ? 0. : lower};
+    const double b{infinite ? 1. : upper};
+    for (std::size_t i=0; i<rule.size(); ++i) {
+        const auto point{rule.point(a,b,i)};
+        const double x{point.first};
+        r.value += infinite
+            ? point.second*f(lower+(1-x)/x)/(x*x)
+            : point.second*f(x);
+    }
+    r.evaluations = rule.size();
+    return r;
+}
+
+std::vector<Method> methods()
+{
+    std::vector<Method> m;
+    for (double rel: {1e-4,1e-5,1e-6,1e-7,1e-8}) {
+        std::ostringstream tol;
+        tol<<std::scientific<<std::setprecision(0)<<rel;
+        const gsl::Cquad cquad{settings(rel)};
+        m.push_back({"cquad rel="+tol.str(),
+                [cquad](const gsl::Function& f, double a, double b)
+                {return cquad.integrate(f,a,b);}});
+        const gsl::Qag qag{settings(rel)};
+        m.push_back({"qag rel="+tol.str(),
+                [qag](const gsl::Function& f, double a, double b)
+                {return qag.integrate(f,a,b);}});
+        multi::Integration gk{1,settings(rel)};
+        m.push_back({"multi rel="+tol.str(),
+                [gk](const gsl::Function& f, double a, double b)
+                {
+                    const auto r{gk([&f](std::size_t n, const double* x,
+                                double* v)
+                            {
+                                for (std::size_t i=0; i<n; ++i)
+                                    v[i] = f(x[i]);
+                            },a,b)};
+                    gsl::Result result;
+                    result.value = r.values[0];
+                    result.error = r.errors[0];
+                    result.evaluations = r.evaluations;
+                    result.intervals = r.intervals;
+                    return result;
+                }});
+    }
+    for (std::size_t n: {50,100,200,400,800}) {
+        const auto rule{std::make_shared<gsl::GaussLegendre>(n)};
+        m.push_back({"gauss-legendre n="+std::to_string(n),
+                [rule](const gsl::Function& f, double a, double b)
+                {return gauss_legendre(*rule,f,a,b);}});
+    }
+    return m;
+}
+
+double reference(const gsl::Function& f, double lower, double upper)
+{
+    gsl::Settings set{settings(1e-12)};
+    set.space = 100000;
+    const gsl::Result r{gsl::Cquad{set}.integrate(f,lower,upper)};
+    if (r.converged())
+        return r.value;
+    return gsl::Qag{set}(f,lower,upper).first;
+}
+
+bool dominates(const Measurement& a, const Measurement& b)
+{
+    return a.seconds<=b.seconds && a.error<=b.error
+        && (a.seconds<b.seconds || a.error<b.error);
+}
+
+void study(const Problem& problem, std::size_t points)
+{
+    const auto all{methods()};
+    for (const auto& region: problem.regions) {
+        const auto grid{facilities::linspace(region.lower,region.upper,
+                points)};
+
+        // reference values
+        std::vector<std::vector<gsl::Function>> integrands;
+        std::vector<std::vector<double>> references;
+        for (double s: grid) {
+            integrands.push_back(problem.integrands(s));
+            std::vector<double> ref;
+            for (const auto& f: integrands.back())
+                ref.push_back(reference(f,problem.lower,problem.upper(s)));
+            references.push_back(ref);
+        }
+
+        std::vector<Measurement> measurements;
+        for (const auto& method: all) {
+            Measurement m;
+            m.method = method.name;
+            for (std::size_t k=0; k<grid.size(); ++k) {
+                double norm{0};
+                double difference{0};
+                for (std::size_t j=0; j<integrands[k].size(); ++j) {
+                    const auto start{std::chrono::steady_clock::now()};
+                    gsl::Result r;
+                    try {
+                        r = method.integrate(integrands[k][j],problem.lower,
+                                problem.upper(grid[k]));
+                    }
+                    catch (const gsl::Error&) {
+                        m.failed = true;
+                    }
+                    m.seconds += std::chrono::duration<double>(
+                            std::chrono::steady_clock::now()-start).count();
+                    m.evaluations += r.evaluations;
+                    m.failed = m.failed || !r.converged();
+                    norm += std::pow(references[k][j],2);
+                    difference += std::pow(r.value-references[k][j],2);
+                }
+                const double error{norm>0 ? std::sqrt(difference/norm)
+                        : std::sqrt(difference)};
+                m.error = std::max(m.error,error);
+            }
+            if (m.failed || !std::isfinite(m.error))
+                m.error = std::numeric_limits<double>::infinity();
+            measurements.push_back(m);
+        }
+
+        std::sort(measurements.begin(),measurements.end(),
+                [](const Measurement& a, const Measurement& b)
+                {return a.seconds<b.seconds;});
+        std::cout<<"\n"<<problem.name<<", region "<<region.name<<" (s in ["
+            <<region.lower<<","<<region.upper<<"], "<<points<<" points)\n"
+            <<std::left<<std::setw(26)<<"method"<<std::right<<std::setw(14)
+            <<"max rel err"<<std::setw(14)<<"time [ms]"<<std::setw(14)
+            <<"evaluations"<<"  pareto\n";
+        for (const auto& m: measurements) {
+            const bool pareto{std::none_of(measurements.begin(),
+                    measurements.end(),[&m](const Measurement& other)
+                    {return dominates(other,m);})};
+            std::cout<<std::left<<std::setw(26)<<m.method<<std::right
+                <<std::setw(14)<<std::scientific<<std::setprecision(2)
+                <<m.error<<std::setw(14)<<std::fixed<<std::setprecision(3)
+                <<1e3*m.seconds<<std::setw(14)<<m.evaluations
+                <<(pareto && !m.failed ? "  *" : "")
+                <<(m.failed ? "  (failed)" : "")<<'\n';
+        }
+        std::cout<<std::defaultfloat<<std::setprecision(6);
+    }
+}
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t points{argc>1 ? std::stoul(argv[1]) : 5};
+
+    disp::DispersiveIntegral dispersive{1,0};
+    const double sth{dispersive.sth};
+    const Region subthreshold{"subthreshold",0.1,sth-0.01};
+    const Region threshold{"threshold",sth+1e-3,sth+0.1};
+    const Region resonance{"resonance",0.7,0.95};
+    const Region tail{"tail",1.2,1.9};
+
+    Problem dispersion;
+    dispersion.name = "dispersive integral (num_sub=1, err=0)";
+    dispersion.regions = {subthreshold,threshold,resonance,tail};
+    dispersion.lower = sth;
+    dispersion.upper = [&dispersive](double){return dispersive.cutoff;};
+    dispersion.integrands = [&dispersive,sth](double s)
+    {
+        if (s<sth)
+            return std::vector<gsl::Function>{[&dispersive,s](double x)
+                    {return dispersive.integrand_trivial(s,x);}};
+        return std::vector<gsl::Function>{[&dispersive,s](double x)
+                {return dispersive.integrand_cauchy(s,x);}};
+    };
+    study(dispersion,points);
+
+    comb::Combination combination{0.9,1.0,-0.4,2.7,2,0.001};
+    for (int i=1; i<=4; ++i) {
+        Problem angular;
+        angular.name = "angular projection f("+std::to_string(i)+",s)";
+        angular.regions = {threshold,resonance,tail};
+        angular.lower = -1;
+        angular.upper = [](double){return 1.;};
+        angular.integrands = [&combination,i](double s)
+        {
+            const auto c{combination.Fhat_integrand(i,s)};
+            return std::vector<gsl::Function>{
+                    [c](double z){return c(z).real();},
+                    [c](double z){return c(z).imag();}};
+        };
+        study(angular,points);
+    }
+    return EXIT_SUCCESS;
+}